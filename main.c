@@ -13,8 +13,15 @@
 #include <string.h>
 #include <sched.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <math.h>
 
 #include "test_parameters.h"
 #include "tests.h"
@@ -22,9 +29,11 @@
 
 #define DEFAULT_CHUNK_SIZE 8096
 #define DEFAULT_COMPRESSION_LEVEL -1
+#define DEFAULT_MEM_LEVEL 8
 #define DEFAULT_THREAD_COUNT 1
 #define DEFAULT_CORE_COUNT 1
 #define DEFAULT_TEST_COUNT 1
+#define DEFAULT_VERIFY_INTERVAL 1
 #define CPU_STATUS_LINE_LENGTH 1024
 #define TAG_LENGTH 10
 #define CPU_TIME_MULTIPLIER 10000
@@ -45,25 +54,73 @@ static int startupfinished_thread_count;
 /* thread_count - number of threads to create */
 static int thread_count = DEFAULT_THREAD_COUNT;
 
+/* proc_count - number of single threaded worker processes to fork instead
+   of threads, 0 runs the workers as threads */
+static int proc_count = 0;
+
 /* define the initial test values */
 static int core_count = DEFAULT_CORE_COUNT;
 static int test_count = DEFAULT_TEST_COUNT;
 static int actual_test_count = 0;
-static int test_size = 0;
 static int cpu_affinity = 0;
 static int test_type = 0;
 static int cpu_core_info = 0;
 static char *FileNameOrPath;
 static int filenamePathSet = 0;
 static int compression_level = DEFAULT_COMPRESSION_LEVEL;
+static int mem_level = DEFAULT_MEM_LEVEL;
+static int window_bits = MAX_WBITS;
+static int strategy = Z_DEFAULT_STRATEGY;
+static float target_mbps = 0;
+static float target_ratio = 0;
 static int chunk_size = DEFAULT_CHUNK_SIZE;
+static size_dist_t size_dist;
 static int corpus = CALGARY_CORPUS;
 static int enable_deflate_buffering = 1;
 static int enable_inflate_buffering = 1;
 static int stream_type = GZIP_DEFLATE_STREAM;
 static int allow_partial_chunks = 0;
 static int verify = 0;
-static float ratio = 0;
+static int verify_interval = DEFAULT_VERIFY_INTERVAL;
+static unsigned long state_bytes = 0;
+static int outbuf_size = 0;
+static int sink_type = SINK_DISCARD;
+static char *sink_path = "";
+static char *bgzf_path = "";
+static int mix_deflate = 50;
+static int mix_inflate = 50;
+static int mix_per_thread = 0;
+static float rate = 0;
+static int flush_policy = FLUSH_POLICY_OFF;
+static unsigned long flush_every = 1;
+static int flush_bytes = 0;
+static int inflate_engine = INFLATE_ENGINE_INFLATE;
+static int batch_records = 256;
+static unsigned long batch_min = 200;
+static unsigned long batch_max = 2048;
+static int offload_engines = 1;
+static int offload_depth = 8;
+static int offload_batch = 1;
+static offload_device_t offload_device;
+static offload_device_t *offload = NULL;
+#define MAX_STREAMS_SWEEP 16
+static int streams_sweep[MAX_STREAMS_SWEEP] = { 1, 16, 256 };
+static int streams_sweeps = 3;
+static int scale_max = 0;
+static int scale_every = 0;
+static int scale_threads = 0;
+static int scale_step = 0;
+static int freq_interval = 0;
+static char *replay_path = NULL;
+static int replay_paced = 0;
+static replay_trace_t replay_trace;
+static replay_trace_t *replay = NULL;
+static freq_monitor_t freq;
+static metrics_server_t metrics;
+static unsigned long long run_start_nsec = 0;
+static char *trace_path = NULL;
+static int trace_calls = 0;
+static trace_ring_t *trace_rings = NULL;
 static int failure_occured = 0;
 
 /* Thread_info structure declaration */
@@ -72,9 +129,32 @@ typedef struct
     pthread_t th;
     int id;
     int count;
+    int group;
+    int core;
 }
 THREAD_INFO;
 
+/* What one worker thread or process did in its run, the report adds these
+   up rather than taking one worker's figures as every worker's. bytes is
+   the uncompressed data throughput is measured on, bytes_in and bytes_out
+   what went into and came out of zlib. run_nsec and cpu_nsec leave out
+   the verification of the worker, verify_nsec and verify_cpu_nsec are what
+   it took (the CPU time with that of its crc32 helpers). */
+typedef struct
+{
+    unsigned long single_call_bytes;
+    int iterations;
+    float ratio;
+    double bytes;
+    double bytes_in;
+    double bytes_out;
+    unsigned long long run_nsec;
+    unsigned long long cpu_nsec;
+    unsigned long long verify_nsec;
+    unsigned long long verify_cpu_nsec;
+}
+worker_result_t;
+
 #define MAX_STAT 10
 #define MAX_CORE 32
 typedef union
@@ -101,6 +181,76 @@ static cpu_time_t cpu_context;
 #define MAX_THREAD 1024
 
 THREAD_INFO tinfo[MAX_THREAD];
+static worker_result_t results[MAX_THREAD];
+
+#define MAX_GROUP 16
+
+/* A group of threads of a -scenario file, each group runs its own test
+   with its own settings next to the other groups */
+typedef struct
+{
+    char name[32];
+    int threads;
+    int count;
+    int type;
+    int level;
+    int chunk;
+    int stream;
+    int corpus;
+    float rate;
+    int cpus[MAX_CORE];
+    int ncpus;
+}
+scenario_group_t;
+
+static char *scenario_path = NULL;
+static scenario_group_t groups[MAX_GROUP];
+static int group_count = 0;
+
+/* Results of the worker processes in -procs mode, kept in a shared
+   anonymous mapping. done is set by a worker once its results are written,
+   a worker that exits without it died during the run. */
+typedef struct
+{
+    struct
+    {
+        worker_result_t result;
+        int done;
+        int failed;
+        unsigned long state_bytes;
+        struct rusage usage;
+    } worker[MAX_THREAD];
+}
+shared_results_t;
+
+/******************************************************************************
+* function:
+*     memory_status (unsigned long *hwm_kb, unsigned long *rss_kb)
+*
+* @param hwm_kb [OUT] - peak resident set size of the process in KB
+* @param rss_kb [OUT] - resident set size now in KB
+*
+* description:
+*   read VmHWM and VmRSS from /proc/self/status, returns -1 when they are
+*   not there
+******************************************************************************/
+static int memory_status(unsigned long *hwm_kb, unsigned long *rss_kb)
+{
+    char line[128];
+    FILE *status = fopen("/proc/self/status", "r");
+    int found = 0;
+
+    if (NULL == status)
+        return -1;
+    while (fgets(line, sizeof(line), status))
+    {
+        if (sscanf(line, "VmHWM: %lu", hwm_kb) == 1 ||
+            sscanf(line, "VmRSS: %lu", rss_kb) == 1)
+            found++;
+    }
+    fclose(status);
+    return found == 2 ? 0 : -1;
+}
 
 /******************************************************************************
 * function:
@@ -251,6 +401,45 @@ static char *test_name(int test)
         case TEST_CORPUS_DECOMPRESSION:
             return "Corpus Decompression";
             break;
+        case TEST_CORPUS_DICTIONARY:
+            return "Corpus Preset Dictionary";
+            break;
+        case TEST_CORPUS_AUTOTUNE:
+            return "Corpus Auto-tune";
+            break;
+        case TEST_CORPUS_CHECKSUM:
+            return "Corpus Checksum";
+            break;
+        case TEST_CORPUS_BGZF:
+            return "Corpus BGZF";
+            break;
+        case TEST_CORPUS_ZRAN:
+            return "Corpus Random Access";
+            break;
+        case TEST_CORPUS_MIXED:
+            return "Corpus Mixed";
+            break;
+        case TEST_CORPUS_FLUSH:
+            return "Corpus Flush Policy";
+            break;
+        case TEST_CORPUS_BATCH:
+            return "Corpus Record Batch";
+            break;
+        case TEST_CORPUS_OFFLOAD:
+            return "Corpus Async Offload";
+            break;
+        case TEST_CORPUS_STREAMS:
+            return "Corpus Concurrent Streams";
+            break;
+        case TEST_CORPUS_MEMORY:
+            return "Corpus Memory Profile";
+            break;
+        case TEST_CORPUS_REPLAY:
+            return "Corpus Traffic Replay";
+            break;
+        case TEST_CORPUS_MESSAGES:
+            return "Corpus Message Sizes";
+            break;
         case 0:
             return "invalid";
             break;
@@ -313,6 +502,100 @@ static char *streamtype_name(int selectedstreamtype)
     return "*unknown*";
 }
 
+/******************************************************************************
+* function:
+*           *flush_name(int selectedflush)
+*
+* @param selectedflush [IN] - deflate flush value
+*
+* description:
+*   flush_name maps the flush values of a -flush schedule to a textual name
+******************************************************************************/
+static char *flush_name(int selectedflush)
+{
+    switch (selectedflush)
+    {
+        case Z_NO_FLUSH:
+            return "none";
+        case Z_PARTIAL_FLUSH:
+            return "partial";
+        case Z_SYNC_FLUSH:
+            return "sync";
+        case Z_FULL_FLUSH:
+            return "full";
+        case Z_BLOCK:
+            return "block";
+    }
+    return NULL;
+}
+
+/******************************************************************************
+* function:
+*           *strategy_name(int selectedstrategy)
+*
+* @param selectedstrategy [IN] - deflate strategy
+*
+* description:
+*   strategy_name maps the zlib strategy to a textual name
+******************************************************************************/
+static char *strategy_name(int selectedstrategy)
+{
+    switch (selectedstrategy)
+    {
+        case Z_DEFAULT_STRATEGY:
+            return "Default";
+            break;
+        case Z_FILTERED:
+            return "Filtered";
+            break;
+        case Z_HUFFMAN_ONLY:
+            return "Huffman only";
+            break;
+        case Z_RLE:
+            return "RLE";
+            break;
+        case Z_FIXED:
+            return "Fixed";
+            break;
+    }
+    return "*unknown*";
+}
+
+/******************************************************************************
+* function:
+*           *sink_name(int selectedsink)
+*
+* @param selectedsink [IN] - output sink type
+*
+* description:
+*   sink_name maps the output sink enum to a textual name
+******************************************************************************/
+static char *sink_name(int selectedsink)
+{
+    switch (selectedsink)
+    {
+        case SINK_DISCARD:
+            return "Discard";
+            break;
+        case SINK_RING:
+            return "Copy into a ring buffer";
+            break;
+        case SINK_FILE:
+            return "write() to file or pipe (-sinkfile)";
+            break;
+        case SINK_PWRITEV:
+            return "pwritev() to file (-sinkfile)";
+            break;
+        case SINK_SPLICE:
+            return "vmsplice() to a pipe and splice() to file or pipe (-sinkfile)";
+            break;
+        case SINK_DIRECT:
+            return "O_DIRECT aligned writes to file (-sinkfile)";
+            break;
+    }
+    return "*unknown*";
+}
+
 /******************************************************************************
 * function:
 *           usage(char *program)
@@ -328,28 +611,81 @@ static void usage(char *program)
     int i;
 
     printf("\nUsage:\n");
-    printf("\t%s [-t <type>] [-c <count>] [-n <count>] [-nc <count>]"
-           " [-k <size>] [-o <corpus>] [-u]"
+    printf("\t%s [-t <type>] [-c <count>] [-n <count>] [-procs <count>] [-nc <count>]"
+           " [-k <size|distribution>] [-o <corpus>] [-u]"
            " [-af] [-f <filepath>] [-l <compressionlevel>]"
+           " [-ml <memlevel>] [-wb <windowbits>] [-st <strategy>]"
            " [-ddb] [-dib] [-s <streamtype>]"
-           " [-pc] [-v] [-h]\n", program);
+           " [-tput <Mbps>] [-ratio <ratio>]"
+           " [-outbuf <bytes>] [-sink <sink>] [-sinkfile <path>]"
+           " [-bgzfout <path>] [-mix <deflate>:<inflate>] [-mixthreads]"
+           " [-rate <ops/sec>] [-scenario <file>] [-metrics <port|path>]"
+           " [-trace <file.json>] [-tracecalls] [-flush <policy>[:<every>]]"
+           " [-engine <inflate|back>] [-batch <records>[:<min>-<max>]]"
+           " [-offload <engines>[:<depth>[:<batch>]]] [-streams <count>[,<count>...]]"
+           " [-scale <threads>[:all]] [-freq <msec>]"
+           " [-replay <file.csv>] [-replaypaced] [-pc] [-v] [-vi <interval>] [-h]\n", program);
     printf("Where:\n");
     printf("\t-t   specifies the test type to run (see below)\n");
     printf("\t-c   specifies the test iteration count\n");
     printf("\t-n   specifies the number of threads to run\n");
+    printf("\t-procs runs this many single threaded worker processes instead of threads\n");
     printf("\t-nc  specifies the number of CPU cores\n");
-    printf("\t-k   specifies the chunk size in bytes\n");
+    printf("\t-k   specifies the chunk and message size in bytes, or a distribution of\n");
+    printf("\t     them every thread draws its sizes from (see below)\n");
     printf("\t-o   specifies the corpus to use for the tests (see below)\n");
     printf("\t-u   display cpu usage per core\n");
     printf("\t-af  enables core affinity\n");
     printf("\t-f   specifies the filepath for a corpus test\n");
     printf("\t-l   specifies the compression level\n");
+    printf("\t-ml  specifies the deflate memLevel (1-9)\n");
+    printf("\t-wb  specifies the window size as windowBits (9-15)\n");
+    printf("\t-st  specifies the deflate strategy (see below)\n");
     printf("\t-ddb disables internal buffering for shim deflate\n");
     printf("\t-dib disables internal buffering for shim inflate\n");
     printf("\t-s   specifies the type of deflate stream (see below)\n");
+    printf("\t-tput auto-tune: recommend the best ratio at or above this Mbps\n");
+    printf("\t-ratio auto-tune: recommend the fastest setting at or below this ratio\n");
+    printf("\t-outbuf deflate/inflate into a buffer of this many bytes drained on every refill\n");
+    printf("\t-sink specifies where the -outbuf buffer is drained to (see below)\n");
+    printf("\t-sinkfile specifies the file or pipe for the file sink\n");
+    printf("\t-bgzfout BGZF test: write each thread's object and .gzi index to <path>.<id>\n");
+    printf("\t-mix mixed test: ratio of deflate to inflate operations (default 50:50)\n");
+    printf("\t-mixthreads mixed test: dedicate threads to one operation instead of drawing each one\n");
+    printf("\t-rate limit every thread to this many operations per second\n");
+    printf("\t-scenario run the thread groups described in a file, one group per line:\n");
+    printf("\t     <name> [threads=N] [count=N] [type=N] [level=N] [chunk=N] [stream=N]\n");
+    printf("\t     [corpus=N] [rate=ops/sec] [cpus=0-3,6]\n");
+    printf("\t     settings a group leaves out are taken from the command line\n");
+    printf("\t-metrics serve live Prometheus metrics on this localhost port or Unix socket path\n");
+    printf("\t-trace write a Chrome trace event timeline of every worker to <file.json>\n");
+    printf("\t-tracecalls add each init, deflate/inflate and end call to the -trace timeline\n");
+    printf("\t-flush deflate with a flush schedule instead of -ddb (see below), the flush\n");
+    printf("\t     policy test compares all the policies at its interval\n");
+    printf("\t-engine decompression test: inflate with the inflate() state machine (inflate,\n");
+    printf("\t     the default) or with inflateBack callbacks (back), back also prints an\n");
+    printf("\t     inflate against inflateBack table when the run is over\n");
+    printf("\t-batch record batch test: records per batch and their smallest and largest\n");
+    printf("\t     size in bytes (default 256:200-2048)\n");
+    printf("\t-offload offload test: engine threads of the software device, requests in\n");
+    printf("\t     flight per thread and requests per submit call (default 1:8:1)\n");
+    printf("\t-streams concurrent streams test: live streams per thread, a set of each\n");
+    printf("\t     count is run in turn (default 1,16,256)\n");
+    printf("\t-scale runs the test at 1, 2, 4 ... up to this many threads, or at every\n");
+    printf("\t     count with :all, each thread doing -c iterations at every step, and\n");
+    printf("\t     fits the Universal Scalability Law to the throughput\n");
+    printf("\t-replay traffic replay test: CSV trace of timestamp_usec,deflate|inflate,size,\n");
+    printf("\t     level,raw|zlib|gzip records, each worker replays every -n th record\n");
+    printf("\t     as one stream on a slice of the corpus, -c passes over the trace\n");
+    printf("\t-replaypaced replay the records at their recorded times, not back to back\n");
+    printf("\t-freq sample the clock of every core at this interval while the workers run\n");
+    printf("\t     and report it per worker core, flagging a run that was throttled\n");
     printf("\t-pc  allow partial chunks\n");
-    printf("\t-v   enable verification of data (use with -c 1)\n");
+    printf("\t-v   enable verification of data\n");
+    printf("\t-vi  verify one iteration in this many per thread, at a random phase (default 1)\n");
     printf("\t-h   print this usage\n");
+    printf("\nWhile running, SIGUSR1 prints an interim report and SIGINT/SIGTERM stop\n"
+           "the run after the current iterations and report it, a second one aborts.\n");
     printf("\nand where the -t test type is:\n\n");
 
     for (i = 1; i <= TEST_TYPE_MAX; i++)
@@ -363,6 +699,31 @@ static void usage(char *program)
     for (i = 0; i <= STREAMTYPE_MAX; i++)
         printf("\t%-2d = %s\n", i, streamtype_name(i));
 
+    printf("\nand where the -sink sink is:\n\n");
+    for (i = 0; i <= SINK_MAX; i++)
+        printf("\t%-2d = %s\n", i, sink_name(i));
+
+    printf("\nand where the -st strategy is:\n\n");
+    for (i = 0; i <= Z_FIXED; i++)
+        printf("\t%-2d = %s\n", i, strategy_name(i));
+
+    printf("\nand where the -flush policy is one of:\n\n\t");
+    for (i = Z_NO_FLUSH; i <= Z_BLOCK; i++)
+        if (flush_name(i))
+            printf("%s ", flush_name(i));
+    printf("\n\n\tevery <n> chunks, or every <n> bytes with a b, k or m suffix (default 1)\n");
+
+    printf("\nand where the -k size is one of, in bytes with an optional k or m suffix:\n\n");
+    printf("\t<size> or fixed:<size>\n");
+    printf("\tuniform:<min>-<max>\n");
+    printf("\tlognormal:<median>:<sigma>[:<min>-<max>]\n"
+           "\t                              redrawn outside min-max, clamped to them\n"
+           "\t                              when that keeps failing\n");
+    printf("\tzipf:<min>-<max>[:<s>]        P(size) falls as 1/size^s (default 1)\n");
+    printf("\tbimodal:<a>:<b>[:<pct>]       pct percent of a, the rest b (default 50)\n");
+    printf("\n\tany of them followed by @<seed> for other draws, for example\n"
+           "\tbimodal:200:64k:90 or lognormal:1k:1.5@7\n");
+
     exit(EXIT_SUCCESS);
 }
 
@@ -395,6 +756,35 @@ static void parse_option(int *index, int argc, char *argv[], int *value)
     *value = atoi(argv[*index]);
 }
 
+/******************************************************************************
+* function:
+*           parse_option_float(int *index,
+*                        int argc,
+*                       char *argv[],
+*                        float *value)
+*
+* @param index [IN] - index pointer
+* @param argc [IN] - input argument count
+* @param argv [IN] - argument buffer
+* @param value [IN] - input value pointer
+*
+* description:
+*   user input arguments check
+******************************************************************************/
+static void parse_option_float(int *index, int argc, char *argv[], float *value)
+{
+    if (*index + 1 >= argc)
+    {
+        fprintf(stderr, "\nParameter expected\n");
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    (*index)++;
+
+    *value = atof(argv[*index]);
+}
+
 /******************************************************************************
 * function:
 *           parse_option_long(int *index,
@@ -448,6 +838,17 @@ static void handle_option(int argc, char *argv[], int *index)
             exit(EXIT_FAILURE);
         }
     }
+    else if (!strcmp(option, "-procs")) {
+        parse_option(index, argc, argv, &proc_count);
+        if (proc_count < 0) {
+            fprintf(stderr, "Error: -procs expects a number of processes\n");
+            exit(EXIT_FAILURE);
+        }
+        if (proc_count > MAX_THREAD) {
+            fprintf(stderr, "Error: Exceeded maximum number of processes\n");
+            exit(EXIT_FAILURE);
+        }
+    }
     else if (!strcmp(option, "-t"))
         parse_option(index, argc, argv, &test_type);
     else if (!strcmp(option, "-c"))
@@ -482,143 +883,1138 @@ static void handle_option(int argc, char *argv[], int *index)
     }
     else if (!strcmp(option, "-l"))
         parse_option(index, argc, argv, &compression_level);
+    else if (!strcmp(option, "-ml")) {
+        parse_option(index, argc, argv, &mem_level);
+        if (mem_level < 1 || mem_level > MAX_MEM_LEVEL) {
+            fprintf(stderr, "Error: -ml expects a memLevel of 1 to %d\n", MAX_MEM_LEVEL);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-wb")) {
+        parse_option(index, argc, argv, &window_bits);
+        /* raw and gzip streams take no window of 2^8, so neither does -wb */
+        if (window_bits < 9 || window_bits > MAX_WBITS) {
+            fprintf(stderr, "Error: -wb expects a windowBits of 9 to %d, the stream type "
+                            "is set with -s\n", MAX_WBITS);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-st")) {
+        parse_option(index, argc, argv, &strategy);
+        if (strategy < Z_DEFAULT_STRATEGY || strategy > Z_FIXED) {
+            fprintf(stderr, "Error: -st expects a strategy of %d to %d\n",
+                    Z_DEFAULT_STRATEGY, Z_FIXED);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-tput"))
+        parse_option_float(index, argc, argv, &target_mbps);
+    else if (!strcmp(option, "-ratio"))
+        parse_option_float(index, argc, argv, &target_ratio);
     else if (!strcmp(option, "-k"))
-        parse_option(index, argc, argv, &chunk_size);
+    {
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        if (tests_sizes_parse(argv[*index], &size_dist) != 0)
+        {
+            fprintf(stderr, "Error: -k expects a size or a size distribution such as "
+                            "uniform:512-4k, lognormal:1k:1.5, zipf:64-64k:1.2 or "
+                            "bimodal:200:64k:90, see -h\n");
+            exit(EXIT_FAILURE);
+        }
+        /* buffers sized by the chunk take the largest size drawn, the
+           drawn sizes do not divide the corpus */
+        chunk_size = size_dist.max;
+        if (size_dist.kind != SIZE_DIST_FIXED)
+            allow_partial_chunks = 1;
+    }
     else if (!strcmp(option, "-o"))
         parse_option(index, argc, argv, &corpus);
     else if (!strcmp(option, "-s"))
         parse_option(index, argc, argv, &stream_type);
-    else if (!strcmp(option, "-pc"))
-    {
-                allow_partial_chunks = 1;
+    else if (!strcmp(option, "-outbuf")) {
+        parse_option(index, argc, argv, &outbuf_size);
+        if (outbuf_size < 1) {
+            fprintf(stderr, "Error: -outbuf expects a buffer size of at least 1 byte\n");
+            exit(EXIT_FAILURE);
+        }
     }
-    else if (!strcmp(option, "-u"))
-        cpu_core_info = 1;
-    else if (!strcmp(option, "-v"))
-        verify = 1;
-    else if (!strcmp(option, "-h"))
-        usage(argv[0]);
-    else
+    else if (!strcmp(option, "-sink"))
+        parse_option(index, argc, argv, &sink_type);
+    else if (!strcmp(option, "-sinkfile"))
     {
-        fprintf(stderr, "\nInvalid option '%s'\n", option);
-        usage(argv[0]);
-        exit(EXIT_FAILURE);
-    }
-}
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
 
-/******************************************************************************
-* function:
-*           *thread_worker(void *arg)
-*
-* @param arg [IN] - thread structure info
-*
-* description:
-*   thread worker setups. the threads will launch at the same time after
-*   all of them in ready condition.
-******************************************************************************/
-static void *thread_worker(void *arg)
-{
-    THREAD_INFO *info = (THREAD_INFO *) arg;
-    int rc1, rc2, rc3, rc4;
-    int abort=0;
-    test_parameters_t test_parameters;
-    test_parameters.count = info->count;
-    test_parameters.type = test_type;
-    test_parameters.id = info->id;
-    test_parameters.level = compression_level;
-    test_parameters.enable_deflate_buffering = enable_deflate_buffering;
-    test_parameters.enable_inflate_buffering = enable_inflate_buffering;
-    test_parameters.streamtype = stream_type;
-    test_parameters.verify = verify;
-    test_parameters.chunksize = chunk_size;
-    test_parameters.corpus = corpus;
-    test_parameters.allow_partial_chunks = allow_partial_chunks;
-    test_parameters.verify_checksum = 0;
+        (*index)++;
 
-    if (filenamePathSet)
-    {
-        test_parameters.file_path = FileNameOrPath;
+        sink_path = argv[*index];
     }
-    else
+    else if (!strcmp(option, "-mix"))
     {
-        test_parameters.file_path = "\0";
-    }
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
 
-    /* mutex lock for thread count */
-    rc1 = pthread_mutex_lock(&mutex);
-    ready_thread_count++;
-    rc2 = pthread_cond_broadcast(&ready_cond);
-    rc3 = pthread_mutex_unlock(&mutex);
+        (*index)++;
 
-    rc4 = tests_startup(&test_parameters);
-    if ((rc1 != 0) || (rc2 != 0) || (rc3 != 0) || (rc4 != TEST_PASSED))
-    {
-        failure_occured=1;
-        abort=1;
+        if (sscanf(argv[*index], "%d:%d", &mix_deflate, &mix_inflate) != 2 ||
+            mix_deflate < 0 || mix_inflate < 0 || mix_deflate + mix_inflate == 0)
+        {
+            fprintf(stderr, "Error: -mix expects <deflate>:<inflate>, for example 30:70\n");
+            exit(EXIT_FAILURE);
+        }
     }
-
-    /* mutex lock for thread count */
-    rc1 = pthread_mutex_lock(&mutex);
-    startupfinished_thread_count++;
-    rc2 = pthread_cond_broadcast(&startupfinished_cond);
-    rc3 = pthread_mutex_unlock(&mutex);
-    if ((rc1 != 0) || (rc2 != 0) || (rc3 != 0))
+    else if (!strcmp(option, "-flush"))
     {
-        failure_occured=1;
-        abort=1;
-    }
+        char name[16];
+        char unit = 0;
+        int fields = 0;
 
-    /* waiting for thread clearance */
-    rc1 = pthread_mutex_lock(&mutex);
-    if (rc1 != 0) {
-        failure_occured=1;
-        abort=1;
-    }
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
 
+        (*index)++;
 
-    while (!cleared_to_start) {
-        rc2 = pthread_cond_wait(&start_cond, &mutex);
-        if (rc2 != 0) {
-            failure_occured=1;
-            abort=1;
+        fields = sscanf(argv[*index], "%15[a-z]:%lu%c", name, &flush_every, &unit);
+        for (flush_policy = Z_BLOCK; flush_policy >= Z_NO_FLUSH; flush_policy--)
+            if (flush_name(flush_policy) && !strcmp(name, flush_name(flush_policy)))
+                break;
+        if (fields < 1 || flush_policy < Z_NO_FLUSH || (fields >= 2 && flush_every == 0))
+        {
+            fprintf(stderr, "Error: -flush expects <policy>[:<every>], for example sync:4 or full:64k\n");
+            exit(EXIT_FAILURE);
+        }
+        if (fields == 3)
+        {
+            flush_bytes = 1;
+            if (unit == 'k')
+                flush_every *= 1024;
+            else if (unit == 'm')
+                flush_every *= 1024 * 1024;
+            else if (unit != 'b')
+            {
+                fprintf(stderr, "Error: -flush interval suffix must be b, k or m\n");
+                exit(EXIT_FAILURE);
+            }
         }
     }
+    else if (!strcmp(option, "-engine"))
+    {
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
 
-    rc3 = pthread_mutex_unlock(&mutex);
-    if (rc3 != 0) {
-        failure_occured=1;
-        abort=1;
-    }
+        (*index)++;
+
+        if (!strcmp(argv[*index], "inflate"))
+            inflate_engine = INFLATE_ENGINE_INFLATE;
+        else if (!strcmp(argv[*index], "back"))
+            inflate_engine = INFLATE_ENGINE_BACK;
+        else
+        {
+            fprintf(stderr, "Error: -engine expects inflate or back\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-batch"))
+    {
+        int fields = 0;
+
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        fields = sscanf(argv[*index], "%d:%lu-%lu", &batch_records, &batch_min, &batch_max);
+        if ((fields != 1 && fields != 3) || batch_records < 1 ||
+            batch_min < 1 || batch_min > batch_max)
+        {
+            fprintf(stderr, "Error: -batch expects <records>[:<min>-<max>], for example 256:200-2048\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-offload"))
+    {
+        int fields = 0;
+
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        fields = sscanf(argv[*index], "%d:%d:%d", &offload_engines, &offload_depth, &offload_batch);
+        if (fields < 1 || offload_engines < 1 || offload_depth < 1 ||
+            offload_batch < 1 || offload_batch > offload_depth)
+        {
+            fprintf(stderr, "Error: -offload expects <engines>[:<depth>[:<batch>]] with a batch no larger\n"
+                            "than the depth, for example 2:16:4\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-streams"))
+    {
+        char *next = NULL;
+        long count = 0;
+
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        next = argv[*index];
+        streams_sweeps = 0;
+        do
+        {
+            count = strtol(next, &next, 10);
+            if (count < 1 || count > 1000000 || streams_sweeps == MAX_STREAMS_SWEEP ||
+                (*next != ',' && *next != '\0'))
+            {
+                fprintf(stderr, "Error: -streams expects up to %d counts of 1 or more, "
+                                "for example 1,64,1024\n", MAX_STREAMS_SWEEP);
+                exit(EXIT_FAILURE);
+            }
+            streams_sweep[streams_sweeps++] = count;
+        } while (*next++ == ',');
+    }
+    else if (!strcmp(option, "-scale"))
+    {
+        char *next = NULL;
+
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        scale_max = strtol(argv[*index], &next, 10);
+        scale_every = !strcmp(next, ":all");
+        if (scale_max < 1 || scale_max > MAX_THREAD || (*next != '\0' && !scale_every))
+        {
+            fprintf(stderr, "Error: -scale expects <threads>[:all] with up to %d threads, "
+                            "for example 8 or 6:all\n", MAX_THREAD);
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-mixthreads"))
+        mix_per_thread = 1;
+    else if (!strcmp(option, "-rate"))
+        parse_option_float(index, argc, argv, &rate);
+    else if (!strcmp(option, "-scenario"))
+    {
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        scenario_path = argv[*index];
+    }
+    else if (!strcmp(option, "-trace"))
+    {
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        trace_path = argv[*index];
+    }
+    else if (!strcmp(option, "-tracecalls"))
+        trace_calls = 1;
+    else if (!strcmp(option, "-replay"))
+    {
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        replay_path = argv[*index];
+    }
+    else if (!strcmp(option, "-replaypaced"))
+        replay_paced = 1;
+    else if (!strcmp(option, "-freq"))
+    {
+        parse_option(index, argc, argv, &freq_interval);
+        if (freq_interval < 1)
+        {
+            fprintf(stderr, "Error: -freq expects a sampling interval of 1 msec or more\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-metrics"))
+    {
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        metrics.endpoint = argv[*index];
+    }
+    else if (!strcmp(option, "-bgzfout"))
+    {
+        if (*index + 1 >= argc)
+        {
+            fprintf(stderr, "\nParameter expected\n");
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+
+        (*index)++;
+
+        bgzf_path = argv[*index];
+    }
+    else if (!strcmp(option, "-pc"))
+    {
+                allow_partial_chunks = 1;
+    }
+    else if (!strcmp(option, "-u"))
+        cpu_core_info = 1;
+    else if (!strcmp(option, "-v"))
+        verify = 1;
+    else if (!strcmp(option, "-vi"))
+    {
+        parse_option(index, argc, argv, &verify_interval);
+        if (verify_interval < 1) {
+            fprintf(stderr, "Error: verify interval must be at least 1\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    else if (!strcmp(option, "-h"))
+        usage(argv[0]);
+    else
+    {
+        fprintf(stderr, "\nInvalid option '%s'\n", option);
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+}
+
+/******************************************************************************
+* function:
+*           parse_cpu_list(char *list, scenario_group_t *group)
+*
+* @param list  [IN] - cpus as a comma separated list of numbers and ranges
+* @param group [OUT] - group the cpus are set for
+*
+* description:
+*   parse the cpus=0-3,6 setting of a scenario group
+******************************************************************************/
+static int parse_cpu_list(char *list, scenario_group_t *group)
+{
+    char *p = list, *end = NULL;
+    long first = 0, last = 0, cpu = 0;
+
+    group->ncpus = 0;
+    while (*p)
+    {
+        first = strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return -1;
+        last = first;
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first)
+                return -1;
+        }
+        for (cpu = first; cpu <= last; cpu++)
+        {
+            if (group->ncpus == MAX_CORE)
+                return -1;
+            group->cpus[group->ncpus++] = cpu;
+        }
+        if (*end == ',')
+            end++;
+        else if (*end != '\0')
+            return -1;
+        p = end;
+    }
+    return group->ncpus > 0 ? 0 : -1;
+}
+
+/******************************************************************************
+* function:
+*           load_scenario(const char *path)
+*
+* @param path [IN] - scenario file
+*
+* description:
+*   read the thread groups of a scenario file. Every line that is not
+*   empty or a # comment is a group: its name followed by key=value
+*   settings. A setting the group leaves out is taken from the command line.
+******************************************************************************/
+static void load_scenario(const char *path)
+{
+    FILE *f = NULL;
+    char line[1024];
+    char *token = NULL, *save = NULL, *value = NULL;
+    scenario_group_t *group = NULL;
+    int lineno = 0;
+    int error = 0;
+
+    f = fopen(path, "r");
+    if (NULL == f)
+    {
+        fprintf(stderr, "Error: could not open scenario file %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    thread_count = 0;
+    while (!error && fgets(line, sizeof(line), f))
+    {
+        lineno++;
+        if ((value = strchr(line, '#')))
+            *value = '\0';
+        token = strtok_r(line, " \t\r\n", &save);
+        if (NULL == token)
+            continue;
+
+        if (group_count == MAX_GROUP)
+        {
+            fprintf(stderr, "Error: %s: more than %d groups\n", path, MAX_GROUP);
+            error = 1;
+            break;
+        }
+        group = &groups[group_count++];
+        memset(group, 0, sizeof(*group));
+        snprintf(group->name, sizeof(group->name), "%s", token);
+        group->threads = 1;
+        group->count = test_count;
+        group->type = test_type;
+        group->level = compression_level;
+        group->chunk = chunk_size;
+        group->stream = stream_type;
+        group->corpus = corpus;
+        group->rate = rate;
+
+        while (!error && (token = strtok_r(NULL, " \t\r\n", &save)))
+        {
+            value = strchr(token, '=');
+            if (NULL == value)
+            {
+                error = 1;
+                break;
+            }
+            *value++ = '\0';
+
+            if (!strcmp(token, "threads"))
+                group->threads = atoi(value);
+            else if (!strcmp(token, "count"))
+                group->count = atoi(value);
+            else if (!strcmp(token, "type"))
+                group->type = atoi(value);
+            else if (!strcmp(token, "level"))
+                group->level = atoi(value);
+            else if (!strcmp(token, "chunk"))
+                group->chunk = atoi(value);
+            else if (!strcmp(token, "stream"))
+                group->stream = atoi(value);
+            else if (!strcmp(token, "corpus"))
+                group->corpus = atoi(value);
+            else if (!strcmp(token, "rate"))
+                group->rate = atof(value);
+            else if (!strcmp(token, "cpus"))
+                error = parse_cpu_list(value, group) != 0;
+            else
+                error = 1;
+        }
+
+        if (!error && (group->threads < 1 || group->count / group->threads < 1 ||
+                       group->type < 1 || group->type > TEST_TYPE_MAX))
+            error = 1;
+        if (error)
+            fprintf(stderr, "Error: %s:%d: invalid group '%s'\n", path, lineno, group->name);
+        thread_count += group->threads;
+    }
+    fclose(f);
+
+    if (!error && group_count == 0)
+    {
+        fprintf(stderr, "Error: %s describes no thread groups\n", path);
+        error = 1;
+    }
+    if (!error && thread_count > MAX_THREAD)
+    {
+        fprintf(stderr, "Error: Exceeded maximum number of threads\n");
+        error = 1;
+    }
+    if (error)
+        exit(EXIT_FAILURE);
+}
+
+/******************************************************************************
+* function:
+*           init_test_parameters(test_parameters_t *test_parameters,
+*                                int id,
+*                                int count)
+*
+* @param test_parameters [OUT] - parameters of one worker
+* @param id              [IN] - worker id
+* @param count           [IN] - iterations the worker runs
+*
+* description:
+*   fill in the parameters of a worker from the command line options
+******************************************************************************/
+static void init_test_parameters(test_parameters_t *test_parameters, int id, int count)
+{
+    test_parameters->count = count;
+    test_parameters->completed = count;
+    test_parameters->type = test_type;
+    test_parameters->id = id;
+    test_parameters->cores = core_count;
+    test_parameters->threads = proc_count > 0 ? proc_count : thread_count;
+    test_parameters->level = compression_level;
+    test_parameters->mem_level = mem_level;
+    test_parameters->window_bits = window_bits;
+    test_parameters->strategy = strategy;
+    test_parameters->target_mbps = target_mbps;
+    test_parameters->target_ratio = target_ratio;
+    test_parameters->enable_deflate_buffering = enable_deflate_buffering;
+    test_parameters->enable_inflate_buffering = enable_inflate_buffering;
+    test_parameters->streamtype = stream_type;
+    test_parameters->verify = verify;
+    test_parameters->verify_interval = verify_interval;
+    test_parameters->verify_phase = 0;
+    test_parameters->verify_buf = NULL;
+    test_parameters->verify_checked = 0;
+    test_parameters->verify_nsec = 0;
+    test_parameters->verify_cpu_nsec = 0;
+    test_parameters->verify_helper_nsec = 0;
+    test_parameters->crc_pool = NULL;
+    test_parameters->chunksize = chunk_size;
+    test_parameters->corpus = corpus;
+    test_parameters->allow_partial_chunks = allow_partial_chunks;
+    test_parameters->verify_checksum = 0;
+    test_parameters->outbuf_size = outbuf_size;
+    test_parameters->sink_type = sink_type;
+    test_parameters->sink_path = sink_path;
+    test_parameters->bgzf_path = bgzf_path;
+    test_parameters->bgzf_pool = NULL;
+    test_parameters->scratch_buf = NULL;
+    test_parameters->scratch_buflen = 0;
+    test_parameters->mix_deflate = mix_deflate;
+    test_parameters->mix_inflate = mix_inflate;
+    test_parameters->mix_per_thread = mix_per_thread;
+    test_parameters->rate = rate;
+    test_parameters->flush_policy = flush_policy;
+    test_parameters->flush_every = flush_every;
+    test_parameters->flush_bytes = flush_bytes;
+    test_parameters->inflate_engine = inflate_engine;
+    test_parameters->batch_records = batch_records;
+    test_parameters->batch_min = batch_min;
+    test_parameters->batch_max = batch_max;
+    test_parameters->offload = offload;
+    test_parameters->offload_depth = offload_depth;
+    test_parameters->offload_batch = offload_batch;
+    test_parameters->streams_sweep = streams_sweep;
+    test_parameters->streams_sweeps = streams_sweeps;
+    test_parameters->replay = replay;
+    test_parameters->size_dist = size_dist.kind != SIZE_DIST_FIXED ? &size_dist : NULL;
+    test_parameters->sizes = NULL;
+    test_parameters->sizes_next = 0;
+    test_parameters->index_buf = NULL;
+    test_parameters->index_len = 0;
+    test_parameters->reference_len = 0;
+    test_parameters->live = metrics.live ? &metrics.live[id] : NULL;
+    test_parameters->trace = trace_rings ? &trace_rings[id] : NULL;
+    test_parameters->trace_calls = trace_calls ? test_parameters->trace : NULL;
+
+    if (filenamePathSet)
+    {
+        test_parameters->file_path = FileNameOrPath;
+    }
+    else
+    {
+        test_parameters->file_path = "\0";
+    }
+}
+
+/******************************************************************************
+* function:
+*           worker_result_start(worker_result_t *result,
+*                               test_parameters_t *test_parameters)
+*
+* @param result          [OUT] - record of the worker
+* @param test_parameters [IN] - parameters of the worker before its run
+*
+* description:
+*   clear the record of a worker about to run, noting where its live
+*   counters stand so only the bytes of this run are counted
+******************************************************************************/
+static void worker_result_start(worker_result_t *result, test_parameters_t *test_parameters)
+{
+    memset(result, 0, sizeof(worker_result_t));
+    if (test_parameters->live)
+    {
+        result->bytes_in = test_parameters->live->bytes_in;
+        result->bytes_out = test_parameters->live->bytes_out;
+    }
+}
+
+/******************************************************************************
+* function:
+*           worker_result_set(worker_result_t *result,
+*                             test_parameters_t *test_parameters,
+*                             unsigned long long run_nsec,
+*                             unsigned long long cpu_nsec)
+*
+* @param result          [OUT] - record of the worker
+* @param test_parameters [IN] - parameters of the worker after its run
+* @param run_nsec        [IN] - wall time of the run
+* @param cpu_nsec        [IN] - cpu time of the run
+*
+* description:
+*   record what a worker did. The bytes in and out come from its live
+*   counters, a test that does not keep them is taken to have turned the
+*   uncompressed bytes of its iterations into that times its ratio. The
+*   time and CPU time the worker spent verifying are taken out of its own
+*   run and CPU time.
+******************************************************************************/
+static void worker_result_set(worker_result_t *result, test_parameters_t *test_parameters,
+                              unsigned long long run_nsec, unsigned long long cpu_nsec)
+{
+    result->single_call_bytes = test_parameters->single_call_bytes;
+    result->iterations = test_parameters->completed;
+    result->ratio = test_parameters->ratio;
+    result->bytes = (double)test_parameters->single_call_bytes * test_parameters->completed;
+    if (test_parameters->live && test_parameters->live->bytes_in > result->bytes_in)
+    {
+        result->bytes_in = test_parameters->live->bytes_in - result->bytes_in;
+        result->bytes_out = test_parameters->live->bytes_out - result->bytes_out;
+    }
+    else
+    {
+        result->bytes_in = result->bytes;
+        result->bytes_out = result->bytes * test_parameters->ratio;
+    }
+    result->verify_nsec = test_parameters->verify_nsec;
+    result->verify_cpu_nsec = test_parameters->verify_cpu_nsec +
+                              test_parameters->verify_helper_nsec;
+    result->run_nsec = run_nsec > test_parameters->verify_nsec ?
+                       run_nsec - test_parameters->verify_nsec : 0;
+    result->cpu_nsec = cpu_nsec > test_parameters->verify_cpu_nsec ?
+                       cpu_nsec - test_parameters->verify_cpu_nsec : 0;
+}
+
+/******************************************************************************
+* function:
+*           *thread_worker(void *arg)
+*
+* @param arg [IN] - thread structure info
+*
+* description:
+*   thread worker setups. the threads will launch at the same time after
+*   all of them in ready condition.
+******************************************************************************/
+static void *thread_worker(void *arg)
+{
+    THREAD_INFO *info = (THREAD_INFO *) arg;
+    int rc1, rc2, rc3, rc4;
+    int abort=0;
+    unsigned long long span = 0, run_nsec = 0, cpu_nsec = 0;
+    test_parameters_t test_parameters;
+
+    init_test_parameters(&test_parameters, info->id, info->count);
+    if (group_count)
+    {
+        scenario_group_t *group = &groups[info->group];
+
+        test_parameters.type = group->type;
+        test_parameters.level = group->level;
+        test_parameters.chunksize = group->chunk;
+        if (group->chunk != chunk_size)
+            test_parameters.size_dist = NULL;
+        test_parameters.streamtype = group->stream;
+        test_parameters.corpus = group->corpus;
+        test_parameters.rate = group->rate;
+        test_parameters.threads = group->threads;
+    }
+    if (test_parameters.live)
+        test_parameters.live->test = test_name(test_parameters.type);
+
+    /* mutex lock for thread count */
+    rc1 = pthread_mutex_lock(&mutex);
+    ready_thread_count++;
+    rc2 = pthread_cond_broadcast(&ready_cond);
+    rc3 = pthread_mutex_unlock(&mutex);
+
+    span = tests_trace_start(test_parameters.trace);
+    rc4 = tests_startup(&test_parameters);
+    tests_trace_stop(test_parameters.trace, "startup", span);
+    if ((rc1 != 0) || (rc2 != 0) || (rc3 != 0) || (rc4 != TEST_PASSED))
+    {
+        failure_occured=1;
+        abort=1;
+    }
+
+    /* mutex lock for thread count */
+    rc1 = pthread_mutex_lock(&mutex);
+    startupfinished_thread_count++;
+    rc2 = pthread_cond_broadcast(&startupfinished_cond);
+    rc3 = pthread_mutex_unlock(&mutex);
+    if ((rc1 != 0) || (rc2 != 0) || (rc3 != 0))
+    {
+        failure_occured=1;
+        abort=1;
+    }
+
+    /* waiting for thread clearance */
+    span = tests_trace_start(test_parameters.trace);
+    rc1 = pthread_mutex_lock(&mutex);
+    if (rc1 != 0) {
+        failure_occured=1;
+        abort=1;
+    }
+
+
+    while (!cleared_to_start) {
+        rc2 = pthread_cond_wait(&start_cond, &mutex);
+        if (rc2 != 0) {
+            failure_occured=1;
+            abort=1;
+        }
+    }
+
+    rc3 = pthread_mutex_unlock(&mutex);
+    if (rc3 != 0) {
+        failure_occured=1;
+        abort=1;
+    }
+    tests_trace_stop(test_parameters.trace, "start wait", span);
 
     if (!abort)
     {
+        span = tests_trace_start(test_parameters.trace);
+        worker_result_start(&results[info->id], &test_parameters);
+        run_nsec = tests_nsec();
+        cpu_nsec = tests_cpu_nsec();
         rc1 = tests_run(&test_parameters);
+        cpu_nsec = tests_cpu_nsec() - cpu_nsec;
+        run_nsec = tests_nsec() - run_nsec;
+        tests_trace_stop(test_parameters.trace, "run", span);
         if (rc1 != TEST_PASSED)
             failure_occured=1;
-        test_size=test_parameters.single_call_bytes;
-        ratio=test_parameters.ratio;
+        worker_result_set(&results[info->id], &test_parameters, run_nsec, cpu_nsec);
     }
     /* update active threads */
     rc1 = pthread_mutex_lock(&mutex);
     active_thread_count--;
+    if (test_parameters.state_bytes > state_bytes)
+        state_bytes = test_parameters.state_bytes;
     rc2 = pthread_cond_broadcast(&stop_cond);
     rc3 = pthread_mutex_unlock(&mutex);
 
+    span = tests_trace_start(test_parameters.trace);
     rc4 = tests_shutdown(&test_parameters);
+    tests_trace_stop(test_parameters.trace, "shutdown", span);
     if ((rc1 != 0) || (rc2 != 0) || (rc3 != 0) || (rc4 != TEST_PASSED))
         failure_occured=1;
 
-    rc1 = pthread_mutex_lock(&mutex);
-    stop_thread_count--;
-    rc2 = pthread_cond_broadcast(&end_cond);
-    rc3 = pthread_mutex_unlock(&mutex);
-    /* set a failure but maybe too late by now */
-    if ((rc1 != 0) || (rc2 != 0) || (rc3 != 0))
-        failure_occured=1;
+    rc1 = pthread_mutex_lock(&mutex);
+    stop_thread_count--;
+    rc2 = pthread_cond_broadcast(&end_cond);
+    rc3 = pthread_mutex_unlock(&mutex);
+    /* set a failure but maybe too late by now */
+    if ((rc1 != 0) || (rc2 != 0) || (rc3 != 0))
+        failure_occured=1;
+
+
+
+    return NULL;
+}
+
+/******************************************************************************
+* function:
+*           freq_worker_cores(void)
+*
+* description:
+*   returns a flag per core of the frequency monitor, set for the cores the
+*   workers were pinned to, or NULL when any worker was left to the
+*   scheduler. The caller frees it.
+******************************************************************************/
+static unsigned char *freq_worker_cores(void)
+{
+    int workers = proc_count > 0 ? proc_count : thread_count;
+    unsigned char *cores = calloc(freq.cores, 1);
+    int i, core;
+
+    for (i = 0; cores && i < workers; i++)
+    {
+        core = proc_count > 0 ? (cpu_affinity ? i % core_count : -1) : tinfo[i].core;
+        if (core < 0)
+        {
+            free(cores);
+            return NULL;
+        }
+        if (core < freq.cores)
+            cores[core] = 1;
+    }
+    return cores;
+}
+
+/******************************************************************************
+* function:
+*           worker_report(int workers)
+*
+* @param workers [IN] - number of worker threads or processes
+*
+* description:
+*   print what every worker did, with its run time against the mean run
+*   time of the workers so stragglers and an uneven split of the work show
+******************************************************************************/
+static void worker_report(int workers)
+{
+    worker_result_t *r;
+    double mean_nsec = 0, mbps = 0, min_mbps = 0, max_mbps = 0;
+    int slowest = 0;
+    int i;
+
+    for (i = 0; i < workers; i++)
+    {
+        mean_nsec += (double)results[i].run_nsec / workers;
+        if (results[i].run_nsec > results[slowest].run_nsec)
+            slowest = i;
+    }
+
+    printf("\nPer worker results:\n");
+    printf("%6s ", "Worker");
+    if (group_count)
+        printf("%-16s ", "Group");
+    printf("%8s %10s %10s %7s %10s %10s %6s %10s %8s\n", "Ops", "MB_in", "MB_out",
+           "Ratio", "Run_msec", "CPU_msec", "CPU_%", "Mbps", "Vs_mean");
+    for (i = 0; i < workers; i++)
+    {
+        r = &results[i];
+        mbps = r->run_nsec ? r->bytes * 8 * 1000 / r->run_nsec : 0;
+        if (0 == i || mbps < min_mbps)
+            min_mbps = mbps;
+        if (mbps > max_mbps)
+            max_mbps = mbps;
+        printf("%6d ", i);
+        if (group_count)
+            printf("%-16s ", groups[tinfo[i].group].name);
+        printf("%8d %10.2f %10.2f %7.3f %10.3f %10.3f %6.1f %10.2f %+7.1f%%\n", r->iterations,
+               r->bytes_in / 1e6, r->bytes_out / 1e6, r->ratio,
+               (double)r->run_nsec / 1e6, (double)r->cpu_nsec / 1e6,
+               r->run_nsec ? (double)r->cpu_nsec * 100 / r->run_nsec : 0, mbps,
+               mean_nsec > 0 ? (r->run_nsec - mean_nsec) * 100 / mean_nsec : 0);
+    }
+    if (workers > 1 && mean_nsec > 0)
+        printf("Imbalance: worker %d ran %.1f%% longer than the mean, worker Mbps %.2f to %.2f\n",
+               slowest, (results[slowest].run_nsec - mean_nsec) * 100 / mean_nsec,
+               min_mbps, max_mbps);
+}
+
+/******************************************************************************
+* function:
+*           generate_report(struct timeval *start_time,
+*                           struct timeval *stop_time,
+*                           unsigned long long cycles,
+*                           struct rusage *usage_start,
+*                           struct rusage *usage_stop,
+*                           int workers,
+*                           int processes)
+*
+* @param start_time  [IN] - time the workers were cleared to start
+* @param stop_time   [IN] - time the last worker finished its run
+* @param cycles      [IN] - elapsed cycles between the two
+* @param usage_start [IN] - resource usage of the workers at the start
+* @param usage_stop  [IN] - resource usage of the workers at the end
+* @param workers     [IN] - number of threads in each worker process
+* @param processes   [IN] - number of worker processes, 0 when the workers
+*                           are threads of this process
+*
+* description:
+*   print the results of the run and the CSV summary
+******************************************************************************/
+static void generate_report(struct timeval *start_time, struct timeval *stop_time,
+                            unsigned long long cycles, struct rusage *usage_start,
+                            struct rusage *usage_stop, int workers, int processes)
+{
+    unsigned long elapsed = 0;
+    int bytes_to_bits = 8;
+    float throughput = 0.0;
+    double bytes_processed = 0;
+    double ratio_bytes = 0;
+    double run_ratio = 0;
+    unsigned long data_per_test = 0;
+    int i;
+    double user_ns_per_byte = 0;
+    double sys_ns_per_byte = 0;
+    unsigned long rss_hwm = usage_stop->ru_maxrss, rss_now = 0;
+    unsigned char *freq_cores = NULL;
+    double freq_avg = 0, freq_min = 0;
+    int throttled = 0;
+    unsigned long long verify_nsec = 0, verify_cpu_nsec = 0, run_nsec = 0;
+    double user_nsec = 0;
+
+    elapsed = (stop_time->tv_sec - start_time->tv_sec) * 1000000 +
+        (stop_time->tv_usec - start_time->tv_usec);
+
+    /* Verification runs between the timed calls of each worker and is
+       already out of every worker's own run and CPU time. The run lasts as
+       long as the longest of those, and the CPU time of the checks comes
+       out of the CPU figures of the process. */
+    if (verify)
+    {
+        for (i = 0; i < (processes ? processes : workers); i++)
+        {
+            verify_nsec += results[i].verify_nsec;
+            verify_cpu_nsec += results[i].verify_cpu_nsec;
+            if (results[i].run_nsec > run_nsec)
+                run_nsec = results[i].run_nsec;
+        }
+        printf("Verify time    = %.3f msec, %.3f msec CPU (excluded)\n",
+               (float)verify_nsec / 1000000, (float)verify_cpu_nsec / 1000000);
+        if (run_nsec >= 1000 && run_nsec / 1000 < elapsed)
+            elapsed = run_nsec / 1000;
+    }
+
+
+    /* The bytes every worker actually processed, the workers of a run need
+       not have done the same number of iterations on the same data */
+    for (i = 0; i < (processes ? processes : workers); i++)
+    {
+        bytes_processed += results[i].bytes;
+        ratio_bytes += results[i].bytes * results[i].ratio;
+    }
+    if (actual_test_count)
+        data_per_test = bytes_processed / actual_test_count;
+    if (bytes_processed > 0)
+        run_ratio = ratio_bytes / bytes_processed;
+    throughput = bytes_processed * bytes_to_bits / elapsed;
+
+    printf("Elapsed time   = %.3f msec\n", (float)elapsed / 1000);
+    printf("Operations     = %d\n", actual_test_count);
+
+    printf("Time per op    = %.3f usec (%d ops/sec)\n",
+           (float)elapsed / actual_test_count,
+           (int)((float)actual_test_count * 1000000.0 / (float)elapsed));
+
+    printf("Elapsed cycles = %llu\n", cycles);
+
+    printf("Throughput     = %.2f (Mbps)\n", throughput);
+
+    /* User and system CPU of the whole process per byte of uncompressed
+       data, this is what the -sink write strategies are compared on */
+    if (bytes_processed > 0)
+    {
+        user_nsec = (usage_stop->ru_utime.tv_sec - usage_start->ru_utime.tv_sec) * 1e9 +
+                    (usage_stop->ru_utime.tv_usec - usage_start->ru_utime.tv_usec) * 1e3;
+        user_nsec = user_nsec > verify_cpu_nsec ? user_nsec - verify_cpu_nsec : 0;
+        user_ns_per_byte = user_nsec / bytes_processed;
+        sys_ns_per_byte = ((usage_stop->ru_stime.tv_sec - usage_start->ru_stime.tv_sec) * 1e9 +
+                           (usage_stop->ru_stime.tv_usec - usage_start->ru_stime.tv_usec) * 1e3) /
+                          bytes_processed;
+    }
+    printf("User CPU/byte  = %.3f nsec\n", user_ns_per_byte);
+    printf("Sys CPU/byte   = %.3f nsec\n", sys_ns_per_byte);
+    printf("Minor faults   = %ld\n", usage_stop->ru_minflt - usage_start->ru_minflt);
+    printf("Major faults   = %ld\n", usage_stop->ru_majflt - usage_start->ru_majflt);
+    printf("Vol/invol csw  = %ld/%ld\n",
+           usage_stop->ru_nvcsw - usage_start->ru_nvcsw,
+           usage_stop->ru_nivcsw - usage_start->ru_nivcsw);
+    if (processes)
+        printf("Peak RSS       = %.1f MB (sum of the worker processes)\n",
+               (double)usage_stop->ru_maxrss / 1024);
+    else if (memory_status(&rss_hwm, &rss_now) == 0)
+        printf("Peak RSS       = %.1f MB (%.1f MB at the end)\n",
+               (double)rss_hwm / 1024, (double)rss_now / 1024);
+    else
+        printf("Peak RSS       = %.1f MB\n", (double)usage_stop->ru_maxrss / 1024);
+    if (state_bytes)
+        printf("zlib state     = %lu bytes per stream (largest of the workers)\n", state_bytes);
+    worker_report(processes ? processes : workers);
+    if (freq_interval)
+    {
+        freq_cores = freq_worker_cores();
+        tests_freq_report(&freq, freq_cores);
+        throttled = tests_freq_summary(&freq, freq_cores, &freq_avg, &freq_min);
+        free(freq_cores);
+    }
+
+    printf("\nCSV summary:\n");
+
+    printf("Algorithm,"
+           "Test_type,"
+           "Deflate_buffering_enabled,"
+           "Inflate_buffering_enabled,"
+           "Compression_Level,"
+           "Chunk_Size,"
+           "Stream_type,"
+           "Core_affinity,"
+           "Elapsed_usec,"
+           "Cores,"
+           "Threads,"
+           "Count,"
+           "Data_per_test,"
+           "Mbps,"
+           "CPU_%%,"
+           "User_%%,"
+           "Kernel_%%,"
+           "Ratio,"
+           "Context_switches,"
+           "Cycles,"
+           "Sink,"
+           "User_ns_per_byte,"
+           "Sys_ns_per_byte,"
+           "Processes,"
+           "State_bytes,"
+           "Peak_RSS_KB,"
+           "Avg_GHz,"
+           "Min_GHz,"
+           "Throttled\n");
+
+    unsigned long cpu_time = 0;
+    unsigned long cpu_user = 0;
+    unsigned long cpu_kernel = 0;
+    unsigned long verify_cpu_usec = 0;
 
+    cpu_time = (cpu_time_total.user +
+                cpu_time_total.nice +
+                cpu_time_total.sys +
+                cpu_time_total.io +
+                cpu_time_total.irq +
+                cpu_time_total.softirq) * CPU_TIME_MULTIPLIER / core_count;
+    cpu_user = cpu_time_total.user * CPU_TIME_MULTIPLIER / core_count;
+    cpu_kernel = cpu_time_total.sys * CPU_TIME_MULTIPLIER / core_count;
+    /* the checks run in user mode, they come out of the user time */
+    verify_cpu_usec = verify_cpu_nsec / 1000 / core_count;
+    cpu_time = cpu_time > verify_cpu_usec ? cpu_time - verify_cpu_usec : 0;
+    cpu_user = cpu_user > verify_cpu_usec ? cpu_user - verify_cpu_usec : 0;
 
+    printf("csv,%s,%d,%s,%s,%d,%d,%d,%s,%lu,%d,%d,%d,%lu,%.2f,%lu,%lu,%lu,%.3f,%d,%llu,%s,%.3f,%.3f,%d,%lu,%lu,%.3f,%.3f,%s\n",
+           group_count ? "Scenario" : test_name(test_type),
+           test_type,
+           enable_deflate_buffering ? "Yes" : "No",
+           enable_inflate_buffering ? "Yes" : "No",
+           compression_level,
+           chunk_size,
+           stream_type,
+           cpu_affinity ? "Yes" : "No",
+           elapsed,
+           core_count, workers, actual_test_count, data_per_test, throughput,
+           cpu_time * CPU_PERCENTAGE_MULTIPLIER / elapsed,
+           cpu_user * CPU_PERCENTAGE_MULTIPLIER / elapsed,
+           cpu_kernel * CPU_PERCENTAGE_MULTIPLIER / elapsed,
+           run_ratio,
+           cpu_context.context,
+           cycles,
+           outbuf_size ? sink_name(sink_type) : "None",
+           user_ns_per_byte,
+           sys_ns_per_byte,
+           processes,
+           state_bytes,
+           processes ? usage_stop->ru_maxrss : rss_hwm,
+           freq_avg,
+           freq_min,
+           throttled ? "Yes" : "No");
+}
 
-    return NULL;
+/******************************************************************************
+* function:
+*           scenario_report(void)
+*
+* description:
+*   print the results of every thread group of a scenario and of the
+*   groups together. A group's throughput is over the time its slowest
+*   thread ran. The run summary that follows covers all the groups, with
+*   the average bytes per operation and the byte weighted ratio.
+******************************************************************************/
+static void scenario_report(void)
+{
+    int g, i;
+    int ops = 0, total_ops = 0;
+    double bytes = 0, total_bytes = 0;
+    double compressed = 0, total_compressed = 0;
+    unsigned long long run_nsec = 0, total_nsec = 0;
+
+    printf("\nScenario groups:\n");
+    printf("%-16s %-24s %7s %7s %12s %10s %7s %10s\n",
+           "Group", "Test", "Threads", "Ops", "Bytes/op", "Mbps", "Ratio", "Msec");
+    for (g = 0; g < group_count; g++)
+    {
+        ops = 0;
+        bytes = 0;
+        compressed = 0;
+        run_nsec = 0;
+        for (i = 0; i < thread_count; i++)
+        {
+            if (tinfo[i].group != g)
+                continue;
+            ops += results[i].iterations;
+            bytes += results[i].bytes;
+            compressed += results[i].bytes * results[i].ratio;
+            if (results[i].run_nsec > run_nsec)
+                run_nsec = results[i].run_nsec;
+        }
+        printf("%-16s %-24s %7d %7d %12.0f %10.2f %7.3f %10.3f\n",
+               groups[g].name, test_name(groups[g].type), groups[g].threads, ops,
+               ops ? bytes / ops : 0, run_nsec ? bytes * 8 * 1000 / run_nsec : 0,
+               bytes ? compressed / bytes : 0, (double)run_nsec / 1000000);
+        total_ops += ops;
+        total_bytes += bytes;
+        total_compressed += compressed;
+        if (run_nsec > total_nsec)
+            total_nsec = run_nsec;
+    }
+    printf("%-16s %-24s %7d %7d %12.0f %10.2f %7.3f %10.3f\n\n",
+           "all", "", thread_count, total_ops,
+           total_ops ? total_bytes / total_ops : 0,
+           total_nsec ? total_bytes * 8 * 1000 / total_nsec : 0,
+           total_bytes ? total_compressed / total_bytes : 0, (double)total_nsec / 1000000);
 }
 
 /******************************************************************************
@@ -631,17 +2027,19 @@ static void *thread_worker(void *arg)
 static void performance_test(void)
 {
     int i;
+    int group = 0;
+    int member = 0;
+    int requested = 0;
     int coreID = 0;
     int rc = 0;
     int sts = 1;
     cpu_set_t cpuset;
     struct timeval start_time;
     struct timeval stop_time;
-    unsigned long elapsed = 0;
     unsigned long long rdtsc_start = 0;
     unsigned long long rdtsc_end = 0;
-    int bytes_to_bits = 8;
-    float throughput = 0.0;
+    struct rusage usage_start;
+    struct rusage usage_stop;
 
     rc = pthread_mutex_init(&mutex, NULL);
     if (rc != 0) {
@@ -673,15 +2071,34 @@ static void performance_test(void)
         fprintf(stderr, "Failed call to pthread_cond_init, status = %d\n", rc);
         exit(EXIT_FAILURE);
     }
-    actual_test_count = test_count / thread_count;
-    actual_test_count = actual_test_count * thread_count;
+    actual_test_count = 0;
 
     for (i = 0; i < thread_count; i++)
     {
         THREAD_INFO *info = &tinfo[i];
 
         info->id = i;
+        info->group = 0;
         info->count = test_count / thread_count;
+        coreID = -1;
+        if (group_count)
+        {
+            /* the threads are handed out to the groups in file order */
+            while (member == groups[group].threads)
+            {
+                group++;
+                member = 0;
+            }
+            info->group = group;
+            info->count = groups[group].count / groups[group].threads;
+            if (groups[group].ncpus)
+                coreID = groups[group].cpus[member % groups[group].ncpus];
+            member++;
+        }
+        if (cpu_affinity == 1 && coreID < 0)
+            coreID = (i % core_count);
+        info->core = coreID;
+        actual_test_count += info->count;
         if (info->count == 0)
         {
             fprintf(stderr, "Error: count set incorrectly resulting in 0 iterations per thread\n");
@@ -695,12 +2112,11 @@ static void performance_test(void)
         }
 
         /* cpu affinity setup */
-        if (cpu_affinity == 1)
+        if (coreID >= 0)
         {
             CPU_ZERO(&cpuset);
 
             /* assigning thread to different cores */
-            coreID = (i % core_count);
             CPU_SET(coreID, &cpuset);
 
             sts = pthread_setaffinity_np(info->th, sizeof(cpu_set_t), &cpuset);
@@ -759,86 +2175,677 @@ static void performance_test(void)
         }
     }
 
-    rc = pthread_mutex_unlock(&mutex);
-    if (rc != 0) {
-        fprintf(stderr, "Failure to release Mutex Lock, status = %d\n", rc);
-        exit(EXIT_FAILURE);
-    }
-    printf("Beginning test ....\n");
-    /* all threads start at the same time */
-    read_stat (1);
-    gettimeofday(&start_time, NULL);
-    rdtsc_start = rdtsc();
-    rc = pthread_mutex_lock(&mutex);
-    if (rc != 0) {
-        fprintf(stderr, "Failure to get Mutex Lock, status = %d\n", rc);
+    rc = pthread_mutex_unlock(&mutex);
+    if (rc != 0) {
+        fprintf(stderr, "Failure to release Mutex Lock, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+    tests_metrics_phase(&metrics, METRICS_PHASE_READY);
+    printf("Beginning test ....\n");
+    if (freq_interval && tests_freq_start(&freq, freq_interval) != TEST_PASSED)
+        exit(EXIT_FAILURE);
+    /* all threads start at the same time */
+    read_stat (1);
+    getrusage(RUSAGE_SELF, &usage_start);
+    gettimeofday(&start_time, NULL);
+    rdtsc_start = rdtsc();
+    rc = pthread_mutex_lock(&mutex);
+    if (rc != 0) {
+        fprintf(stderr, "Failure to get Mutex Lock, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+    cleared_to_start = 1;
+    run_start_nsec = tests_nsec();
+    tests_metrics_phase(&metrics, METRICS_PHASE_RUNNING);
+    rc = pthread_cond_broadcast(&start_cond);
+    if (rc != 0) {
+        fprintf(stderr, "Failure calling pthread_cond_broadcast, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+    rc = pthread_mutex_unlock(&mutex);
+    if (rc != 0) {
+        fprintf(stderr, "Failure to release Mutex Lock, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+
+    /* wait for other threads stop */
+    rc = pthread_mutex_lock(&mutex);
+    if (rc != 0) {
+        fprintf(stderr, "Failure to get Mutex Lock, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+
+    while (active_thread_count > 0) {
+        rc = pthread_cond_wait(&stop_cond, &mutex);
+        if (rc != 0) {
+            fprintf(stderr, "Failure calling pthread_cond_wait, status = %d\n", rc);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    rc = pthread_mutex_unlock(&mutex);
+    if (rc != 0) {
+        fprintf(stderr, "Failure to release Mutex Lock, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+
+    rdtsc_end = rdtsc();
+    gettimeofday(&stop_time, NULL);
+    getrusage(RUSAGE_SELF, &usage_stop);
+    read_stat (0);
+    tests_freq_stop(&freq);
+    tests_metrics_phase(&metrics, METRICS_PHASE_SHUTDOWN);
+
+    rc = pthread_mutex_lock(&mutex);
+    if (rc != 0) {
+        fprintf(stderr, "Failure to get Mutex Lock, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+
+    while (stop_thread_count > 0) {
+        rc = pthread_cond_wait(&end_cond, &mutex);
+        if (rc != 0) {
+            fprintf(stderr, "Failure calling pthread_cond_wait, status = %d\n", rc);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    rc = pthread_mutex_unlock(&mutex);
+    if (rc != 0) {
+        fprintf(stderr, "Failure to release Mutex Lock, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < thread_count; i++)
+    {
+        if (pthread_join(tinfo[i].th, NULL))
+            printf("Could not join thread id - %d !\n", i);
+    }
+    tests_metrics_phase(&metrics, METRICS_PHASE_DONE);
+
+    /* a stopped run is reported over the iterations the threads did */
+    requested = actual_test_count;
+    actual_test_count = 0;
+    for (i = 0; i < thread_count; i++)
+        actual_test_count += results[i].iterations;
+
+
+    printf("All threads complete\n\n");
+    if (tests_stop_requested())
+        printf("# Run stopped early after %d of %d operations\n", actual_test_count, requested);
+
+    if (failure_occured)
+    {
+        printf("AT LEAST ONE FAILURE OCCURED DURING THE TESTS - DO NOT TRUST THE FIGURES PRODUCED\n");
+    }
+    else
+    {
+       printf("# PASS verify for ZLIB\n");
+    }
+
+    if (group_count)
+        scenario_report();
+
+    generate_report(&start_time, &stop_time, rdtsc_end - rdtsc_start,
+                    &usage_start, &usage_stop, thread_count, 0);
+}
+
+/******************************************************************************
+* function:
+*           *scale_worker(void *arg)
+*
+* @param arg [IN] - thread structure info
+*
+* description:
+*   worker of the -scale pool. It starts the test up once and then runs it
+*   at every step of the study it is one of the active threads in, from
+*   the state startup left, so the corpus is only loaded once.
+******************************************************************************/
+static void *scale_worker(void *arg)
+{
+    THREAD_INFO *info = (THREAD_INFO *) arg;
+    test_parameters_t test_parameters;
+    test_parameters_t started;
+    unsigned long long run_nsec = 0, cpu_nsec = 0;
+    int step = 0;
+    int rc = TEST_PASSED;
+
+    init_test_parameters(&test_parameters, info->id, test_count);
+    if (test_parameters.live)
+        test_parameters.live->test = test_name(test_parameters.type);
+    if (tests_startup(&test_parameters) != TEST_PASSED)
+        failure_occured = 1;
+    started = test_parameters;
+
+    pthread_mutex_lock(&mutex);
+    startupfinished_thread_count++;
+    pthread_cond_broadcast(&startupfinished_cond);
+    for (;;)
+    {
+        while (scale_step == step)
+            pthread_cond_wait(&start_cond, &mutex);
+        step = scale_step;
+        if (scale_threads < 0)
+            break;
+        if (info->id >= scale_threads)
+            continue;
+        pthread_mutex_unlock(&mutex);
+
+        /* Every step starts from the state startup left, a run may have
+           changed it (the compression test trims output_buflen) */
+        started.verify_buf = test_parameters.verify_buf;
+        test_parameters = started;
+        test_parameters.threads = scale_threads;
+        tests_verify_init(&test_parameters);
+        worker_result_start(&results[info->id], &test_parameters);
+        run_nsec = tests_nsec();
+        cpu_nsec = tests_cpu_nsec();
+        rc = failure_occured ? TEST_FAILED : tests_run(&test_parameters);
+        cpu_nsec = tests_cpu_nsec() - cpu_nsec;
+        run_nsec = tests_nsec() - run_nsec;
+
+        pthread_mutex_lock(&mutex);
+        if (rc != TEST_PASSED)
+            failure_occured = 1;
+        worker_result_set(&results[info->id], &test_parameters, run_nsec, cpu_nsec);
+        if (test_parameters.state_bytes > state_bytes)
+            state_bytes = test_parameters.state_bytes;
+        active_thread_count--;
+        pthread_cond_broadcast(&stop_cond);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (tests_shutdown(&test_parameters) != TEST_PASSED)
+        failure_occured = 1;
+    return NULL;
+}
+
+/******************************************************************************
+* function:
+*           usl_fit(const int *threads, const double *mbps, int points,
+*                   double *sigma, double *kappa)
+*
+* @param threads [IN] - thread count of every point
+* @param mbps    [IN] - throughput of every point, the first at one thread
+* @param points  [IN] - number of points
+* @param sigma   [OUT] - contention coefficient
+* @param kappa   [OUT] - coherency coefficient
+*
+* description:
+*   least squares fit of the Universal Scalability Law
+*       X(N) = X(1) N / (1 + sigma (N - 1) + kappa N (N - 1))
+*   which is linear in sigma and kappa once written as
+*       N X(1) / X(N) - 1 = sigma (N - 1) + kappa N (N - 1)
+*   Neither coefficient is let go below zero, the other one is fitted
+*   alone when that happens.
+******************************************************************************/
+static void usl_fit(const int *threads, const double *mbps, int points,
+                    double *sigma, double *kappa)
+{
+    double sxx = 0, sxz = 0, szz = 0, sxy = 0, szy = 0;
+    double x, z, y, det;
+    int i;
+
+    for (i = 0; i < points; i++)
+    {
+        x = threads[i] - 1;
+        z = (double)threads[i] * (threads[i] - 1);
+        y = threads[i] * mbps[0] / mbps[i] - 1;
+        sxx += x * x;
+        sxz += x * z;
+        szz += z * z;
+        sxy += x * y;
+        szy += z * y;
+    }
+
+    *sigma = 0;
+    *kappa = 0;
+    det = sxx * szz - sxz * sxz;
+    if (det > 0)
+    {
+        *sigma = (sxy * szz - szy * sxz) / det;
+        *kappa = (szy * sxx - sxy * sxz) / det;
+    }
+    if (det <= 0 || *kappa < 0)
+    {
+        *kappa = 0;
+        *sigma = sxx > 0 ? sxy / sxx : 0;
+    }
+    else if (*sigma < 0)
+    {
+        *sigma = 0;
+        *kappa = szz > 0 ? szy / szz : 0;
+    }
+    if (*sigma < 0)
+        *sigma = 0;
+}
+
+/******************************************************************************
+* function:
+*           scale_test(void)
+*
+* description:
+*   runs the test at 1 to scale_max threads, doubling or one more at every
+*   step and always ending at scale_max, with a pool of scale_max threads started up once. Every active
+*   thread runs -c iterations at each step. The report gives the speedup
+*   over one thread, the parallel efficiency and the CPU cycles per byte of
+*   every step, and the Universal Scalability Law fitted to them.
+******************************************************************************/
+static void scale_test(void)
+{
+    int steps[MAX_THREAD];
+    double mbps[MAX_THREAD];
+    double cycles_per_byte[MAX_THREAD];
+    double ghz[MAX_THREAD];
+    double ghz_min = 0;
+    double sigma = 0, kappa = 0, peak = 0, bytes = 0, cpu = 0, verify_cpu = 0, model = 0;
+    unsigned long long nsec = 0, wall = 0, tsc = 0;
+    struct rusage usage_start;
+    struct rusage usage_stop;
+    int points = 0;
+    int i, n;
+
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&startupfinished_cond, NULL);
+    pthread_cond_init(&start_cond, NULL);
+    pthread_cond_init(&stop_cond, NULL);
+
+    for (i = 0; i < scale_max; i++)
+    {
+        tinfo[i].id = i;
+        tinfo[i].group = 0;
+        tinfo[i].core = -1;
+        tinfo[i].count = test_count;
+        if (pthread_create(&tinfo[i].th, NULL, scale_worker, (void *)&tinfo[i]) != 0)
+        {
+            fprintf(stderr, "Failure to create thread %d\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_mutex_lock(&mutex);
+    while (startupfinished_thread_count < scale_max)
+        pthread_cond_wait(&startupfinished_cond, &mutex);
+    pthread_mutex_unlock(&mutex);
+    tests_metrics_phase(&metrics, METRICS_PHASE_RUNNING);
+    printf("Beginning scaling study ....\n");
+
+    for (n = 1; n <= scale_max && !failure_occured && !tests_stop_requested();
+         n = scale_every ? n + 1 : (n < scale_max && n * 2 > scale_max ? scale_max : n * 2))
+    {
+        if (freq_interval && tests_freq_start(&freq, freq_interval) != TEST_PASSED)
+            exit(EXIT_FAILURE);
+        getrusage(RUSAGE_SELF, &usage_start);
+        tsc = rdtsc();
+        nsec = tests_nsec();
+
+        pthread_mutex_lock(&mutex);
+        active_thread_count = n;
+        scale_threads = n;
+        run_start_nsec = tests_nsec();
+        scale_step++;
+        pthread_cond_broadcast(&start_cond);
+        while (active_thread_count > 0)
+            pthread_cond_wait(&stop_cond, &mutex);
+        pthread_mutex_unlock(&mutex);
+
+        wall = tests_nsec() - nsec;
+        tsc = rdtsc() - tsc;
+        getrusage(RUSAGE_SELF, &usage_stop);
+        tests_freq_stop(&freq);
+        ghz[points] = 0;
+        if (freq_interval && tests_freq_summary(&freq, NULL, &ghz[points], &ghz_min))
+            printf("# WARNING: CPU throttling detected at %d threads\n", n);
+
+        /* without verification, the step lasts as long as its slowest
+           worker and the CPU time of the checks is not part of it */
+        nsec = wall;
+        verify_cpu = 0;
+        bytes = 0;
+        for (i = 0; i < n; i++)
+        {
+            bytes += results[i].bytes;
+            verify_cpu += results[i].verify_cpu_nsec / 1e9;
+        }
+        if (verify)
+        {
+            nsec = 0;
+            for (i = 0; i < n; i++)
+                if (results[i].run_nsec > nsec)
+                    nsec = results[i].run_nsec;
+            if (0 == nsec || nsec > wall)
+                nsec = wall;
+        }
+        cpu = (usage_stop.ru_utime.tv_sec - usage_start.ru_utime.tv_sec) +
+              (usage_stop.ru_utime.tv_usec - usage_start.ru_utime.tv_usec) / 1e6 +
+              (usage_stop.ru_stime.tv_sec - usage_start.ru_stime.tv_sec) +
+              (usage_stop.ru_stime.tv_usec - usage_start.ru_stime.tv_usec) / 1e6;
+        cpu = cpu > verify_cpu ? cpu - verify_cpu : 0;
+
+        steps[points] = n;
+        mbps[points] = bytes * 8 * 1000 / nsec;
+        /* CPU time in TSC cycles, the TSC rate taken over the step */
+        cycles_per_byte[points] = bytes > 0 ? cpu * tsc * 1e9 / wall / bytes : 0;
+        printf("Scale step: %d threads, %.2f Mbps\n", n, mbps[points]);
+        points++;
+    }
+
+    pthread_mutex_lock(&mutex);
+    scale_threads = -1;
+    scale_step++;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&mutex);
+    for (i = 0; i < scale_max; i++)
+        pthread_join(tinfo[i].th, NULL);
+    tests_metrics_phase(&metrics, METRICS_PHASE_DONE);
+
+    printf("All threads complete\n\n");
+    if (failure_occured)
+        printf("AT LEAST ONE FAILURE OCCURED DURING THE TESTS - DO NOT TRUST THE FIGURES PRODUCED\n");
+    else
+        printf("# PASS verify for ZLIB\n");
+    if (points == 0 || mbps[0] <= 0)
+        return;
+
+    usl_fit(steps, mbps, points, &sigma, &kappa);
+
+    printf("\nScaling study, %s, %d iterations per thread:\n", test_name(test_type), test_count);
+    printf("%8s %10s %8s %11s %10s %10s%s\n", "Threads", "Mbps", "Speedup",
+           "Efficiency", "Cycles/B", "USL_Mbps", freq_interval ? "  Avg_GHz" : "");
+    for (i = 0; i < points; i++)
+    {
+        n = steps[i];
+        model = mbps[0] * n / (1 + sigma * (n - 1) + kappa * n * (n - 1));
+        printf("%8d %10.2f %8.2f %10.1f%% %10.2f %10.2f", n, mbps[i],
+               mbps[i] / mbps[0], mbps[i] * 100 / mbps[0] / n,
+               cycles_per_byte[i], model);
+        if (freq_interval)
+            printf(" %8.3f", ghz[i]);
+        printf("\n");
+    }
+    printf("USL fit: contention sigma = %.4f, coherency kappa = %.6f\n", sigma, kappa);
+    if (points < 3)
+        printf("USL fit: fewer than three points, kappa is not determined\n");
+    if (sigma >= 1)
+        printf("USL fit: no gain from a second thread, throughput peaks at 1 thread\n");
+    else if (kappa > 0)
+    {
+        peak = sqrt((1 - sigma) / kappa);
+        printf("USL fit: throughput peaks at %.1f threads, %.2f Mbps\n", peak,
+               mbps[0] * peak / (1 + sigma * (peak - 1) + kappa * peak * (peak - 1)));
+    }
+    else if (sigma > 0)
+        printf("USL fit: no peak, throughput levels off towards %.2f Mbps\n", mbps[0] / sigma);
+
+    printf("\nCSV scaling:\nThreads,Mbps,Speedup,Efficiency,Cycles_per_byte,USL_Mbps,Sigma,Kappa,Avg_GHz\n");
+    for (i = 0; i < points; i++)
+    {
+        n = steps[i];
+        model = mbps[0] * n / (1 + sigma * (n - 1) + kappa * n * (n - 1));
+        printf("csv,%d,%.2f,%.3f,%.3f,%.3f,%.2f,%.6f,%.8f,%.3f\n", n, mbps[i], mbps[i] / mbps[0],
+               mbps[i] / mbps[0] / n, cycles_per_byte[i], model, sigma, kappa, ghz[i]);
+    }
+}
+
+/******************************************************************************
+* function:
+*           procs_reaped(int i, pid_t pid, int status, shared_results_t *shared)
+*
+* @param i      [IN] - worker that exited
+* @param pid    [IN] - its process
+* @param status [IN] - its wait status
+* @param shared [IN] - shared results of the workers
+*
+* description:
+*   account for a worker process that exited. One that did not exit cleanly
+*   or exited before its results were written fails the run, and the other
+*   workers are asked to stop so the run ends instead of waiting on it.
+******************************************************************************/
+static void procs_reaped(int i, pid_t pid, int status, shared_results_t *shared)
+{
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0 &&
+        __atomic_load_n(&shared->worker[i].done, __ATOMIC_ACQUIRE))
+        return;
+
+    if (WIFSIGNALED(status))
+        fprintf(stderr, "Error: worker process %d (pid %d) was killed by signal %d\n",
+                i, (int)pid, WTERMSIG(status));
+    else
+        fprintf(stderr, "Error: worker process %d (pid %d) exited with status %d%s\n",
+                i, (int)pid, WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+                shared->worker[i].done ? "" : " before finishing its run");
+    failure_occured = 1;
+    shared->worker[i].done = 1;
+    tests_stop_request();
+}
+
+/******************************************************************************
+* function:
+*           multiprocess_test(void)
+*
+* description:
+*   runs the test in proc_count forked single threaded worker processes.
+*   The corpus is loaded once before forking so the workers share its pages
+*   copy-on-write and they leave their results in a shared mapping for the
+*   report. The workers are started together by closing the start pipe they
+*   block reading, each writes a byte to the done pipe when it finishes, and
+*   they are let go to shut down by closing the release pipe. The parent
+*   never blocks on a worker: it waits on the done pipe with a timeout and
+*   reaps exited workers as it goes, so one that dies fails the run instead
+*   of hanging it.
+******************************************************************************/
+static void multiprocess_test(void)
+{
+    int i;
+    int rc = 0;
+    int status = 0;
+    int count = 0;
+    int finished = 0;
+    int start_pipe[2], done_pipe[2], release_pipe[2];
+    char byte = 0;
+    char drain[MAX_THREAD];
+    pid_t pid;
+    pid_t pids[MAX_THREAD];
+    int reaped[MAX_THREAD];
+    struct pollfd pfd;
+    cpu_set_t cpuset;
+    unsigned long long span = 0, run_nsec = 0, cpu_nsec = 0;
+    shared_results_t *shared;
+    test_parameters_t test_parameters;
+    struct timeval start_time;
+    struct timeval stop_time;
+    unsigned long long rdtsc_start = 0;
+    unsigned long long rdtsc_end = 0;
+    struct rusage usage_start;
+    struct rusage usage_stop;
+
+    count = test_count / proc_count;
+    if (count == 0)
+    {
+        fprintf(stderr, "Error: count set incorrectly resulting in 0 iterations per process\n");
         exit(EXIT_FAILURE);
     }
-    cleared_to_start = 1;
-    rc = pthread_cond_broadcast(&start_cond);
-    if (rc != 0) {
-        fprintf(stderr, "Failure calling pthread_cond_broadcast, status = %d\n", rc);
+    actual_test_count = count * proc_count;
+
+    shared = mmap(NULL, sizeof(shared_results_t), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == shared) {
+        fprintf(stderr, "Failure to map shared results\n");
         exit(EXIT_FAILURE);
     }
-    rc = pthread_mutex_unlock(&mutex);
-    if (rc != 0) {
-        fprintf(stderr, "Failure to release Mutex Lock, status = %d\n", rc);
+
+    if (pipe(start_pipe) != 0 || pipe(done_pipe) != 0 || pipe(release_pipe) != 0) {
+        fprintf(stderr, "Failure to create the worker process pipes\n");
         exit(EXIT_FAILURE);
     }
 
-    /* wait for other threads stop */
-    rc = pthread_mutex_lock(&mutex);
-    if (rc != 0) {
-        fprintf(stderr, "Failure to get Mutex Lock, status = %d\n", rc);
+    init_test_parameters(&test_parameters, 0, count);
+    if (tests_startup(&test_parameters) != TEST_PASSED) {
+        fprintf(stderr, "Failure during test startup\n");
         exit(EXIT_FAILURE);
     }
 
-    while (active_thread_count > 0) {
-        rc = pthread_cond_wait(&stop_cond, &mutex);
-        if (rc != 0) {
-            fprintf(stderr, "Failure calling pthread_cond_wait, status = %d\n", rc);
+    /* nothing buffered may be inherited or it is printed once per worker */
+    fflush(stdout);
+    fflush(stderr);
+
+    memset(reaped, 0, sizeof(reaped));
+    for (i = 0; i < proc_count; i++)
+    {
+        pid = fork();
+        if (pid < 0) {
+            fprintf(stderr, "Failure to fork worker process %d\n", i);
             exit(EXIT_FAILURE);
         }
+        if (pid == 0)
+        {
+            /* the signals stay blocked here, the parent takes them, and a
+               worker does not outlive an aborted parent */
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            close(start_pipe[1]);
+            close(done_pipe[0]);
+            close(release_pipe[1]);
+            if (cpu_affinity == 1)
+            {
+                CPU_ZERO(&cpuset);
+                CPU_SET(i % core_count, &cpuset);
+                if (sched_setaffinity(0, sizeof(cpu_set_t), &cpuset) != 0)
+                    fprintf(stderr, "sched_setaffinity error for process %d\n", i);
+                else
+                    printf("Process %d assigned on CPU core %d\n", i, i % core_count);
+            }
+
+            test_parameters.id = i;
+            test_parameters.live = metrics.live ? &metrics.live[i] : NULL;
+            test_parameters.trace = trace_rings ? &trace_rings[i] : NULL;
+            test_parameters.trace_calls = trace_calls ? test_parameters.trace : NULL;
+            if (tests_startup_process(&test_parameters) != TEST_PASSED)
+                shared->worker[i].failed = 1;
+            span = tests_trace_start(test_parameters.trace);
+            /* the read returns at end of file, once the parent closes it */
+            while (read(start_pipe[0], &byte, 1) < 0 && errno == EINTR)
+                ;
+            tests_trace_stop(test_parameters.trace, "start wait", span);
+
+            span = tests_trace_start(test_parameters.trace);
+            worker_result_start(&shared->worker[i].result, &test_parameters);
+            run_nsec = tests_nsec();
+            cpu_nsec = tests_cpu_nsec();
+            rc = tests_run(&test_parameters);
+            cpu_nsec = tests_cpu_nsec() - cpu_nsec;
+            run_nsec = tests_nsec() - run_nsec;
+            tests_trace_stop(test_parameters.trace, "run", span);
+            shared->worker[i].failed |= (rc != TEST_PASSED);
+            worker_result_set(&shared->worker[i].result, &test_parameters, run_nsec, cpu_nsec);
+            shared->worker[i].state_bytes = test_parameters.state_bytes;
+            getrusage(RUSAGE_SELF, &shared->worker[i].usage);
+            __atomic_store_n(&shared->worker[i].done, 1, __ATOMIC_RELEASE);
+            if (write(done_pipe[1], &byte, 1) != 1)
+                shared->worker[i].failed = 1;
+
+            span = tests_trace_start(test_parameters.trace);
+            while (read(release_pipe[0], &byte, 1) < 0 && errno == EINTR)
+                ;
+            tests_trace_stop(test_parameters.trace, "stop wait", span);
+
+            if (tests_shutdown(&test_parameters) != TEST_PASSED)
+                shared->worker[i].failed = 1;
+            fflush(stdout);
+            fflush(stderr);
+            _exit(0);
+        }
+        pids[i] = pid;
     }
+    close(start_pipe[0]);
+    close(done_pipe[1]);
+    close(release_pipe[0]);
 
-    rc = pthread_mutex_unlock(&mutex);
-    if (rc != 0) {
-        fprintf(stderr, "Failure to release Mutex Lock, status = %d\n", rc);
+    tests_metrics_phase(&metrics, METRICS_PHASE_READY);
+    printf("Beginning test ....\n");
+    if (freq_interval && tests_freq_start(&freq, freq_interval) != TEST_PASSED)
         exit(EXIT_FAILURE);
+    read_stat (1);
+    gettimeofday(&start_time, NULL);
+    rdtsc_start = rdtsc();
+    close(start_pipe[1]);
+    run_start_nsec = tests_nsec();
+    tests_metrics_phase(&metrics, METRICS_PHASE_RUNNING);
+
+    /* the last done byte wakes the parent at the end of the run, the
+       timeout is there to notice a worker that died without writing it */
+    pfd.fd = done_pipe[0];
+    pfd.events = POLLIN;
+    while (finished < proc_count)
+    {
+        rc = poll(&pfd, 1, 100);
+        if (rc > 0 && read(done_pipe[0], drain, sizeof(drain)) <= 0)
+            pfd.fd = -1;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+        {
+            for (i = 0; i < proc_count && pids[i] != pid; i++)
+                ;
+            if (i == proc_count)
+                continue;
+            reaped[i] = 1;
+            procs_reaped(i, pid, status, shared);
+        }
+        for (i = 0, finished = 0; i < proc_count; i++)
+            if (reaped[i] || __atomic_load_n(&shared->worker[i].done, __ATOMIC_ACQUIRE))
+                finished++;
     }
-
     rdtsc_end = rdtsc();
     gettimeofday(&stop_time, NULL);
     read_stat (0);
+    tests_freq_stop(&freq);
+    tests_metrics_phase(&metrics, METRICS_PHASE_SHUTDOWN);
 
-    rc = pthread_mutex_lock(&mutex);
-    if (rc != 0) {
-        fprintf(stderr, "Failure to get Mutex Lock, status = %d\n", rc);
-        exit(EXIT_FAILURE);
-    }
-
-    while (stop_thread_count > 0) {
-        rc = pthread_cond_wait(&end_cond, &mutex);
-        if (rc != 0) {
-            fprintf(stderr, "Failure calling pthread_cond_wait, status = %d\n", rc);
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    rc = pthread_mutex_unlock(&mutex);
-    if (rc != 0) {
-        fprintf(stderr, "Failure to release Mutex Lock, status = %d\n", rc);
-        exit(EXIT_FAILURE);
+    close(release_pipe[1]);
+    for (i = 0; i < proc_count; i++)
+    {
+        if (reaped[i])
+            continue;
+        if (waitpid(pids[i], &status, 0) < 0)
+            failure_occured = 1;
+        else
+            procs_reaped(i, pids[i], status, shared);
     }
-
-    for (i = 0; i < thread_count; i++)
+    close(done_pipe[0]);
+    tests_metrics_phase(&metrics, METRICS_PHASE_DONE);
+
+    /* the resource usage of the workers is only known from the workers */
+    memset(&usage_start, 0, sizeof(usage_start));
+    memset(&usage_stop, 0, sizeof(usage_stop));
+    actual_test_count = 0;
+    for (i = 0; i < proc_count; i++)
     {
-        if (pthread_join(tinfo[i].th, NULL))
-            printf("Could not join thread id - %d !\n", i);
+        struct rusage *u = &shared->worker[i].usage;
+
+        results[i] = shared->worker[i].result;
+        actual_test_count += results[i].iterations;
+
+        if (shared->worker[i].failed)
+            failure_occured = 1;
+        if (shared->worker[i].state_bytes > state_bytes)
+            state_bytes = shared->worker[i].state_bytes;
+        usage_stop.ru_maxrss += u->ru_maxrss;
+        usage_stop.ru_utime.tv_sec += u->ru_utime.tv_sec;
+        usage_stop.ru_utime.tv_usec += u->ru_utime.tv_usec;
+        usage_stop.ru_stime.tv_sec += u->ru_stime.tv_sec;
+        usage_stop.ru_stime.tv_usec += u->ru_stime.tv_usec;
+        usage_stop.ru_minflt += u->ru_minflt;
+        usage_stop.ru_majflt += u->ru_majflt;
+        usage_stop.ru_nvcsw += u->ru_nvcsw;
+        usage_stop.ru_nivcsw += u->ru_nivcsw;
     }
 
+    /* the parent never ran the test, there is nothing of its own to verify */
+    test_parameters.verify = 0;
+    tests_shutdown(&test_parameters);
 
-    printf("All threads complete\n\n");
+    printf("All processes complete\n\n");
+    if (tests_stop_requested())
+        printf("# Run stopped early after %d of %d operations\n",
+               actual_test_count, count * proc_count);
 
     if (failure_occured)
     {
@@ -849,79 +2856,183 @@ static void performance_test(void)
        printf("# PASS verify for ZLIB\n");
     }
 
-    /* generate report */
-    elapsed = (stop_time.tv_sec - start_time.tv_sec) * 1000000 +
-        (stop_time.tv_usec - start_time.tv_usec);
+    generate_report(&start_time, &stop_time, rdtsc_end - rdtsc_start,
+                    &usage_start, &usage_stop, 1, proc_count);
 
+    munmap(shared, sizeof(shared_results_t));
+}
 
-    /* Cast test_size * test_count to avoid int overflow */
-    throughput = ((float)test_size * (float)actual_test_count *
-                  bytes_to_bits / (float)elapsed);
+/******************************************************************************
+* function:
+*           start_live_counters(void)
+*
+* description:
+*   map the live counters of the workers, shared so worker processes can
+*   update them too, and start the metrics endpoint when one is asked for.
+*   The counters are also what the SIGUSR1 interim report is made from.
+******************************************************************************/
+static void start_live_counters(void)
+{
+    int workers = proc_count > 0 ? proc_count : thread_count;
+    int i;
 
-    printf("Elapsed time   = %.3f msec\n", (float)elapsed / 1000);
-    printf("Operations     = %d\n", actual_test_count);
+    metrics.live = mmap(NULL, workers * sizeof(live_counters_t), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == metrics.live) {
+        fprintf(stderr, "Failure to map the live counters\n");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < workers; i++)
+        metrics.live[i].test = test_name(test_type);
+    metrics.workers = workers;
 
-    printf("Time per op    = %.3f usec (%d ops/sec)\n",
-           (float)elapsed / actual_test_count,
-           (int)((float)test_count * 1000000.0 / (float)elapsed));
+    if (metrics.endpoint && tests_metrics_start(&metrics) != TEST_PASSED)
+        exit(EXIT_FAILURE);
+}
 
-    printf("Elapsed cycles = %llu\n", rdtsc_end - rdtsc_start);
+/* Upper bound of the power of two bucket holding a latency percentile */
+static double live_percentile_usec(const unsigned long long *latency,
+                                   unsigned long long count, double percentile)
+{
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * count);
+    unsigned long long seen = 0;
+    int b;
 
-    printf("Throughput     = %.2f (Mbps)\n", throughput);
+    for (b = 0; b < LIVE_BUCKETS; b++)
+    {
+        seen += latency[b];
+        if (seen > rank)
+            break;
+    }
+    return (double)(2ULL << (b < LIVE_BUCKETS - 1 ? b : LIVE_BUCKETS - 2)) / 1000;
+}
 
-    printf("\nCSV summary:\n");
+/******************************************************************************
+* function:
+*           interim_report(void)
+*
+* description:
+*   print the throughput and latency of every worker so far from the live
+*   counters, on SIGUSR1, while the workers carry on
+******************************************************************************/
+static void interim_report(void)
+{
+    unsigned long long latency[LIVE_BUCKETS];
+    unsigned long long ops = 0, in = 0, out = 0, errors = 0;
+    unsigned long long elapsed = 0;
+    int i, b;
 
-    printf("Algorithm,"
-           "Test_type,"
-           "Deflate_buffering_enabled,"
-           "Inflate_buffering_enabled,"
-           "Compression_Level,"
-           "Chunk_Size,"
-           "Stream_type,"
-           "Core_affinity,"
-           "Elapsed_usec,"
-           "Cores,"
-           "Threads,"
-           "Count,"
-           "Data_per_test,"
-           "Mbps,"
-           "CPU_%%,"
-           "User_%%,"
-           "Kernel_%%,"
-           "Ratio,"
-           "Context_switches,"
-           "Cycles\n");
+    if (0 == run_start_nsec)
+    {
+        printf("\n# Interim report: the run has not started yet\n");
+        fflush(stdout);
+        return;
+    }
+    elapsed = tests_nsec() - run_start_nsec;
+    memset(latency, 0, sizeof(latency));
+
+    flockfile(stdout);
+    printf("\n# Interim report after %.3f sec%s\n", (double)elapsed / 1e9,
+           tests_stop_requested() ? " (stopping)" : "");
+    printf("%8s %10s %12s %12s %8s\n", "Worker", "Ops", "In_Mbps", "Out_Mbps", "Errors");
+    for (i = 0; i < metrics.workers; i++)
+    {
+        live_counters_t *live = &metrics.live[i];
+        unsigned long long o = __atomic_load_n(&live->ops, __ATOMIC_RELAXED);
+        unsigned long long bi = __atomic_load_n(&live->bytes_in, __ATOMIC_RELAXED);
+        unsigned long long bo = __atomic_load_n(&live->bytes_out, __ATOMIC_RELAXED);
+        unsigned long long e = __atomic_load_n(&live->errors, __ATOMIC_RELAXED);
+
+        for (b = 0; b < LIVE_BUCKETS; b++)
+            latency[b] += __atomic_load_n(&live->latency[b], __ATOMIC_RELAXED);
+        printf("%8d %10llu %12.2f %12.2f %8llu\n", i, o,
+               (double)bi * 8 * 1000 / elapsed, (double)bo * 8 * 1000 / elapsed, e);
+        ops += o;
+        in += bi;
+        out += bo;
+        errors += e;
+    }
+    printf("%8s %10llu %12.2f %12.2f %8llu\n", "all", ops,
+           (double)in * 8 * 1000 / elapsed, (double)out * 8 * 1000 / elapsed, errors);
+    if (ops)
+        printf("Latency p50/p90/p99 <= %.1f/%.1f/%.1f usec\n",
+               live_percentile_usec(latency, ops, 50),
+               live_percentile_usec(latency, ops, 90),
+               live_percentile_usec(latency, ops, 99));
+    printf("\n");
+    fflush(stdout);
+    funlockfile(stdout);
+}
 
-    unsigned long cpu_time = 0;
-    unsigned long cpu_user = 0;
-    unsigned long cpu_kernel = 0;
+static sigset_t signal_set;
 
-    cpu_time = (cpu_time_total.user +
-                cpu_time_total.nice +
-                cpu_time_total.sys +
-                cpu_time_total.io +
-                cpu_time_total.irq +
-                cpu_time_total.softirq) * CPU_TIME_MULTIPLIER / core_count;
-    cpu_user = cpu_time_total.user * CPU_TIME_MULTIPLIER / core_count;
-    cpu_kernel = cpu_time_total.sys * CPU_TIME_MULTIPLIER / core_count;
+/******************************************************************************
+* function:
+*           *signal_worker(void *arg)
+*
+* description:
+*   take the signals meant for the run: SIGUSR1 prints an interim report,
+*   SIGINT/SIGTERM ask the workers to stop after their current iteration
+*   so the run is still reported, a second one aborts.
+******************************************************************************/
+static void *signal_worker(void *arg)
+{
+    int sig = 0;
+    int stops = 0;
 
-    printf("csv,%s,%d,%s,%s,%d,%d,%d,%s,%lu,%d,%d,%d,%d,%.2f,%lu,%lu,%lu,%.3f,%d,%llu\n",
-           test_name(test_type),
-           test_type,
-           enable_deflate_buffering ? "Yes" : "No",
-           enable_inflate_buffering ? "Yes" : "No",
-           compression_level,
-           chunk_size,
-           stream_type,
-           cpu_affinity ? "Yes" : "No",
-           elapsed,
-           core_count, thread_count, actual_test_count, test_size, throughput,
-           cpu_time * CPU_PERCENTAGE_MULTIPLIER / elapsed,
-           cpu_user * CPU_PERCENTAGE_MULTIPLIER / elapsed,
-           cpu_kernel * CPU_PERCENTAGE_MULTIPLIER / elapsed,
-           ratio,
-           cpu_context.context,
-           rdtsc_end-rdtsc_start);
+    while (1)
+    {
+        if (sigwait(&signal_set, &sig) != 0)
+            continue;
+
+        if (sig == SIGUSR1)
+        {
+            interim_report();
+            continue;
+        }
+
+        if (stops++ == 0)
+        {
+            fprintf(stderr, "\n# %s: stopping after the current iterations, "
+                    "send it again to abort\n", strsignal(sig));
+            tests_stop_request();
+        }
+        else
+        {
+            fprintf(stderr, "\n# %s: aborted\n", strsignal(sig));
+            _exit(128 + sig);
+        }
+    }
+    return NULL;
+}
+
+/******************************************************************************
+* function:
+*           start_signal_thread(void)
+*
+* description:
+*   block the signals of the run in every thread and worker process started
+*   from here on, they are taken by a thread of their own with sigwait
+******************************************************************************/
+static void start_signal_thread(void)
+{
+    pthread_t th;
+    int rc = 0;
+
+    sigemptyset(&signal_set);
+    sigaddset(&signal_set, SIGINT);
+    sigaddset(&signal_set, SIGTERM);
+    sigaddset(&signal_set, SIGUSR1);
+
+    rc = pthread_sigmask(SIG_BLOCK, &signal_set, NULL);
+    if (rc == 0)
+        rc = pthread_create(&th, NULL, signal_worker, NULL);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Failure to start the signal thread, status = %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(th);
 }
 
 void CHECK_ERR(int err, char *msg)
@@ -962,6 +3073,97 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    if (scenario_path)
+    {
+        if (proc_count > 0)
+        {
+            fprintf(stderr, "Error: -scenario runs thread groups, it can not be used with -procs\n");
+            exit(EXIT_FAILURE);
+        }
+        load_scenario(scenario_path);
+    }
+
+    if (inflate_engine == INFLATE_ENGINE_BACK && outbuf_size)
+    {
+        fprintf(stderr, "Error: -engine back writes the whole output in place, it can not be used with -outbuf\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (proc_count > 0 && thread_count > 1)
+    {
+        fprintf(stderr, "Error: -procs runs single threaded workers, it can not be used with -n\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (scale_max)
+    {
+        if (proc_count > 0 || group_count || thread_count > 1)
+        {
+            fprintf(stderr, "Error: -scale picks the thread counts itself, it can not be used with "
+                            "-n, -procs or -scenario\n");
+            exit(EXIT_FAILURE);
+        }
+        /* everything sized by thread count is sized for the largest step */
+        thread_count = scale_max;
+    }
+
+    /* The trace is read once and shared by the workers */
+    if (test_type == TEST_CORPUS_REPLAY && !group_count)
+    {
+        if (NULL == replay_path)
+        {
+            fprintf(stderr, "Error: the replay test needs a trace, use -replay <file.csv>\n");
+            exit(EXIT_FAILURE);
+        }
+        if (tests_replay_load(replay_path, &replay_trace) != TEST_PASSED)
+            exit(EXIT_FAILURE);
+        replay_trace.paced = replay_paced;
+        replay = &replay_trace;
+    }
+    for (i = 0; i < group_count; i++)
+    {
+        if (groups[i].type == TEST_CORPUS_REPLAY)
+        {
+            fprintf(stderr, "Error: the replay test splits the trace over all the threads, "
+                            "it can not be a -scenario group\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* The signals are blocked before any other thread is started, every
+       thread inherits the mask and only the signal thread takes them */
+    if (tests_stop_init() != TEST_PASSED)
+    {
+        fprintf(stderr, "Failure to map the stop flag\n");
+        exit(EXIT_FAILURE);
+    }
+    start_signal_thread();
+
+    /* The device is shared by the threads of the run, it is not there for
+       worker processes */
+    for (i = 0, offload = NULL; i < (group_count ? group_count : 1); i++)
+    {
+        if ((group_count ? groups[i].type : test_type) != TEST_CORPUS_OFFLOAD)
+            continue;
+        if (proc_count > 0)
+        {
+            fprintf(stderr, "Error: the offload test serves threads, it can not be used with -procs\n");
+            exit(EXIT_FAILURE);
+        }
+        if (tests_offload_open(&offload_device, offload_engines) != TEST_PASSED)
+            exit(EXIT_FAILURE);
+        offload = &offload_device;
+        break;
+    }
+
+    start_live_counters();
+    if (trace_path)
+    {
+        trace_rings = tests_trace_open(proc_count > 0 ? proc_count : thread_count);
+        if (NULL == trace_rings)
+            exit(EXIT_FAILURE);
+    }
+
     active_thread_count = thread_count;
     stop_thread_count = thread_count;
     ready_thread_count = 0;
@@ -969,23 +3171,110 @@ int main(int argc, char *argv[])
 
     printf("\nzlib performance test application\n");
     printf("\nTest parameters:\n\n");
-    printf("\tTest type:                        %d (%s)\n", test_type, test_name(test_type));
+    if (group_count)
+        printf("\tScenario:                         %s (%d groups)\n", scenario_path, group_count);
+    else
+        printf("\tTest type:                        %d (%s)\n", test_type, test_name(test_type));
     printf("\tCompression level:                %d\n", compression_level);
+    printf("\tMemory level:                     %d\n", mem_level);
+    printf("\tWindow bits:                      %d\n", window_bits);
+    printf("\tStrategy:                         %d (%s)\n", strategy, strategy_name(strategy));
     printf("\tStream type:                      %d (%s)\n", stream_type, streamtype_name(stream_type));
     printf("\tTest count:                       %d\n", test_count);
-    printf("\tThread count:                     %d\n", thread_count);
+    if (proc_count > 0)
+        printf("\tProcess count:                    %d\n", proc_count);
+    else if (scale_max)
+        printf("\tThread count:                     1 to %d, %s\n", scale_max,
+               scale_every ? "every count" : "powers of two");
+    else
+        printf("\tThread count:                     %d\n", thread_count);
     printf("\tNumber of cores:                  %d\n", core_count);
-    printf("\tChunk size:                       %d\n", chunk_size);
+    if (size_dist.kind != SIZE_DIST_FIXED)
+    {
+        char dist[128];
+
+        tests_sizes_describe(&size_dist, dist, sizeof(dist));
+        printf("\tChunk size:                       %s\n", dist);
+    }
+    else
+        printf("\tChunk size:                       %d\n", chunk_size);
     printf("\tCorpus used:                      %d (%s)\n", corpus, corpus_name(corpus));
     printf("\tBuffering in deflate enabled:     %s\n", enable_deflate_buffering ? "Yes" : "No");
     printf("\tBuffering in inflate enabled:     %s\n", enable_inflate_buffering ? "Yes" : "No");
     printf("\tAllow Partial Chunks:             %s\n", allow_partial_chunks ? "Yes" : "No");
     printf("\tCPU core affinity:                %s\n", cpu_affinity ? "Yes" : "No");
     printf("\tVerification:                     %s\n", verify ? "Yes" : "No");    
+    if (verify)
+        printf("\tVerify interval:                  %d\n", verify_interval);
+    if (outbuf_size)
+    {
+        printf("\tOutput buffer:                    %d\n", outbuf_size);
+        printf("\tOutput sink:                      %d (%s)\n", sink_type, sink_name(sink_type));
+    }
+    if (rate > 0)
+        printf("\tRate per thread:                  %.2f ops/sec\n", rate);
+    for (i = 0; i < group_count; i++)
+        printf("\tGroup %-16s            %d threads, count %d, type %d, level %d, chunk %d, stream %d, corpus %d%s\n",
+               groups[i].name, groups[i].threads, groups[i].count, groups[i].type,
+               groups[i].level, groups[i].chunk, groups[i].stream, groups[i].corpus,
+               groups[i].ncpus ? ", pinned" : "");
+    if (test_type == TEST_CORPUS_MIXED)
+        printf("\tDeflate:inflate mix:              %d:%d%s\n", mix_deflate, mix_inflate,
+               mix_per_thread ? " (per thread)" : "");
+    if (flush_policy != FLUSH_POLICY_OFF || test_type == TEST_CORPUS_FLUSH)
+        printf("\tFlush schedule:                   %s every %lu %s\n",
+               flush_policy != FLUSH_POLICY_OFF ? flush_name(flush_policy) : "each policy",
+               flush_every, flush_bytes ? "bytes" : "chunks");
+    if (test_type == TEST_CORPUS_BATCH)
+        printf("\tRecord batch:                     %d records of %lu-%lu bytes\n",
+               batch_records, batch_min, batch_max);
+    if (test_type == TEST_CORPUS_STREAMS)
+    {
+        printf("\tConcurrent streams:               ");
+        for (i = 0; i < streams_sweeps; i++)
+            printf("%s%d", i ? "," : "", streams_sweep[i]);
+        printf("\n");
+    }
+    if (replay)
+        printf("\tReplay trace:                     %s (%d records over %.3f sec%s)\n",
+               replay_path, replay->count, (double)replay->span_usec / 1e6,
+               replay->paced ? ", paced" : "");
+    if (offload)
+        printf("\tOffload device:                   %d engines, depth %d, batch %d\n",
+               offload_engines, offload_depth, offload_batch);
+    if (inflate_engine == INFLATE_ENGINE_BACK)
+        printf("\tInflate engine:                   inflateBack\n");
+    if (bgzf_path[0] != '\0')
+        printf("\tBGZF output:                      %s\n", bgzf_path);
+    if (freq_interval)
+        printf("\tFrequency sampling:               every %d msec\n", freq_interval);
+    if (metrics.endpoint)
+        printf("\tMetrics endpoint:                 %s\n", metrics.endpoint);
+    if (trace_path)
+        printf("\tTrace file:                       %s%s\n", trace_path,
+               trace_calls ? " (with calls)" : "");
 
     printf("\n");
 
-    performance_test();
+    if (proc_count > 0)
+        multiprocess_test();
+    else if (scale_max)
+        scale_test();
+    else
+        performance_test();
+
+    if (trace_rings)
+        tests_trace_dump(trace_path, trace_rings, proc_count > 0 ? proc_count : thread_count,
+                         proc_count > 0);
+
+    if (offload)
+        tests_offload_close(offload);
+
+    if (replay)
+        tests_replay_free(replay);
+
+    if (metrics.endpoint)
+        tests_metrics_stop(&metrics);
 
     return 0;
 }
@@ -6,24 +6,76 @@
 typedef struct
 {
     int count;
+    int completed;
     int type;
     int id;
+    int cores;
+    int threads;
     char *file_path;
     unsigned char* input_buf;
     unsigned char* output_buf;
     unsigned long input_buflen;
     unsigned long output_buflen;
+    unsigned char* scratch_buf;
+    unsigned long scratch_buflen;
+    unsigned char* dictionary;
+    unsigned int dictionary_len;
+    unsigned char* index_buf;
+    unsigned long index_len;
+    unsigned long reference_len;
+    char *bgzf_path;
+    struct bgzf_pool *bgzf_pool;
     unsigned long single_call_bytes;
+    unsigned long state_bytes;
+    unsigned long outbuf_size;
+    int sink_type;
+    char *sink_path;
     unsigned long  verify_checksum;
     int level;
+    int mem_level;
+    int window_bits;
+    int strategy;
     int chunksize;
     int corpus;
     int enable_deflate_buffering;
     int enable_inflate_buffering;
     int allow_partial_chunks;
     int streamtype;
+    int mix_deflate;
+    int mix_inflate;
+    int mix_per_thread;
+    int flush_policy;
+    unsigned long flush_every;
+    int flush_bytes;
+    int inflate_engine;
+    int batch_records;
+    unsigned long batch_min;
+    unsigned long batch_max;
     int verify;
+    int verify_interval;
+    int verify_phase;
+    unsigned char* verify_buf;
+    unsigned long verify_checked;
+    unsigned long long verify_nsec;
+    unsigned long long verify_cpu_nsec;
+    unsigned long long verify_helper_nsec;
+    struct crc_pool *crc_pool;
+    struct live_counters *live;
+    struct trace_ring *trace;
+    struct trace_ring *trace_calls;
+    struct offload_device *offload;
+    int offload_depth;
+    int offload_batch;
+    int *streams_sweep;
+    int streams_sweeps;
+    struct replay_trace *replay;
+    struct size_dist *size_dist;
+    unsigned int *sizes;
+    unsigned int sizes_next;
     float ratio;
+    float rate;
+    float target_mbps;
+    float target_ratio;
     z_stream strm;
 }
 test_parameters_t;
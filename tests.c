@@ -11,12 +11,699 @@
 #endif
 
 #include <pthread.h>
+#include <sys/mman.h>
 
+#include "zlib.h"
 #include "tests.h"
 
+/* Largest number of slices the crc32 of a buffer is split into */
+#define CRC_MAX_SLICES 256
+
+typedef struct
+{
+    pthread_t th;
+    const unsigned char *buf;
+    unsigned long len;
+    unsigned long crc;
+    struct crc_pool *pool;
+}
+crc_slice_t;
+
+/* crc32 helpers of a worker, started with the worker so that a verified
+   iteration or a measured parallel crc32 only hands them their slices.
+   Helper i computes slice i, the worker slice 0. */
+typedef struct crc_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    unsigned long generation;
+    int active;
+    int pending;
+    int quit;
+    int helpers;
+    unsigned long long helper_nsec;
+    crc_slice_t slice[CRC_MAX_SLICES];
+}
+crc_pool_t;
+
+static void *crc_slice_worker(void *arg)
+{
+    crc_slice_t *slice = (crc_slice_t *)arg;
+
+    slice->crc = crc32(0, slice->buf, (uInt)slice->len);
+    return NULL;
+}
+
+static void *crc_pool_helper(void *arg)
+{
+    crc_slice_t *slice = (crc_slice_t *)arg;
+    crc_pool_t *pool = slice->pool;
+    int index = slice - pool->slice;
+    unsigned long seen = 0;
+    unsigned long long cpu = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        if (index >= pool->active)
+            continue;
+        pthread_mutex_unlock(&pool->lock);
+
+        cpu = tests_cpu_nsec();
+        crc_slice_worker(slice);
+        cpu = tests_cpu_nsec() - cpu;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->helper_nsec += cpu;
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void crc_pool_destroy(crc_pool_t *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (i = 1; i <= pool->helpers; i++)
+        pthread_join(pool->slice[i].th, NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+/******************************************************************************
+* function:
+*     crc_pool_create (int slices)
+*
+* @param slices [IN] - largest number of slices the pool splits a buffer into
+*
+* description:
+*   start the slices - 1 helper threads of a pool, the thread using the
+*   pool computes the first slice itself. Fewer helpers than asked for is
+*   not an error, the buffers are then cut into fewer slices.
+******************************************************************************/
+static crc_pool_t *crc_pool_create(int slices)
+{
+    crc_pool_t *pool = NULL;
+    int i;
+
+    if (slices > CRC_MAX_SLICES)
+        slices = CRC_MAX_SLICES;
+    pool = calloc(1, sizeof(crc_pool_t));
+    if (NULL == pool)
+        return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (i = 1; i < slices; i++) {
+        pool->slice[i].pool = pool;
+        if (pthread_create(&pool->slice[i].th, NULL, crc_pool_helper, &pool->slice[i]) != 0)
+            break;
+        pool->helpers++;
+    }
+    return pool;
+}
+
+/******************************************************************************
+* function:
+*     tests_crc32_pool (crc_pool_t *pool,
+*                       const unsigned char *buf,
+*                       unsigned long len,
+*                       int slices,
+*                       unsigned long long *helper_nsec)
+*
+* @param pool        [IN] - helpers of the calling worker
+* @param buf         [IN] - data to checksum
+* @param len         [IN] - length of the data
+* @param slices      [IN] - number of slices to cut the data into
+* @param helper_nsec [OUT] - CPU time the helpers spent on it, or NULL
+*
+* description:
+*   returns the crc32 of a buffer computed in slices by the calling thread
+*   and the helpers of the pool, merged with crc32_combine
+******************************************************************************/
+unsigned long tests_crc32_pool(crc_pool_t *pool, const unsigned char *buf,
+                               unsigned long len, int slices,
+                               unsigned long long *helper_nsec)
+{
+    unsigned long part = 0;
+    unsigned long result = 0;
+    int i;
+
+    if (slices > pool->helpers + 1)
+        slices = pool->helpers + 1;
+    if (slices < 1 || (unsigned long)slices > len)
+        slices = 1;
+    part = len / slices;
+
+    for (i = 0; i < slices; i++) {
+        pool->slice[i].buf = buf + (i * part);
+        pool->slice[i].len = (i == slices - 1) ? len - (i * part) : part;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->active = slices;
+    pool->pending = slices - 1;
+    pool->helper_nsec = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    crc_slice_worker(&pool->slice[0]);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+    if (helper_nsec)
+        *helper_nsec = pool->helper_nsec;
+    pthread_mutex_unlock(&pool->lock);
+
+    result = pool->slice[0].crc;
+    for (i = 1; i < slices; i++)
+        result = crc32_combine(result, pool->slice[i].crc, pool->slice[i].len);
+    return result;
+}
+
+/******************************************************************************
+* function:
+*     tests_verify_init (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - parameters of one worker
+*
+* description:
+*   pick the iteration within every verify_interval iterations this worker
+*   verifies. The phase is random per worker so the workers of a run do not
+*   all verify on the same iterations. The first time, also start the crc32
+*   helpers of the worker.
+******************************************************************************/
+void tests_verify_init(test_parameters_t* test_parameters)
+{
+    unsigned int seed = (unsigned int)tests_nsec() ^ (test_parameters->id * 2654435761U);
+    int span = test_parameters->verify_interval;
+
+    if (span < 1)
+        span = 1;
+    if (span > test_parameters->count)
+        span = test_parameters->count;
+
+    test_parameters->verify_phase = (span > 1) ? rand_r(&seed) % span : 0;
+    test_parameters->verify_nsec = 0;
+    test_parameters->verify_cpu_nsec = 0;
+    test_parameters->verify_helper_nsec = 0;
+    test_parameters->verify_checked = 0;
+
+    if (test_parameters->verify)
+        tests_crc_pool_start(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_crc_pool_start (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - parameters of one worker
+*
+* description:
+*   start the crc32 helpers of a worker unless it has them already, one less
+*   than its share of the cores. Returns the number of slices the helpers
+*   and the worker split a crc32 into, 1 when there are no helpers.
+******************************************************************************/
+int tests_crc_pool_start(test_parameters_t* test_parameters)
+{
+    int share = test_parameters->cores;
+
+    if (test_parameters->threads > 1)
+        share /= test_parameters->threads;
+    if (NULL == test_parameters->crc_pool && share > 1)
+        test_parameters->crc_pool = crc_pool_create(share);
+    return test_parameters->crc_pool ? test_parameters->crc_pool->helpers + 1 : 1;
+}
+
+/******************************************************************************
+* function:
+*     tests_verify_due (test_parameters_t* test_parameters, int iteration)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param iteration       [IN] - iteration about to run
+*
+* description:
+*   returns 1 when the output of this iteration is to be verified
+******************************************************************************/
+int tests_verify_due(test_parameters_t* test_parameters, int iteration)
+{
+    if (!test_parameters->verify)
+        return 0;
+    if (test_parameters->verify_interval <= 1)
+        return 1;
+    return (iteration % test_parameters->verify_interval) == test_parameters->verify_phase;
+}
+
+/******************************************************************************
+* function:
+*     tests_verify_buffer (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - parameters of one worker
+*
+* description:
+*   returns the buffer a verified iteration decompresses into. It is
+*   allocated on first use, big enough for the uncompressed corpus, and
+*   cleared every time so data left by an earlier iteration can not pass
+*   for the output of this one. The time taken is not part of the run.
+******************************************************************************/
+unsigned char *tests_verify_buffer(test_parameters_t* test_parameters)
+{
+    verify_span_t span;
+
+    tests_verify_start(&span);
+    if (NULL == test_parameters->verify_buf) {
+        test_parameters->verify_buf = malloc(test_parameters->input_buflen + 100);
+        if (NULL == test_parameters->verify_buf) {
+            fprintf(stderr, "# FAIL: Could not allocate verify buffer.\n");
+            return NULL;
+        }
+    }
+    memset(test_parameters->verify_buf, 0, test_parameters->input_buflen + 100);
+
+    tests_verify_stop(test_parameters, &span);
+    return test_parameters->verify_buf;
+}
+
+static int verify_data(test_parameters_t* test_parameters,
+                       const unsigned char *data, unsigned long len)
+{
+    unsigned long long helper_nsec = 0;
+    unsigned long crc = 0;
+    int slices = test_parameters->cores;
+
+    if (len != test_parameters->input_buflen) {
+        fprintf(stderr, "# FAIL: thread %d verify length %lu, expected %lu\n",
+                test_parameters->id, len, test_parameters->input_buflen);
+        return TEST_FAILED;
+    }
+
+    /* Slices smaller than this are not worth a helper */
+    if ((unsigned long)slices > len / (256 * 1024))
+        slices = len / (256 * 1024);
+    if (test_parameters->crc_pool && slices > 1) {
+        crc = tests_crc32_pool(test_parameters->crc_pool, data, len, slices, &helper_nsec);
+        test_parameters->verify_helper_nsec += helper_nsec;
+    }
+    else {
+        crc = crc32(0, data, (uInt)len);
+    }
+
+    if (crc != test_parameters->verify_checksum) {
+        fprintf(stderr, "# FAIL: thread %d verify crc32 0x%08lx, expected 0x%08lx\n",
+                test_parameters->id, crc, test_parameters->verify_checksum);
+        return TEST_FAILED;
+    }
+
+    test_parameters->verify_checked++;
+    return TEST_PASSED;
+}
+
+/******************************************************************************
+* function:
+*     tests_verify_data (test_parameters_t* test_parameters,
+*                        const unsigned char *data,
+*                        unsigned long len)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param data            [IN] - uncompressed output of an iteration
+* @param len             [IN] - length of the output
+*
+* description:
+*   check the output of an iteration against the crc32 of the corpus taken
+*   at startup. The time taken is not part of the run.
+******************************************************************************/
+int tests_verify_data(test_parameters_t* test_parameters,
+                      const unsigned char *data, unsigned long len)
+{
+    verify_span_t span;
+    int failed = TEST_PASSED;
+
+    tests_verify_start(&span);
+    failed = verify_data(test_parameters, data, len);
+    tests_verify_stop(test_parameters, &span);
+    return failed;
+}
+
+/******************************************************************************
+* function:
+*     tests_verify_stream (test_parameters_t* test_parameters,
+*                          const unsigned char *stream,
+*                          unsigned long len)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param stream          [IN] - compressed output of an iteration
+* @param len             [IN] - length of the compressed output
+*
+* description:
+*   inflate the output of a compression iteration into the verify buffer
+*   and check it against the crc32 of the corpus taken at startup. The time
+*   taken is not part of the run.
+******************************************************************************/
+int tests_verify_stream(test_parameters_t* test_parameters,
+                        const unsigned char *stream, unsigned long len)
+{
+    z_stream strm;
+    unsigned char *out = NULL;
+    verify_span_t span;
+    int failed = TEST_PASSED;
+    int ret = 0;
+
+    out = tests_verify_buffer(test_parameters);
+    if (NULL == out)
+        return TEST_FAILED;
+
+    tests_verify_start(&span);
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, tests_window_bits(test_parameters->streamtype,
+                                                test_parameters->window_bits));
+    if (ret != Z_OK) {
+        fprintf(stderr, "# FAIL: inflateInit2 for verify failed, ret:%d\n", ret);
+        failed = TEST_FAILED;
+    }
+    else {
+        strm.next_in = (void *)stream;
+        strm.avail_in = len;
+        strm.next_out = out;
+        strm.avail_out = test_parameters->input_buflen + 100;
+        ret = inflate(&strm, Z_FINISH);
+        if (ret != Z_STREAM_END) {
+            fprintf(stderr, "# FAIL: thread %d verify inflate failed, ret:%d\n",
+                    test_parameters->id, ret);
+            failed = TEST_FAILED;
+        }
+        else {
+            failed = verify_data(test_parameters, out, strm.total_out);
+        }
+        inflateEnd(&strm);
+    }
+
+    tests_verify_stop(test_parameters, &span);
+    return failed;
+}
+
+/******************************************************************************
+* function:
+*     tests_verify_report (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - parameters of one worker
+*
+* description:
+*   print how many iterations of the worker were verified and release the
+*   verify buffer and crc32 helpers. Returns TEST_FAILED when verification was asked for but
+*   no iteration was checked, unless the run was stopped before the worker
+*   reached the iteration it samples: that worker is reported unchecked.
+******************************************************************************/
+int tests_verify_report(test_parameters_t* test_parameters)
+{
+    int failed = TEST_PASSED;
+
+    if (test_parameters->verify) {
+        if (test_parameters->verify_checked > 0) {
+            fprintf(stderr, "\nVerification: PASS (thread %d, %lu outputs checked over %d iterations)\n\n",
+                    test_parameters->id, test_parameters->verify_checked,
+                    test_parameters->completed);
+        }
+        else if (tests_stop_requested() &&
+                 test_parameters->completed < test_parameters->count) {
+            fprintf(stderr, "\nVerification: UNCHECKED (thread %d, stopped after %d iterations "
+                    "before the one it verifies)\n\n", test_parameters->id,
+                    test_parameters->completed);
+        }
+        else {
+            fprintf(stderr, "\nVerification: FAIL (thread %d, no iteration checked)\n\n",
+                    test_parameters->id);
+            failed = TEST_FAILED;
+        }
+    }
+
+    if (test_parameters->verify_buf) {
+        free(test_parameters->verify_buf);
+        test_parameters->verify_buf = NULL;
+    }
+    if (test_parameters->crc_pool) {
+        crc_pool_destroy(test_parameters->crc_pool);
+        test_parameters->crc_pool = NULL;
+    }
+    return failed;
+}
+
+/******************************************************************************
+* function:
+*     tests_pace (test_parameters_t* test_parameters,
+*                 int iteration,
+*                 unsigned long long start)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param iteration       [IN] - iteration about to run
+* @param start           [IN] - tests_nsec() when the first iteration started
+*
+* description:
+*   hold an iteration back until it is due when the worker runs at a target
+*   rate of operations per second. A worker that falls behind is not made
+*   to catch up in a burst beyond running without pauses.
+******************************************************************************/
+void tests_pace(test_parameters_t* test_parameters, int iteration,
+                unsigned long long start)
+{
+    unsigned long long due = 0, now = 0;
+    struct timespec ts;
+
+    if (test_parameters->rate <= 0)
+        return;
+
+    due = start + (unsigned long long)(iteration * 1000000000.0 / test_parameters->rate);
+    now = tests_nsec();
+    if (now >= due)
+        return;
+
+    ts.tv_sec = (due - now) / 1000000000ULL;
+    ts.tv_nsec = (due - now) % 1000000000ULL;
+    nanosleep(&ts, NULL);
+}
+
+/* Stop flag set on SIGINT/SIGTERM, in a shared mapping so the workers of
+   -procs mode see it as well */
+static int *stop_flag = NULL;
+
+/******************************************************************************
+* function:
+*     tests_stop_init (void)
+*
+* description:
+*   map the stop flag, before any worker process is forked
+******************************************************************************/
+int tests_stop_init(void)
+{
+    stop_flag = mmap(NULL, sizeof(*stop_flag), PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == stop_flag) {
+        stop_flag = NULL;
+        return TEST_FAILED;
+    }
+    *stop_flag = 0;
+    return TEST_PASSED;
+}
+
+void tests_stop_request(void)
+{
+    if (stop_flag)
+        __atomic_store_n(stop_flag, 1, __ATOMIC_RELAXED);
+}
+
+int tests_stop_requested(void)
+{
+    return stop_flag ? __atomic_load_n(stop_flag, __ATOMIC_RELAXED) : 0;
+}
+
+/******************************************************************************
+* function:
+*     tests_running (test_parameters_t* test_parameters, int iteration)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param iteration       [IN] - iteration about to run
+*
+* description:
+*   loop condition of the test iterations: returns 1 while the iteration is
+*   within the count and no stop was requested. The iterations run so far
+*   are kept in completed, it is what the report counts after an early stop.
+******************************************************************************/
+int tests_running(test_parameters_t* test_parameters, int iteration)
+{
+    test_parameters->completed = iteration;
+    if (iteration >= test_parameters->count)
+        return 0;
+    return !tests_stop_requested();
+}
+
+/* Single writer increment of a live counter, the store is atomic so the
+   metrics thread never reads a torn value */
+#define LIVE_ADD(counter, value) \
+    __atomic_store_n(&(counter), (counter) + (value), __ATOMIC_RELAXED)
+
+/******************************************************************************
+* function:
+*     tests_live_op (test_parameters_t* test_parameters,
+*                    unsigned long bytes_in,
+*                    unsigned long bytes_out,
+*                    unsigned long long nsec)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param bytes_in        [IN] - bytes the operation consumed
+* @param bytes_out       [IN] - bytes the operation produced
+* @param nsec            [IN] - time the operation took
+*
+* description:
+*   count a completed operation in the live counters of the worker and
+*   refresh its cpu time, nothing is done unless a metrics endpoint is running
+******************************************************************************/
+void tests_live_op(test_parameters_t* test_parameters, unsigned long bytes_in,
+                   unsigned long bytes_out, unsigned long long nsec)
+{
+    live_counters_t *live = test_parameters->live;
+    struct timespec cpu;
+
+    if (NULL == live)
+        return;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    __atomic_store_n(&live->cpu_nsec,
+                     (unsigned long long)cpu.tv_sec * 1000000000ULL + cpu.tv_nsec,
+                     __ATOMIC_RELAXED);
+    LIVE_ADD(live->ops, 1);
+    LIVE_ADD(live->bytes_in, bytes_in);
+    LIVE_ADD(live->bytes_out, bytes_out);
+    LIVE_ADD(live->latency_sum, nsec);
+    LIVE_ADD(live->latency[63 - __builtin_clzll(nsec | 1)], 1);
+}
+
+void tests_live_error(test_parameters_t* test_parameters)
+{
+    live_counters_t *live = test_parameters->live;
+
+    if (NULL == live)
+        return;
+
+    LIVE_ADD(live->errors, 1);
+}
+
+/******************************************************************************
+* function:
+*     tests_flush_schedule (test_parameters_t* test_parameters,
+*                           unsigned long *chunks,
+*                           unsigned long *pending,
+*                           unsigned long len)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param chunks          [IN] - chunks fed since the last flush, updated
+* @param pending         [IN] - bytes fed since the last flush, updated
+* @param len             [IN] - length of the chunk about to be fed
+*
+* description:
+*   returns the flush value to pass to deflate with the next chunk under
+*   the flush schedule, the counts restart when it is a flush
+******************************************************************************/
+int tests_flush_schedule(test_parameters_t* test_parameters, unsigned long *chunks,
+                         unsigned long *pending, unsigned long len)
+{
+    (*chunks)++;
+    *pending += len;
+
+    if (test_parameters->flush_bytes ? *pending < test_parameters->flush_every :
+                                       *chunks < test_parameters->flush_every)
+        return Z_NO_FLUSH;
+
+    *chunks = 0;
+    *pending = 0;
+    return test_parameters->flush_policy;
+}
+
+/******************************************************************************
+* function:
+*     tests_window_bits (int streamtype, int wbits)
+*
+* @param streamtype [IN] - raw, zlib or gzip deflate stream
+* @param wbits      [IN] - base two logarithm of the window size (9..15)
+*
+* description:
+*   returns the windowBits value to pass to deflateInit2/inflateInit2 so the
+*   stream is produced/consumed with the requested wrapper
+******************************************************************************/
+int tests_window_bits(int streamtype, int wbits)
+{
+    switch (streamtype)
+    {
+        case RAW_DEFLATE_STREAM:
+            return -wbits;
+        case ZLIB_DEFLATE_STREAM:
+            return wbits;
+        case GZIP_DEFLATE_STREAM:
+            return wbits + 16;
+        default:
+            /* Default to gzip encoding */
+            return wbits + 16;
+    }
+}
+
+/******************************************************************************
+* function:
+*     tests_zalloc (voidpf opaque, uInt items, uInt size)
+*
+* @param opaque [IN] - zalloc_count_t the bytes are counted in
+* @param items  [IN] - number of items
+* @param size   [IN] - size of an item
+*
+* description:
+*   zalloc that counts the bytes zlib holds, the length is kept in front
+*   of the block for tests_zfree
+******************************************************************************/
+voidpf tests_zalloc(voidpf opaque, uInt items, uInt size)
+{
+    zalloc_count_t *count = (zalloc_count_t *)opaque;
+    size_t len = (size_t)items * size;
+    size_t *block = malloc(len + sizeof(size_t));
+
+    if (NULL == block)
+        return Z_NULL;
+    *block = len;
+    count->bytes += len;
+    if (count->bytes > count->peak)
+        count->peak = count->bytes;
+    return block + 1;
+}
+
+void tests_zfree(voidpf opaque, voidpf address)
+{
+    zalloc_count_t *count = (zalloc_count_t *)opaque;
+    size_t *block = (size_t *)address - 1;
+
+    count->bytes -= *block;
+    free(block);
+}
+
 
 int tests_startup(test_parameters_t* test_parameters)
 {
+    tests_verify_init(test_parameters);
+    if (TEST_PASSED != tests_sizes_init(test_parameters))
+        return TEST_FAILED;
+
     switch (test_parameters->type)
     {
         case TEST_CORPUS_COMPRESSION:
@@ -25,6 +712,45 @@ int tests_startup(test_parameters_t* test_parameters)
         case TEST_CORPUS_DECOMPRESSION:
             return tests_startup_corpus_decompression(test_parameters);
             break;
+        case TEST_CORPUS_DICTIONARY:
+            return tests_startup_corpus_dictionary(test_parameters);
+            break;
+        case TEST_CORPUS_AUTOTUNE:
+            return tests_startup_corpus_autotune(test_parameters);
+            break;
+        case TEST_CORPUS_CHECKSUM:
+            return tests_startup_corpus_checksum(test_parameters);
+            break;
+        case TEST_CORPUS_BGZF:
+            return tests_startup_corpus_bgzf(test_parameters);
+            break;
+        case TEST_CORPUS_ZRAN:
+            return tests_startup_corpus_zran(test_parameters);
+            break;
+        case TEST_CORPUS_MIXED:
+            return tests_startup_corpus_mixed(test_parameters);
+            break;
+        case TEST_CORPUS_FLUSH:
+            return tests_startup_corpus_flush(test_parameters);
+            break;
+        case TEST_CORPUS_BATCH:
+            return tests_startup_corpus_batch(test_parameters);
+            break;
+        case TEST_CORPUS_OFFLOAD:
+            return tests_startup_corpus_offload(test_parameters);
+            break;
+        case TEST_CORPUS_STREAMS:
+            return tests_startup_corpus_streams(test_parameters);
+            break;
+        case TEST_CORPUS_MEMORY:
+            return tests_startup_corpus_memory(test_parameters);
+            break;
+        case TEST_CORPUS_REPLAY:
+            return tests_startup_corpus_replay(test_parameters);
+            break;
+        case TEST_CORPUS_MESSAGES:
+            return tests_startup_corpus_messages(test_parameters);
+            break;
         default:
             fprintf(stderr, "Unknown test type %d\n", test_parameters->type);
             return TEST_FAILED;
@@ -32,6 +758,29 @@ int tests_startup(test_parameters_t* test_parameters)
     }
 }
 
+/******************************************************************************
+* function:
+*     tests_startup_process (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - parameters the worker process was forked with
+*
+* description:
+*   set up a -procs worker process after the fork. It inherits the buffers
+*   the startup of the parent left but not its threads, the crc32 helpers
+*   and BGZF block threads are started again for the worker.
+******************************************************************************/
+int tests_startup_process(test_parameters_t* test_parameters)
+{
+    test_parameters->crc_pool = NULL;
+    tests_verify_init(test_parameters);
+    if (TEST_CORPUS_BGZF == test_parameters->type) {
+        test_parameters->bgzf_pool = NULL;
+        if (TEST_PASSED != tests_bgzf_pool_start(test_parameters))
+            return TEST_FAILED;
+    }
+    return tests_sizes_init(test_parameters);
+}
+
 
 /******************************************************************************
 * function:
@@ -71,6 +820,45 @@ int tests_run(test_parameters_t* test_parameters)
         case TEST_CORPUS_DECOMPRESSION:
             rc=tests_run_corpus_decompression(test_parameters);
             break;
+        case TEST_CORPUS_DICTIONARY:
+            rc=tests_run_corpus_dictionary(test_parameters);
+            break;
+        case TEST_CORPUS_AUTOTUNE:
+            rc=tests_run_corpus_autotune(test_parameters);
+            break;
+        case TEST_CORPUS_CHECKSUM:
+            rc=tests_run_corpus_checksum(test_parameters);
+            break;
+        case TEST_CORPUS_BGZF:
+            rc=tests_run_corpus_bgzf(test_parameters);
+            break;
+        case TEST_CORPUS_ZRAN:
+            rc=tests_run_corpus_zran(test_parameters);
+            break;
+        case TEST_CORPUS_MIXED:
+            rc=tests_run_corpus_mixed(test_parameters);
+            break;
+        case TEST_CORPUS_FLUSH:
+            rc=tests_run_corpus_flush(test_parameters);
+            break;
+        case TEST_CORPUS_BATCH:
+            rc=tests_run_corpus_batch(test_parameters);
+            break;
+        case TEST_CORPUS_OFFLOAD:
+            rc=tests_run_corpus_offload(test_parameters);
+            break;
+        case TEST_CORPUS_STREAMS:
+            rc=tests_run_corpus_streams(test_parameters);
+            break;
+        case TEST_CORPUS_MEMORY:
+            rc=tests_run_corpus_memory(test_parameters);
+            break;
+        case TEST_CORPUS_REPLAY:
+            rc=tests_run_corpus_replay(test_parameters);
+            break;
+        case TEST_CORPUS_MESSAGES:
+            rc=tests_run_corpus_messages(test_parameters);
+            break;
         default:
             fprintf(stderr, "Unknown test type %d\n", test_parameters->type);
             rc=TEST_FAILED;
@@ -86,17 +874,63 @@ int tests_run(test_parameters_t* test_parameters)
 
 int tests_shutdown(test_parameters_t* test_parameters)
 {
+    int rc=TEST_FAILED;
+
     switch (test_parameters->type)
     {
         case TEST_CORPUS_COMPRESSION:
-            return tests_shutdown_corpus_compression(test_parameters);
+            rc=tests_shutdown_corpus_compression(test_parameters);
             break;
         case TEST_CORPUS_DECOMPRESSION:
-            return tests_shutdown_corpus_decompression(test_parameters);
+            rc=tests_shutdown_corpus_decompression(test_parameters);
+            break;
+        case TEST_CORPUS_DICTIONARY:
+            rc=tests_shutdown_corpus_dictionary(test_parameters);
+            break;
+        case TEST_CORPUS_AUTOTUNE:
+            rc=tests_shutdown_corpus_autotune(test_parameters);
+            break;
+        case TEST_CORPUS_CHECKSUM:
+            rc=tests_shutdown_corpus_checksum(test_parameters);
+            break;
+        case TEST_CORPUS_BGZF:
+            rc=tests_shutdown_corpus_bgzf(test_parameters);
+            break;
+        case TEST_CORPUS_ZRAN:
+            rc=tests_shutdown_corpus_zran(test_parameters);
+            break;
+        case TEST_CORPUS_MIXED:
+            rc=tests_shutdown_corpus_mixed(test_parameters);
+            break;
+        case TEST_CORPUS_FLUSH:
+            rc=tests_shutdown_corpus_flush(test_parameters);
+            break;
+        case TEST_CORPUS_BATCH:
+            rc=tests_shutdown_corpus_batch(test_parameters);
+            break;
+        case TEST_CORPUS_OFFLOAD:
+            rc=tests_shutdown_corpus_offload(test_parameters);
+            break;
+        case TEST_CORPUS_STREAMS:
+            rc=tests_shutdown_corpus_streams(test_parameters);
+            break;
+        case TEST_CORPUS_MEMORY:
+            rc=tests_shutdown_corpus_memory(test_parameters);
+            break;
+        case TEST_CORPUS_REPLAY:
+            rc=tests_shutdown_corpus_replay(test_parameters);
+            break;
+        case TEST_CORPUS_MESSAGES:
+            rc=tests_shutdown_corpus_messages(test_parameters);
             break;
         default:
             fprintf(stderr, "Unknown test type %d\n", test_parameters->type);
-            return TEST_FAILED;
+            rc=TEST_FAILED;
             break;
     }
+
+    tests_sizes_free(test_parameters);
+    if (TEST_PASSED != tests_verify_report(test_parameters))
+        rc=TEST_FAILED;
+    return rc;
 }
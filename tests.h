@@ -1,6 +1,9 @@
 #ifndef __TESTS_H
 #define __TESTS_H
 
+#include <time.h>
+#include <pthread.h>
+
 #include "test_parameters.h"
 
 static __inline__ unsigned long long rdtsc(void)
@@ -12,7 +15,449 @@ static __inline__ unsigned long long rdtsc(void)
     return (((unsigned long long)a) | (((unsigned long long)d) << 32));
 }
 
+/* Monotonic wall clock in nanoseconds, used for the timings taken inside
+   a test (as opposed to the whole run timing done in main.c) */
+static __inline__ unsigned long long tests_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/* CPU time of the calling thread in nanoseconds */
+static __inline__ unsigned long long tests_cpu_nsec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+    return ((unsigned long long)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/* Destination the bounded output buffer (-outbuf) is drained to */
+typedef struct
+{
+    int type;
+    int fd;
+    int pipe_fd[2];
+    int seekable;
+    long offset;
+    long length;
+    unsigned char *ring;
+    unsigned long ring_size;
+    unsigned long ring_pos;
+    unsigned char *stage;
+    unsigned long stage_len;
+    unsigned long long bytes;
+    unsigned long drains;
+    unsigned long long cycles;
+}
+output_sink_t;
+
+int tests_sink_open (output_sink_t *sink, test_parameters_t* test_parameters,
+                     unsigned long expected);
+void tests_sink_rewind (output_sink_t *sink);
+int tests_sink_drain (output_sink_t *sink, const unsigned char *buf, unsigned long len);
+void tests_sink_close (output_sink_t *sink);
+void tests_sink_report (test_parameters_t* test_parameters, output_sink_t *sink,
+                        const char *call, unsigned long calls,
+                        unsigned long long total_cycles);
+
+/* Latency histogram: log-linear buckets, HIST_SUB_BUCKETS per power of two,
+   good for values up to 2^(HIST_BUCKETS / HIST_SUB_BUCKETS) */
+#define HIST_SUB_BITS           3
+#define HIST_SUB_BUCKETS        (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS            (64 * HIST_SUB_BUCKETS)
+
+typedef struct
+{
+    unsigned long long count;
+    unsigned long long sum;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long buckets[HIST_BUCKETS];
+}
+histogram_t;
+
+void tests_histogram_init (histogram_t *histogram);
+void tests_histogram_add (histogram_t *histogram, unsigned long long value);
+void tests_histogram_merge (histogram_t *histogram, const histogram_t *other);
+unsigned long long tests_histogram_percentile (const histogram_t *histogram,
+                                               double percentile);
+
+/* Live counters of one worker for the metrics endpoint (-metrics). Only
+   the worker writes them and the metrics thread reads them while the test
+   runs, both with relaxed atomic accesses so neither side takes a lock.
+   The latency buckets are one per power of two nanoseconds. */
+#define LIVE_BUCKETS            64
+
+typedef struct live_counters
+{
+    const char *test;
+    unsigned long long ops;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long errors;
+    unsigned long long latency_sum;
+    unsigned long long cpu_nsec;
+    unsigned long long latency[LIVE_BUCKETS];
+}
+__attribute__((aligned(64))) live_counters_t;
+
+void tests_live_op (test_parameters_t* test_parameters, unsigned long bytes_in,
+                    unsigned long bytes_out, unsigned long long nsec);
+void tests_live_error (test_parameters_t* test_parameters);
+
+/* Timeline trace (-trace): every worker records spans of time into a ring
+   of its own, mapped and faulted in before the run. Recording a span is
+   two rdtsc reads and three stores, when the ring is full the oldest
+   spans are overwritten. The rings are written out in the Chrome trace
+   event format after the run. */
+#define TRACE_RING_EVENTS       (1 << 16)
+
+typedef struct
+{
+    const char *name;
+    unsigned long long start;
+    unsigned long long end;
+}
+trace_event_t;
+
+typedef struct trace_ring
+{
+    trace_event_t *events;
+    unsigned long long next;
+}
+trace_ring_t;
+
+static __inline__ unsigned long long tests_trace_start(trace_ring_t *ring)
+{
+    return ring ? rdtsc() : 0;
+}
+
+static __inline__ void tests_trace_stop(trace_ring_t *ring, const char *name,
+                                        unsigned long long start)
+{
+    trace_event_t *event;
+
+    if (!ring)
+        return;
+
+    event = &ring->events[ring->next++ & (TRACE_RING_EVENTS - 1)];
+    event->name = name;
+    event->start = start;
+    event->end = rdtsc();
+}
+
+trace_ring_t *tests_trace_open (int workers);
+int tests_trace_dump (const char *path, trace_ring_t *rings, int workers, int processes);
+
+/* Phases of a run as seen by the metrics endpoint */
+#define METRICS_PHASE_STARTUP   0
+#define METRICS_PHASE_READY     1
+#define METRICS_PHASE_RUNNING   2
+#define METRICS_PHASE_SHUTDOWN  3
+#define METRICS_PHASE_DONE      4
+
+/* Metrics endpoint serving the live counters of the workers in the
+   Prometheus text format, on a localhost TCP port or a Unix socket */
+typedef struct
+{
+    live_counters_t *live;
+    int workers;
+    int phase;
+    int stop;
+    int fd;
+    char *endpoint;
+    pthread_t th;
+}
+metrics_server_t;
+
+int tests_metrics_start (metrics_server_t *metrics);
+void tests_metrics_phase (metrics_server_t *metrics, int phase);
+void tests_metrics_stop (metrics_server_t *metrics);
+
+/* Frequency of one core over a run: the clock sampled from cpufreq (or
+   /proc/cpuinfo), the busy clock from the APERF/MPERF counters and the
+   thermal throttle events, the counters left at zero and the throttle
+   count at FREQ_THROTTLE_UNKNOWN where they can not be read */
+#define FREQ_THROTTLE_UNKNOWN   (~0ULL)
+
+typedef struct
+{
+    unsigned long long khz_sum;
+    unsigned long khz_min;
+    unsigned long khz_max;
+    unsigned long samples;
+    int aperf_fd;
+    int mperf_fd;
+    unsigned long long aperf;
+    unsigned long long mperf;
+    unsigned long long throttle;
+}
+freq_core_t;
+
+/* CPU frequency monitor (-freq): a thread sampling the clock of every core
+   at an interval while the workers run */
+typedef struct
+{
+    freq_core_t *core;
+    int cores;
+    int interval_msec;
+    int stop;
+    int running;
+    const char *source;
+    unsigned long long tsc_start;
+    unsigned long long nsec_start;
+    double tsc_ghz;
+    pthread_t th;
+}
+freq_monitor_t;
+
+int tests_freq_start (freq_monitor_t *monitor, int interval_msec);
+void tests_freq_stop (freq_monitor_t *monitor);
+int tests_freq_summary (freq_monitor_t *monitor, const unsigned char *cores,
+                        double *avg_ghz, double *min_ghz);
+void tests_freq_report (freq_monitor_t *monitor, const unsigned char *cores);
+
+/* crc32 of buf computed in slices by the helper threads of a worker and
+   merged with crc32_combine, the calling thread computes the first slice
+   itself. The helpers are started once, before the worker runs. */
+int tests_crc_pool_start (test_parameters_t* test_parameters);
+unsigned long tests_crc32_pool (struct crc_pool *pool, const unsigned char *buf,
+                                unsigned long len, int slices,
+                                unsigned long long *helper_nsec);
+
+/* Sampled verification (-v, -vi): a worker verifies one iteration out of
+   every verify_interval at a random phase. The checks run between the
+   timed calls, the wall time they take is reported in verify_nsec and the
+   CPU time in verify_cpu_nsec (the worker) and verify_helper_nsec (its crc32
+   helpers) so all of it can be taken out of the figures of the run. The
+   helpers are started with the worker, none is created while it runs. */
+typedef struct
+{
+    unsigned long long nsec;
+    unsigned long long cpu_nsec;
+}
+verify_span_t;
+
+static __inline__ void tests_verify_start(verify_span_t *span)
+{
+    span->nsec = tests_nsec();
+    span->cpu_nsec = tests_cpu_nsec();
+}
+
+static __inline__ void tests_verify_stop(test_parameters_t* test_parameters,
+                                         verify_span_t *span)
+{
+    test_parameters->verify_cpu_nsec += tests_cpu_nsec() - span->cpu_nsec;
+    test_parameters->verify_nsec += tests_nsec() - span->nsec;
+}
+
+void tests_verify_init (test_parameters_t* test_parameters);
+int tests_verify_due (test_parameters_t* test_parameters, int iteration);
+unsigned char *tests_verify_buffer (test_parameters_t* test_parameters);
+int tests_verify_data (test_parameters_t* test_parameters,
+                       const unsigned char *data, unsigned long len);
+int tests_verify_stream (test_parameters_t* test_parameters,
+                         const unsigned char *stream, unsigned long len);
+int tests_verify_report (test_parameters_t* test_parameters);
+
+/* Early stop (SIGINT/SIGTERM): workers finish the iteration they are in
+   and leave their loop, the run is reported over the iterations done */
+int tests_stop_init (void);
+void tests_stop_request (void);
+int tests_stop_requested (void);
+int tests_running (test_parameters_t* test_parameters, int iteration);
+
+/* Sleep until an iteration is due when the worker has a target rate */
+void tests_pace (test_parameters_t* test_parameters, int iteration,
+                 unsigned long long start);
+
+/* Flush schedule (-flush): deflate is called with flush_policy every
+   flush_every chunks, or once flush_every bytes have gone in since the
+   last flush when flush_bytes is set, and with Z_NO_FLUSH in between */
+#define FLUSH_POLICY_OFF        -1
+/* Output room allowed for the markers of one flush */
+#define FLUSH_MARKER_ROOM       16
+
+int tests_flush_schedule (test_parameters_t* test_parameters, unsigned long *chunks,
+                          unsigned long *pending, unsigned long len);
+
+/* Software offload device (-offload), a stand-in for an accelerator:
+   engine threads take deflate requests off one submission list, compress
+   each as a stream of its own and complete it on the queue of the worker
+   that submitted it. The workers submit and poll without waiting for a
+   request to be served. */
+typedef struct offload_request
+{
+    const unsigned char *in;
+    unsigned long in_len;
+    unsigned char *out;
+    unsigned long out_room;
+    unsigned long out_len;
+    int level;
+    int window_bits;
+    int mem_level;
+    int strategy;
+    int status;
+    unsigned long tag;
+    unsigned long long submit_nsec;
+    unsigned long long start_nsec;
+    unsigned long long done_nsec;
+    struct offload_queue *queue;
+    struct offload_request *next;
+}
+offload_request_t;
+
+typedef struct offload_device
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    offload_request_t *head;
+    offload_request_t *tail;
+    int engines;
+    int stop;
+    unsigned long long open_nsec;
+    struct offload_engine *engine;
+}
+offload_device_t;
+
+/* Completions of one worker, not yet polled */
+typedef struct offload_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    offload_request_t *head;
+    offload_request_t *tail;
+    offload_device_t *device;
+}
+offload_queue_t;
+
+int tests_offload_open (offload_device_t *device, int engines);
+void tests_offload_close (offload_device_t *device);
+void tests_offload_queue_init (offload_queue_t *queue, offload_device_t *device);
+void tests_offload_queue_destroy (offload_queue_t *queue);
+int tests_offload_submit (offload_queue_t *queue, offload_request_t **requests, int n);
+int tests_offload_poll (offload_queue_t *queue, offload_request_t **done, int max, int wait);
+
+/* Inflate engine of the decompression test (-engine): the inflate() state
+   machine or inflateBack with callbacks over the test buffers */
+#define INFLATE_ENGINE_INFLATE  0
+#define INFLATE_ENGINE_BACK     1
+
+int tests_inflate_back (z_stream *strm, unsigned char *window,
+                        const unsigned char *in, unsigned long in_len,
+                        int streamtype, unsigned long chunk,
+                        unsigned char *out, unsigned long out_len);
+int tests_inflate_back_compare (test_parameters_t* test_parameters);
+
+/* Memory zlib asks for through zalloc, with tests_zalloc/tests_zfree as
+   the allocators of a stream and a zalloc_count_t as its opaque. Streams
+   may share a count, peak is then the most they held at once. */
+typedef struct
+{
+    unsigned long long bytes;
+    unsigned long long peak;
+}
+zalloc_count_t;
+
+voidpf tests_zalloc (voidpf opaque, uInt items, uInt size);
+void tests_zfree (voidpf opaque, voidpf address);
+
+static __inline__ void tests_zalloc_use(z_stream *strm, zalloc_count_t *count)
+{
+    strm->zalloc = tests_zalloc;
+    strm->zfree = tests_zfree;
+    strm->opaque = count;
+}
+
+/* Recorded traffic (-replay): the operations of a capture with their
+   message size, level and stream type, at the times they were seen */
+#define REPLAY_DEFLATE          0
+#define REPLAY_INFLATE          1
+
+typedef struct
+{
+    unsigned long long usec;
+    unsigned long size;
+    int op;
+    int level;
+    int stream;
+}
+replay_record_t;
+
+typedef struct replay_trace
+{
+    replay_record_t *records;
+    int count;
+    int paced;
+    unsigned long long span_usec;
+    unsigned long max_size;
+    /* streams the inflate records read, compressed by the first worker
+       to start up and read by all of them */
+    unsigned char *streams;
+}
+replay_trace_t;
+
+int tests_replay_load (const char *path, replay_trace_t *trace);
+void tests_replay_free (replay_trace_t *trace);
+
+/* Chunk and message size distribution (-k): every worker draws SIZES_COUNT
+   sizes from it before the start barrier and cycles through them as it
+   runs, the per size reports group the sizes in powers of two */
+#define SIZE_DIST_FIXED         0
+#define SIZE_DIST_UNIFORM       1
+#define SIZE_DIST_LOGNORMAL     2
+#define SIZE_DIST_ZIPF          3
+#define SIZE_DIST_BIMODAL       4
+#define SIZE_DIST_MAX           SIZE_DIST_BIMODAL
+
+#define SIZES_COUNT             16384
+#define SIZES_MAX               (1UL << 24)
+#define SIZES_BUCKETS           25
+
+typedef struct size_dist
+{
+    int kind;
+    unsigned long min;
+    unsigned long max;
+    unsigned long a;
+    unsigned long b;
+    int pct;
+    double sigma;
+    double s;
+    unsigned int seed;
+}
+size_dist_t;
+
+int tests_sizes_parse (const char *spec, size_dist_t *dist);
+void tests_sizes_describe (const size_dist_t *dist, char *text, int len);
+int tests_sizes_init (test_parameters_t* test_parameters);
+void tests_sizes_free (test_parameters_t* test_parameters);
+
+/* Size of the next chunk or message a worker feeds zlib */
+static __inline__ unsigned long tests_sizes_next(test_parameters_t* test_parameters)
+{
+    if (NULL == test_parameters->sizes)
+        return test_parameters->chunksize;
+    return test_parameters->sizes[test_parameters->sizes_next++ & (SIZES_COUNT - 1)];
+}
+
+/* Power of two bucket of a size, bucket b holds 2^b to 2^(b+1)-1 bytes */
+static __inline__ int tests_sizes_bucket(unsigned long size)
+{
+    return 63 - __builtin_clzll(size | 1);
+}
+
+/* Map a stream type onto the windowBits argument expected by deflateInit2
+   and inflateInit2 for a window of 2^wbits bytes. */
+int tests_window_bits (int streamtype, int wbits);
+
 int tests_startup (test_parameters_t* test_parameters);
+int tests_startup_process (test_parameters_t* test_parameters);
 int tests_run (test_parameters_t* test_parameters);
 int tests_shutdown (test_parameters_t* test_parameters);
 
@@ -48,12 +493,214 @@ int tests_run_corpus_decompression (test_parameters_t* test_parameters);
 int tests_shutdown_corpus_decompression (test_parameters_t* test_parameters);
 
 
+/* This function will read in the files to a memory buffer and train a
+   preset dictionary of frequent substrings from a sample of them */
+int tests_startup_corpus_dictionary (test_parameters_t* test_parameters);
+
+/* This function runs the preset dictionary test. It slices the buffer into
+   small messages of several sizes and compresses/decompresses each message
+   as an independent stream, once with and once without the dictionary */
+int tests_run_corpus_dictionary (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the dictionary test. */
+int tests_shutdown_corpus_dictionary (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer ready for
+   the auto-tune test */
+int tests_startup_corpus_autotune (test_parameters_t* test_parameters);
+
+/* This function searches level, memLevel, windowBits, strategy and chunk
+   size for the settings on the throughput/ratio Pareto frontier of the
+   corpus, pruning dominated settings early, and prints a recommendation
+   for the throughput floor or ratio target in the test_parameters */
+int tests_run_corpus_autotune (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the auto-tune test. */
+int tests_shutdown_corpus_autotune (test_parameters_t* test_parameters);
+
+
+/* This function will read the files into a buffer of the largest checksum
+   size, repeating the corpus as needed */
+int tests_startup_corpus_checksum (test_parameters_t* test_parameters);
+
+/* This function benchmarks crc32, adler32, crc32_combine, adler32_combine
+   and a parallel crc32 over buffer sizes from 64 bytes to 64 MB */
+int tests_run_corpus_checksum (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the checksum test. */
+int tests_shutdown_corpus_checksum (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer and compress
+   them once as a single gzip stream to compare the block format against */
+int tests_startup_corpus_bgzf (test_parameters_t* test_parameters);
+
+/* This function compresses the buffer into independent BGZF gzip members
+   of a fixed uncompressed size in parallel, packs them into one object and
+   builds the .gzi index of member offsets */
+int tests_run_corpus_bgzf (test_parameters_t* test_parameters);
+
+/* This function will write the object and its index when asked to and
+   cleanup up the memory allocation of buffers after the BGZF test. */
+int tests_shutdown_corpus_bgzf (test_parameters_t* test_parameters);
+
+/* This function starts the block threads of a BGZF worker, done by its
+   startup and again by a -procs worker process */
+int tests_bgzf_pool_start (test_parameters_t* test_parameters);
+
+
+/* This function will read in and compress the files like the decompression
+   test, then inflate the result once recording an access point, the bit
+   offset and 32K window, at the first block boundary every 128K */
+int tests_startup_corpus_zran (test_parameters_t* test_parameters);
+
+/* This function serves random reads of chunk size bytes by restarting
+   inflate at the closest access point, for several checkpoint spacings,
+   and reports the read latency percentiles of each spacing */
+int tests_run_corpus_zran (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers and of
+   the index after the random access test. */
+int tests_shutdown_corpus_zran (test_parameters_t* test_parameters);
+
+
+/* This function will read in and compress the files like the decompression
+   test and allocate the buffer the deflate operations write to */
+int tests_startup_corpus_mixed (test_parameters_t* test_parameters);
+
+/* This function runs deflate and inflate operations over the corpus mixed
+   in the -mix ratio, drawn at random per operation or per thread with
+   -mixthreads, and reports the throughput and latency of each type */
+int tests_run_corpus_mixed (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the mixed test. */
+int tests_shutdown_corpus_mixed (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer and allocate
+   an output buffer with room for the flush markers */
+int tests_startup_corpus_flush (test_parameters_t* test_parameters);
+
+/* This function compresses the corpus under every flush policy at the
+   -flush interval and reports the ratio and throughput lost against no
+   flushing and the latency of the deflate calls that flush */
+int tests_run_corpus_flush (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the flush policy test. */
+int tests_shutdown_corpus_flush (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer and allocate
+   an output buffer for a batch of -batch records */
+int tests_startup_corpus_batch (test_parameters_t* test_parameters);
+
+/* This function compresses batches of small records sliced from the corpus
+   with a stream per record, a stream per batch with full flushes between
+   the records and a reused stream reset between records, and reports the
+   records/s, throughput and ratio of each */
+int tests_run_corpus_batch (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the record batch test. */
+int tests_shutdown_corpus_batch (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer and allocate
+   an output slot for every -k chunk of it */
+int tests_startup_corpus_offload (test_parameters_t* test_parameters);
+
+/* This function compresses the corpus through the offload device, a
+   request per chunk with up to -offload depth requests in flight, and
+   reports the submit and poll overheads and the request latency */
+int tests_run_corpus_offload (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the offload test. */
+int tests_shutdown_corpus_offload (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer */
+int tests_startup_corpus_streams (test_parameters_t* test_parameters);
+
+/* This function deflates sets of -streams live streams per thread, fed
+   from different offsets of the corpus a chunk at a time in turn, and
+   reports the throughput, the cache misses and the memory in zlib state
+   of each set size */
+int tests_run_corpus_streams (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the concurrent streams test. */
+int tests_shutdown_corpus_streams (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer and allocate
+   a buffer to inflate it back into */
+int tests_startup_corpus_memory (test_parameters_t* test_parameters);
+
+/* This function deflates and inflates the corpus at every windowBits from
+   9 to 15 and memLevel from 1 to 9 and reports the zlib state bytes per
+   stream, the ratio and the throughput of each */
+int tests_run_corpus_memory (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the memory profile test. */
+int tests_shutdown_corpus_memory (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer and, for the
+   first worker, compress the corpus slices the inflate records of the
+   -replay trace take */
+int tests_startup_corpus_replay (test_parameters_t* test_parameters);
+
+/* This function replays this worker's share of the -replay trace against
+   slices of the corpus, as fast as it can or at the recorded times, and
+   reports the throughput and latency of the deflate and inflate records */
+int tests_run_corpus_replay (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the traffic replay test. */
+int tests_shutdown_corpus_replay (test_parameters_t* test_parameters);
+
+
+/* This function will read in the files to a memory buffer and allocate
+   room for the largest message of the -k distribution */
+int tests_startup_corpus_messages (test_parameters_t* test_parameters);
+
+/* This function compresses and decompresses messages sliced from the
+   corpus with sizes drawn from the -k distribution, each one a stream of
+   its own, and reports the throughput and latency per message size */
+int tests_run_corpus_messages (test_parameters_t* test_parameters);
+
+/* This function will cleanup up the memory allocation of buffers after
+   the message size test. */
+int tests_shutdown_corpus_messages (test_parameters_t* test_parameters);
+
+
 /* Defines for zlib corner tests maximum length for stateless operation */
 #define DEFLATE_LENGTH          108544
 
 #define TEST_CORPUS_COMPRESSION               1 
 #define TEST_CORPUS_DECOMPRESSION             2
-#define TEST_TYPE_MAX           TEST_CORPUS_DECOMPRESSION
+#define TEST_CORPUS_DICTIONARY                3
+#define TEST_CORPUS_AUTOTUNE                  4
+#define TEST_CORPUS_CHECKSUM                  5
+#define TEST_CORPUS_BGZF                      6
+#define TEST_CORPUS_ZRAN                      7
+#define TEST_CORPUS_MIXED                     8
+#define TEST_CORPUS_FLUSH                     9
+#define TEST_CORPUS_BATCH                    10
+#define TEST_CORPUS_OFFLOAD                  11
+#define TEST_CORPUS_STREAMS                  12
+#define TEST_CORPUS_MEMORY                   13
+#define TEST_CORPUS_REPLAY                   14
+#define TEST_CORPUS_MESSAGES                 15
+#define TEST_TYPE_MAX           TEST_CORPUS_MESSAGES
 #define CUSTOM_FILE                           0       
 #define CANTERBURY_CORPUS                     1
 #define CALGARY_CORPUS                        2
@@ -63,9 +710,18 @@ int tests_shutdown_corpus_decompression (test_parameters_t* test_parameters);
 #define ZLIB_DEFLATE_STREAM                   1
 #define GZIP_DEFLATE_STREAM                   2
 #define STREAMTYPE_MAX          GZIP_DEFLATE_STREAM
+#define SINK_DISCARD                          0
+#define SINK_RING                             1
+#define SINK_FILE                             2
+#define SINK_PWRITEV                          3
+#define SINK_SPLICE                           4
+#define SINK_DIRECT                           5
+#define SINK_MAX                SINK_DIRECT
 #define WINDOW_SIZE_8K                        5
 #define WINDOW_SIZE_16K                       6
 #define WINDOW_SIZE_32K                       7
+/* windowBits for one of the WINDOW_SIZE values above, 2^13 is 8K */
+#define WINDOW_SIZE_TO_WBITS(size)  ((size) + 8)
 #define TEST_PASSED                           0
 #define TEST_FAILED                           1
 #define DEBUG(...) 
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* Settings are first compared on a sample from the start of the corpus */
+#define AUTOTUNE_SAMPLE_BYTES   (512 * 1024)
+/* The probe is the first part of the sample, a setting whose probe is
+   clearly dominated is stopped before the rest of the sample is measured */
+#define AUTOTUNE_PROBE_DIVISOR  4
+/* Throughput margin for a probe to be considered clearly dominated */
+#define AUTOTUNE_EARLY_STOP     0.25
+/* Throughput margin allowed for timing noise on the sample */
+#define AUTOTUNE_SLACK          0.05
+
+#define AUTOTUNE_STOPPED        0
+#define AUTOTUNE_SAMPLED        1
+#define AUTOTUNE_MEASURED       2
+
+static const int autotune_mem_levels[] = { 1, 4, 8, 9 };
+static const int autotune_windows[] = { WINDOW_SIZE_8K, WINDOW_SIZE_16K, WINDOW_SIZE_32K };
+static const int autotune_strategies[] = { Z_DEFAULT_STRATEGY, Z_FILTERED, Z_HUFFMAN_ONLY, Z_RLE };
+static const int autotune_chunk_sizes[] = { 4096, 65536, 1048576 };
+
+#define ARRAY_SIZE(a) (sizeof(a)/sizeof((a)[0]))
+
+typedef struct
+{
+    int level;
+    int mem_level;
+    int window_bits;
+    int strategy;
+    int chunksize;
+    int state;
+    /* figures on the sample, the settings are pruned on these only */
+    float sample_mbps;
+    float sample_ratio;
+    /* figures on the corpus, once the setting is measured */
+    float mbps;
+    float ratio;
+}
+autotune_setting_t;
+
+
+/******************************************************************************
+* function:
+*     autotune_compress (test_parameters_t* test_parameters,
+*                        autotune_setting_t *setting,
+*                        unsigned long len,
+*                        float *mbps,
+*                        float *ratio)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+* @param setting         [IN] - deflate setting to measure
+* @param len             [IN] - number of bytes from the start of the corpus to compress
+* @param mbps            [OUT] - throughput of the compression
+* @param ratio           [OUT] - compressed size over uncompressed size
+*
+* description:
+*   compress the start of the corpus the way run_corpus_compression does,
+*   including stream setup and teardown, with the given setting
+******************************************************************************/
+static int
+autotune_compress(test_parameters_t* test_parameters, autotune_setting_t *setting,
+                  unsigned long len, float *mbps, float *ratio)
+{
+    z_stream strm;
+    int ret = 0;
+    int flush = Z_NO_FLUSH;
+    unsigned long long start = 0, elapsed = 0;
+
+    start = tests_nsec();
+
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.next_out = (void *)test_parameters->output_buf;
+    strm.avail_out = test_parameters->output_buflen;
+
+    ret = deflateInit2(&strm, setting->level, 8,
+                       tests_window_bits(test_parameters->streamtype, setting->window_bits),
+                       setting->mem_level, setting->strategy);
+    if (ret != Z_OK) {
+        fprintf(stderr, "# FAIL: deflateInit2 failed, ret:%d\n", ret);
+        return TEST_FAILED;
+    }
+
+    do {
+        strm.next_in = (void *)test_parameters->input_buf + strm.total_in;
+        if (strm.total_in + setting->chunksize >= len) {
+            strm.avail_in = len - strm.total_in;
+            flush = Z_FINISH;
+        }
+        else {
+            strm.avail_in = setting->chunksize;
+        }
+        ret = deflate(&strm, flush);
+        strm.avail_out = test_parameters->output_buflen - strm.total_out;
+    } while (ret == Z_OK);
+
+    if (ret != Z_STREAM_END) {
+        printf("# FAIL: deflate stream corrupt, ret:%d \r\n", ret);
+        deflateEnd(&strm);
+        return TEST_FAILED;
+    }
+
+    *ratio = (float)strm.total_out / strm.total_in;
+    deflateEnd(&strm);
+
+    elapsed = tests_nsec() - start;
+    *mbps = (float)((double)len * 8 * 1000 / (elapsed + 1));
+
+    return TEST_PASSED;
+}
+
+/* Returns 1 if a is at least as good a ratio as b and faster than b by the
+   given margin. Ratio is output over input so lower is better. */
+static int
+autotune_dominates(float mbps_a, float ratio_a, float mbps_b, float ratio_b, float margin)
+{
+    return (ratio_a <= ratio_b) && (mbps_a >= mbps_b * (1 + margin));
+}
+
+static int
+autotune_frontier_compare(const void *a, const void *b)
+{
+    const autotune_setting_t *sa = *(const autotune_setting_t **)a;
+    const autotune_setting_t *sb = *(const autotune_setting_t **)b;
+
+    if (sa->mbps == sb->mbps)
+        return 0;
+    return (sa->mbps > sb->mbps) ? -1 : 1;
+}
+
+static void
+autotune_print_setting(autotune_setting_t *s)
+{
+    printf("%10.2f %8.3f %6d %9d %11d %9d %9d    -l %d -ml %d -wb %d -st %d -k %d\n",
+           s->mbps, s->ratio, s->level, s->mem_level, s->window_bits,
+           s->strategy, s->chunksize,
+           s->level, s->mem_level, s->window_bits, s->strategy, s->chunksize);
+}
+
+
+
+int
+startup_corpus_autotune(test_parameters_t* test_parameters)
+{
+    return tests_startup_corpus_compression(test_parameters);
+}
+
+
+
+int
+run_corpus_autotune(test_parameters_t* test_parameters)
+{
+    autotune_setting_t *settings = NULL;
+    autotune_setting_t **frontier = NULL;
+    autotune_setting_t *s = NULL;
+    autotune_setting_t *best = NULL;
+    unsigned int numSettings = 0, numFrontier = 0;
+    unsigned int numStopped = 0, numMeasured = 0;
+    unsigned int l, m, w, st, c, i, j;
+    unsigned long sampleLen = 0, probeLen = 0;
+    unsigned long long totalBytes = 0;
+    float mbps = 0, ratio = 0;
+    float *probe_mbps = NULL;
+    float *probe_ratio = NULL;
+    int failed = TEST_PASSED;
+    int r = 0;
+
+    sampleLen = test_parameters->input_buflen;
+    if (sampleLen > AUTOTUNE_SAMPLE_BYTES)
+        sampleLen = AUTOTUNE_SAMPLE_BYTES;
+    probeLen = sampleLen / AUTOTUNE_PROBE_DIVISOR;
+
+    i = 9 * ARRAY_SIZE(autotune_mem_levels) * ARRAY_SIZE(autotune_windows) *
+        ARRAY_SIZE(autotune_strategies) * ARRAY_SIZE(autotune_chunk_sizes);
+    settings = calloc(i, sizeof(autotune_setting_t));
+    frontier = calloc(i, sizeof(autotune_setting_t *));
+    probe_mbps = calloc(i, sizeof(float));
+    probe_ratio = calloc(i, sizeof(float));
+    if (NULL == settings || NULL == frontier || NULL == probe_mbps || NULL == probe_ratio) {
+        fprintf(stderr, "# FAIL: Could not allocate space for auto-tune settings.\n");
+        failed = TEST_FAILED;
+        goto cleanup;
+    }
+
+    /* Build the search space. Huffman only and RLE do not use the level,
+       the hash chains or (for huffman only) the window, so they are only
+       tried once per chunk size. */
+    for (st = 0; st < ARRAY_SIZE(autotune_strategies); st++) {
+        for (c = 0; c < ARRAY_SIZE(autotune_chunk_sizes); c++) {
+            for (l = 1; l <= 9; l++) {
+                for (m = 0; m < ARRAY_SIZE(autotune_mem_levels); m++) {
+                    for (w = 0; w < ARRAY_SIZE(autotune_windows); w++) {
+                        int single = (autotune_strategies[st] == Z_HUFFMAN_ONLY ||
+                                      autotune_strategies[st] == Z_RLE);
+
+                        if (single && (l != 1 || m != 0 || w != 0))
+                            continue;
+
+                        s = &settings[numSettings++];
+                        s->level = single ? 6 : l;
+                        s->mem_level = single ? 8 : autotune_mem_levels[m];
+                        s->window_bits = single ? MAX_WBITS : WINDOW_SIZE_TO_WBITS(autotune_windows[w]);
+                        s->strategy = autotune_strategies[st];
+                        s->chunksize = autotune_chunk_sizes[c];
+                    }
+                }
+            }
+        }
+    }
+
+    /* Probe every setting and stop the ones that are clearly beaten by a
+       setting probed before them, the rest is measured on the full sample */
+    for (i = 0; i < numSettings && TEST_PASSED == failed; i++) {
+        s = &settings[i];
+        failed = autotune_compress(test_parameters, s, probeLen, &probe_mbps[i], &probe_ratio[i]);
+        totalBytes += probeLen;
+        if (TEST_PASSED != failed)
+            break;
+
+        s->state = AUTOTUNE_SAMPLED;
+        for (j = 0; j < i; j++) {
+            if (autotune_dominates(probe_mbps[j], probe_ratio[j],
+                                   probe_mbps[i], probe_ratio[i], AUTOTUNE_EARLY_STOP)) {
+                s->state = AUTOTUNE_STOPPED;
+                numStopped++;
+                break;
+            }
+        }
+        if (AUTOTUNE_SAMPLED == s->state) {
+            failed = autotune_compress(test_parameters, s, sampleLen,
+                                       &s->sample_mbps, &s->sample_ratio);
+            totalBytes += sampleLen;
+        }
+    }
+
+    /* Settings not dominated on the sample are measured on the corpus,
+       taking the best of count runs. Whether a setting is dominated is
+       decided on the sample figures of both, the corpus figures of the
+       settings measured before it are not comparable. */
+    for (i = 0; i < numSettings && TEST_PASSED == failed; i++) {
+        s = &settings[i];
+        if (AUTOTUNE_SAMPLED != s->state)
+            continue;
+
+        for (j = 0; j < numSettings; j++) {
+            if (j != i && AUTOTUNE_SAMPLED <= settings[j].state &&
+                autotune_dominates(settings[j].sample_mbps, settings[j].sample_ratio,
+                                   s->sample_mbps, s->sample_ratio, AUTOTUNE_SLACK))
+                break;
+        }
+        if (j < numSettings)
+            continue;
+
+        s->mbps = 0;
+        for (r = 0; r < test_parameters->count && TEST_PASSED == failed; r++) {
+            failed = autotune_compress(test_parameters, s, test_parameters->input_buflen,
+                                       &mbps, &ratio);
+            totalBytes += test_parameters->input_buflen;
+            if (mbps > s->mbps)
+                s->mbps = mbps;
+            s->ratio = ratio;
+        }
+        s->state = AUTOTUNE_MEASURED;
+        numMeasured++;
+    }
+
+    if (TEST_PASSED != failed)
+        goto cleanup;
+
+    /* Keep the measured settings no other measured setting beats */
+    for (i = 0; i < numSettings; i++) {
+        s = &settings[i];
+        if (AUTOTUNE_MEASURED != s->state)
+            continue;
+
+        for (j = 0; j < numSettings; j++) {
+            autotune_setting_t *o = &settings[j];
+
+            if (j == i || AUTOTUNE_MEASURED != o->state)
+                continue;
+            if (o->ratio <= s->ratio && o->mbps >= s->mbps &&
+                (o->ratio < s->ratio || o->mbps > s->mbps))
+                break;
+        }
+        if (j == numSettings)
+            frontier[numFrontier++] = s;
+    }
+    qsort(frontier, numFrontier, sizeof(autotune_setting_t *), autotune_frontier_compare);
+
+    flockfile(stdout);
+    printf("\nThread %d auto-tune: %u settings, %u stopped early, %u pruned on the sample, "
+           "%u measured on the corpus\n",
+           test_parameters->id, numSettings, numStopped,
+           numSettings - numStopped - numMeasured, numMeasured);
+    printf("\nPareto frontier:\n");
+    printf("%10s %8s %6s %9s %11s %9s %9s    %s\n",
+           "Mbps", "Ratio", "Level", "MemLevel", "WindowBits", "Strategy", "Chunk", "Options");
+    for (i = 0; i < numFrontier; i++)
+        autotune_print_setting(frontier[i]);
+
+    if (test_parameters->target_mbps > 0) {
+        best = NULL;
+        for (i = 0; i < numFrontier; i++) {
+            if (frontier[i]->mbps >= test_parameters->target_mbps &&
+                (NULL == best || frontier[i]->ratio < best->ratio))
+                best = frontier[i];
+        }
+        printf("\nBest ratio at or above %.2f Mbps:\n", test_parameters->target_mbps);
+        if (best)
+            autotune_print_setting(best);
+        else
+            printf("    no setting reaches the throughput floor\n");
+    }
+    if (test_parameters->target_ratio > 0) {
+        best = NULL;
+        for (i = 0; i < numFrontier; i++) {
+            if (frontier[i]->ratio <= test_parameters->target_ratio &&
+                (NULL == best || frontier[i]->mbps > best->mbps))
+                best = frontier[i];
+        }
+        printf("\nFastest setting at or below ratio %.3f:\n", test_parameters->target_ratio);
+        if (best)
+            autotune_print_setting(best);
+        else
+            printf("    no setting reaches the ratio target\n");
+    }
+    funlockfile(stdout);
+
+    if (numFrontier > 0)
+        test_parameters->ratio = frontier[numFrontier - 1]->ratio;
+    test_parameters->single_call_bytes = totalBytes / test_parameters->count;
+
+cleanup:
+    free(settings);
+    free(frontier);
+    free(probe_mbps);
+    free(probe_ratio);
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_autotune(test_parameters_t* test_parameters)
+{
+    /* output_buf holds whatever setting ran last, not one stream that
+       could be checked against the corpus */
+    test_parameters->verify = 0;
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_autotune  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup an auto-tune job over a buffer of concatinated corpus files
+*
+******************************************************************************/
+int
+tests_startup_corpus_autotune(test_parameters_t* test_parameters)
+{
+   return startup_corpus_autotune(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_autotune  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	run an auto-tune job, searching the deflate settings for the Pareto frontier of the corpus
+*
+******************************************************************************/
+int
+tests_run_corpus_autotune(test_parameters_t* test_parameters)
+{
+    return run_corpus_autotune(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_autotune  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown an auto-tune job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_autotune(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_autotune(test_parameters);
+}
@@ -0,0 +1,453 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+#define BATCH_PER_RECORD        0
+#define BATCH_FULL_FLUSH        1
+#define BATCH_RESET             2
+#define BATCH_STRATEGIES        3
+
+/* Output room of one record beyond deflateBound of its bytes, for the
+   header and trailer of a stream or the markers of a full flush */
+#define BATCH_RECORD_ROOM       (32 + FLUSH_MARKER_ROOM)
+
+static const char *batch_strategy_name[] = { "record", "fullflush", "reset" };
+static const char *batch_trace_name[] = {
+    "stream per record", "full flush batch", "reset batch"
+};
+
+/* One record of a batch, a slice of the corpus */
+typedef struct
+{
+    const unsigned char *data;
+    unsigned long len;
+}
+batch_record_t;
+
+typedef struct
+{
+    unsigned long batches;
+    unsigned long long records;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long ns;
+    histogram_t latency;
+}
+batch_result_t;
+
+
+
+int
+startup_corpus_batch(test_parameters_t* test_parameters)
+{
+    if (TEST_PASSED != tests_startup_corpus_compression(test_parameters))
+        return TEST_FAILED;
+
+    /* A record can not be longer than the corpus it is sliced from */
+    if (test_parameters->batch_max > test_parameters->input_buflen)
+        test_parameters->batch_max = test_parameters->input_buflen;
+    if (test_parameters->batch_min > test_parameters->batch_max)
+        test_parameters->batch_min = test_parameters->batch_max;
+
+    /* Every strategy writes the compressed batch to the scratch buffer */
+    test_parameters->scratch_buflen = (unsigned long)test_parameters->batch_records *
+        (test_parameters->batch_max + (test_parameters->batch_max >> 3) + BATCH_RECORD_ROOM);
+    test_parameters->scratch_buf = malloc(test_parameters->scratch_buflen);
+    if (NULL == test_parameters->scratch_buf) {
+        fprintf(stderr, "# FAIL: Could not allocate batch output buffer.\n");
+        return TEST_FAILED;
+    }
+
+    return TEST_PASSED;
+}
+
+
+
+/******************************************************************************
+* function:
+*     batch_draw (test_parameters_t* test_parameters, batch_record_t *records,
+*                 unsigned int *seed)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param records         [OUT] - batch_records records
+* @param seed            [IN] - rand_r seed of the worker, updated
+*
+* description:
+*   slice a batch of records of batch_min to batch_max bytes from random
+*   places in the corpus, returns the bytes in the batch
+******************************************************************************/
+static unsigned long
+batch_draw(test_parameters_t* test_parameters, batch_record_t *records, unsigned int *seed)
+{
+    unsigned long span = test_parameters->batch_max - test_parameters->batch_min + 1;
+    unsigned long total = 0, len = 0;
+    int r;
+
+    for (r = 0; r < test_parameters->batch_records; r++) {
+        len = test_parameters->batch_min + rand_r(seed) % span;
+        records[r].data = test_parameters->input_buf +
+                          rand_r(seed) % (test_parameters->input_buflen - len + 1);
+        records[r].len = len;
+        total += len;
+    }
+    return total;
+}
+
+/******************************************************************************
+* function:
+*     batch_deflate (test_parameters_t* test_parameters, int strategy,
+*                    z_stream *reused, const batch_record_t *records,
+*                    unsigned long *out_len)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param strategy        [IN] - BATCH_PER_RECORD, BATCH_FULL_FLUSH or BATCH_RESET
+* @param reused          [IN] - stream of the worker that BATCH_RESET reuses
+* @param records         [IN] - records of the batch
+* @param out_len         [OUT] - bytes written to scratch_buf
+*
+* description:
+*   compress the batch into scratch_buf under one strategy: a stream set up
+*   and torn down for every record, one stream for the batch with the records
+*   ended by full flushes, or one long lived stream reset between records.
+*   Each record is fed in a single deflate call, as a broker hands them over.
+******************************************************************************/
+static int
+batch_deflate(test_parameters_t* test_parameters, int strategy, z_stream *reused,
+              const batch_record_t *records, unsigned long *out_len)
+{
+    z_stream strm;
+    z_stream *s = &strm;
+    unsigned char *out = test_parameters->scratch_buf;
+    unsigned long room = test_parameters->scratch_buflen;
+    int windowbits = tests_window_bits(test_parameters->streamtype,
+                                       test_parameters->window_bits);
+    int last = test_parameters->batch_records - 1;
+    int flush = Z_FINISH;
+    int r, ret = Z_OK;
+
+    *out_len = 0;
+    if (BATCH_RESET == strategy)
+        s = reused;
+
+    if (BATCH_FULL_FLUSH == strategy) {
+        memset(s, 0, sizeof(*s));
+        ret = deflateInit2(s, test_parameters->level, 8, windowbits,
+                           test_parameters->mem_level, test_parameters->strategy);
+        if (ret != Z_OK)
+            return ret;
+        s->next_out = out;
+        s->avail_out = room;
+    }
+
+    for (r = 0; r <= last && (Z_OK == ret || Z_STREAM_END == ret); r++) {
+        if (BATCH_PER_RECORD == strategy) {
+            memset(s, 0, sizeof(*s));
+            ret = deflateInit2(s, test_parameters->level, 8, windowbits,
+                               test_parameters->mem_level, test_parameters->strategy);
+            if (ret != Z_OK)
+                return ret;
+        }
+        if (BATCH_FULL_FLUSH != strategy) {
+            s->next_out = out + *out_len;
+            s->avail_out = room - *out_len;
+        }
+        else {
+            flush = (r == last) ? Z_FINISH : Z_FULL_FLUSH;
+        }
+
+        s->next_in = (z_const Bytef *)records[r].data;
+        s->avail_in = records[r].len;
+        ret = deflate(s, flush);
+
+        if (BATCH_PER_RECORD == strategy) {
+            *out_len += s->total_out;
+            deflateEnd(s);
+        }
+        else if (BATCH_RESET == strategy) {
+            *out_len += s->total_out;
+            deflateReset(s);
+        }
+        if (Z_FINISH == flush && ret != Z_STREAM_END)
+            ret = (Z_OK == ret) ? Z_BUF_ERROR : ret;
+    }
+
+    if (BATCH_FULL_FLUSH == strategy) {
+        *out_len = s->total_out;
+        deflateEnd(s);
+    }
+    return (Z_STREAM_END == ret) ? Z_OK : ret;
+}
+
+/******************************************************************************
+* function:
+*     batch_verify (test_parameters_t* test_parameters, int strategy,
+*                   const batch_record_t *records, unsigned long out_len)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param strategy        [IN] - strategy the batch was compressed under
+* @param records         [IN] - records of the batch
+* @param out_len         [IN] - compressed bytes in scratch_buf
+*
+* description:
+*   inflate the compressed batch and check it record by record, one stream
+*   per record or a single stream holding them all. The time taken is not
+*   part of the run.
+******************************************************************************/
+static int
+batch_verify(test_parameters_t* test_parameters, int strategy,
+             const batch_record_t *records, unsigned long out_len)
+{
+    z_stream strm;
+    unsigned char *out = NULL;
+    unsigned long pos = 0, have = 0;
+    verify_span_t span;
+    int windowbits = tests_window_bits(test_parameters->streamtype,
+                                       test_parameters->window_bits);
+    int r, ret = Z_OK;
+    int failed = TEST_PASSED;
+
+    out = tests_verify_buffer(test_parameters);
+    if (NULL == out)
+        return TEST_FAILED;
+
+    tests_verify_start(&span);
+    memset(&strm, 0, sizeof(strm));
+    for (r = 0; r < test_parameters->batch_records && TEST_PASSED == failed; r++) {
+        if (0 == r || BATCH_FULL_FLUSH != strategy) {
+            ret = inflateInit2(&strm, windowbits);
+            if (ret != Z_OK)
+                break;
+            strm.next_in = test_parameters->scratch_buf + pos;
+            strm.avail_in = out_len - pos;
+        }
+
+        /* Exactly the record is asked for, a record that inflates short or
+           long does not line up with the next one */
+        strm.next_out = out;
+        strm.avail_out = records[r].len;
+        ret = inflate(&strm, Z_SYNC_FLUSH);
+        have = records[r].len - strm.avail_out;
+        if ((ret != Z_OK && ret != Z_STREAM_END) || have != records[r].len ||
+            memcmp(out, records[r].data, have) != 0) {
+            fprintf(stderr, "# FAIL: thread %d %s batch record %d of %lu bytes does not "
+                    "match, ret:%d\n", test_parameters->id, batch_strategy_name[strategy],
+                    r, records[r].len, ret);
+            failed = TEST_FAILED;
+        }
+
+        if (BATCH_FULL_FLUSH != strategy || r == test_parameters->batch_records - 1) {
+            if (TEST_PASSED == failed && ret != Z_STREAM_END) {
+                /* the record is complete, the trailer is what is left */
+                ret = inflate(&strm, Z_FINISH);
+                if (ret != Z_STREAM_END) {
+                    fprintf(stderr, "# FAIL: thread %d %s batch record %d does not end "
+                            "its stream, ret:%d\n", test_parameters->id,
+                            batch_strategy_name[strategy], r, ret);
+                    failed = TEST_FAILED;
+                }
+            }
+            pos += strm.total_in;
+            inflateEnd(&strm);
+        }
+    }
+    if (ret != Z_OK && ret != Z_STREAM_END && TEST_PASSED == failed) {
+        fprintf(stderr, "# FAIL: inflateInit2 for verify failed, ret:%d\n", ret);
+        failed = TEST_FAILED;
+    }
+
+    if (TEST_PASSED == failed && pos != out_len) {
+        fprintf(stderr, "# FAIL: thread %d %s batch holds %lu bytes past its records\n",
+                test_parameters->id, batch_strategy_name[strategy], out_len - pos);
+        failed = TEST_FAILED;
+    }
+    if (TEST_PASSED == failed)
+        test_parameters->verify_checked++;
+
+    tests_verify_stop(test_parameters, &span);
+    return failed;
+}
+
+
+
+int
+run_corpus_batch(test_parameters_t* test_parameters)
+{
+    batch_result_t results[BATCH_STRATEGIES];
+    batch_result_t *r;
+    batch_record_t *records = NULL;
+    z_stream reused;
+    unsigned long batch_len = 0, out_len = 0;
+    unsigned long long t0 = 0, trace = 0, run_start = 0;
+    unsigned long long bytes_in = 0, bytes_out = 0;
+    unsigned int seed = 0;
+    int failed = TEST_PASSED;
+    int i, s, ret;
+
+    memset(results, 0, sizeof(results));
+    for (s = 0; s < BATCH_STRATEGIES; s++)
+        tests_histogram_init(&results[s].latency);
+
+    records = malloc(test_parameters->batch_records * sizeof(batch_record_t));
+    if (NULL == records) {
+        fprintf(stderr, "# FAIL: Could not allocate batch records.\n");
+        return TEST_FAILED;
+    }
+
+    /* The reused stream is set up once per worker, outside the timed
+       batches, as a broker would keep it for its lifetime */
+    memset(&reused, 0, sizeof(reused));
+    ret = deflateInit2(&reused, test_parameters->level, 8,
+                       tests_window_bits(test_parameters->streamtype,
+                                         test_parameters->window_bits),
+                       test_parameters->mem_level, test_parameters->strategy);
+    if (ret != Z_OK) {
+        fprintf(stderr, "# FAIL: deflateInit2 of the reused stream failed, ret:%d\n", ret);
+        free(records);
+        return TEST_FAILED;
+    }
+
+    seed = (unsigned int)tests_nsec() ^ (test_parameters->id * 2654435761U);
+    run_start = tests_nsec();
+
+    /* Every iteration draws one batch and compresses it under each strategy
+       in turn, so they all see the same records */
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        tests_pace(test_parameters, i, run_start);
+        batch_len = batch_draw(test_parameters, records, &seed);
+
+        for (s = 0; s < BATCH_STRATEGIES && TEST_PASSED == failed; s++) {
+            t0 = tests_nsec();
+            trace = tests_trace_start(test_parameters->trace);
+            ret = batch_deflate(test_parameters, s, &reused, records, &out_len);
+            tests_trace_stop(test_parameters->trace, batch_trace_name[s], trace);
+            t0 = tests_nsec() - t0;
+
+            if (ret != Z_OK) {
+                fprintf(stderr, "# FAIL: %s batch deflate failed, ret:%d\n",
+                        batch_strategy_name[s], ret);
+                tests_live_error(test_parameters);
+                failed = TEST_FAILED;
+                break;
+            }
+
+            r = &results[s];
+            r->batches++;
+            r->records += test_parameters->batch_records;
+            r->bytes_in += batch_len;
+            r->bytes_out += out_len;
+            r->ns += t0;
+            tests_histogram_add(&r->latency, t0);
+            tests_live_op(test_parameters, batch_len, out_len, t0);
+
+            if (tests_verify_due(test_parameters, i))
+                failed = batch_verify(test_parameters, s, records, out_len);
+        }
+    }
+
+    deflateEnd(&reused);
+    free(records);
+
+    if (TEST_PASSED != failed || 0 == results[BATCH_PER_RECORD].batches)
+        return failed;
+
+    flockfile(stdout);
+    printf("\nThread %d batches of %d records of %lu to %lu bytes:\n",
+           test_parameters->id, test_parameters->batch_records,
+           test_parameters->batch_min, test_parameters->batch_max);
+    printf("%10s %12s %10s %8s %10s %10s %10s\n", "Strategy", "Records/s",
+           "Mbps", "Ratio", "Batch_us", "p50_us", "p99_us");
+    for (s = 0; s < BATCH_STRATEGIES; s++) {
+        r = &results[s];
+        printf("%10s %12.0f %10.2f %8.4f %10.1f %10.1f %10.1f\n",
+               batch_strategy_name[s], (double)r->records * 1e9 / r->ns,
+               (double)r->bytes_in * 8 * 1000 / r->ns,
+               (double)r->bytes_out / r->bytes_in,
+               (double)r->ns / r->batches / 1000,
+               (double)tests_histogram_percentile(&r->latency, 50) / 1000,
+               (double)tests_histogram_percentile(&r->latency, 99) / 1000);
+        bytes_in += r->bytes_in;
+        bytes_out += r->bytes_out;
+    }
+    printf("record: a stream per record, fullflush: one stream per batch with a full "
+           "flush\nafter each record, reset: one stream kept by the thread and reset "
+           "between records\n");
+    funlockfile(stdout);
+
+    /* An operation compresses the same batch under every strategy */
+    test_parameters->single_call_bytes = bytes_in / results[BATCH_PER_RECORD].batches;
+    test_parameters->ratio = (float)bytes_out / bytes_in;
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_batch(test_parameters_t* test_parameters)
+{
+    if (test_parameters->scratch_buf) {
+        free(test_parameters->scratch_buf);
+        test_parameters->scratch_buf = NULL;
+        test_parameters->scratch_buflen = 0;
+    }
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_batch  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a record batch job
+*
+******************************************************************************/
+int
+tests_startup_corpus_batch(test_parameters_t* test_parameters)
+{
+   return startup_corpus_batch(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_batch  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	compare the batch compression strategies on batches of small records
+*
+******************************************************************************/
+int
+tests_run_corpus_batch(test_parameters_t* test_parameters)
+{
+    return run_corpus_batch(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_batch  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a record batch job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_batch(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_batch(test_parameters);
+}
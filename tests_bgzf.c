@@ -0,0 +1,688 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* Uncompressed bytes per gzip member, the block size bgzip uses so a
+   member never grows past the 64K its BSIZE field can describe */
+#define BGZF_BLOCK_SIZE         65280
+#define BGZF_MAX_MEMBER         65536
+/* gzip header with the 6 byte BC extra field, and the crc32/isize trailer */
+#define BGZF_HEADER_SIZE        18
+#define BGZF_TRAILER_SIZE       8
+/* Largest number of threads one worker compresses its blocks with */
+#define BGZF_MAX_THREADS        64
+
+/* Empty member bgzip writes at the end of a file to mark its end */
+static const unsigned char bgzf_eof[] =
+{
+    0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00,
+    0x42, 0x43, 0x02, 0x00, 0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00
+};
+
+typedef struct
+{
+    pthread_t th;
+    test_parameters_t *test_parameters;
+    int first;
+    int stride;
+    unsigned long blocks;
+    unsigned char *slots;
+    unsigned long slot_size;
+    unsigned long *member_len;
+    int failed;
+    struct bgzf_pool *pool;
+}
+bgzf_worker_t;
+
+/* Block threads of a worker, started at startup so that an iteration only
+   hands them their blocks. Thread 0 is the worker itself, the members are
+   compressed into fixed slots and packed into output_buf once all of them
+   are done. */
+typedef struct bgzf_pool
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    unsigned long generation;
+    int pending;
+    int quit;
+    int threads;
+    int started;
+    unsigned long *member_len;
+    unsigned char *slots;
+    bgzf_worker_t worker[BGZF_MAX_THREADS];
+}
+bgzf_pool_t;
+
+static void
+put_le16(unsigned char *p, unsigned int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+}
+
+static void
+put_le32(unsigned char *p, unsigned long v)
+{
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, (v >> 16) & 0xffff);
+}
+
+static void
+put_le64(unsigned char *p, uint64_t v)
+{
+    put_le32(p, (unsigned long)(v & 0xffffffff));
+    put_le32(p + 4, (unsigned long)(v >> 32));
+}
+
+static unsigned int
+get_le16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint64_t
+get_le64(const unsigned char *p)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static unsigned long
+bgzf_blocks(test_parameters_t* test_parameters)
+{
+    return (test_parameters->input_buflen + BGZF_BLOCK_SIZE - 1) / BGZF_BLOCK_SIZE;
+}
+
+/* Size of the .gzi index: a count then one offset pair per block after
+   the first */
+static unsigned long
+bgzf_index_size(unsigned long blocks)
+{
+    return 8 + 16 * (blocks - 1);
+}
+
+/******************************************************************************
+* function:
+*     bgzf_member (z_stream *strm,
+*                  const unsigned char *in,
+*                  unsigned long in_len,
+*                  unsigned char *out,
+*                  unsigned long out_size,
+*                  int level,
+*                  int strategy,
+*                  unsigned long *out_len)
+*
+* @param strm     [IN] - raw deflate stream, reset before every member
+* @param in       [IN] - uncompressed block
+* @param in_len   [IN] - length of the block
+* @param out      [OUT] - space for the member
+* @param out_size [IN] - size of that space
+* @param level    [IN] - compression level
+* @param strategy [IN] - deflate strategy
+* @param out_len  [OUT] - length of the member
+*
+* description:
+*   write one gzip member with the BGZF extra field holding the member size.
+*   A block that does not compress into 64K is stored instead.
+******************************************************************************/
+static int
+bgzf_member(z_stream *strm, const unsigned char *in, unsigned long in_len,
+            unsigned char *out, unsigned long out_size, int level, int strategy,
+            unsigned long *out_len)
+{
+    unsigned long deflated = 0;
+    int stored = 0;
+    int ret = Z_OK;
+
+    for (;;) {
+        deflateReset(strm);
+        strm->next_in = (void *)in;
+        strm->avail_in = in_len;
+        strm->next_out = out + BGZF_HEADER_SIZE;
+        strm->avail_out = out_size - BGZF_HEADER_SIZE - BGZF_TRAILER_SIZE;
+        ret = deflate(strm, Z_FINISH);
+        deflated = strm->total_out;
+        if (ret == Z_STREAM_END &&
+            BGZF_HEADER_SIZE + deflated + BGZF_TRAILER_SIZE <= BGZF_MAX_MEMBER)
+            break;
+        if (stored)
+            return TEST_FAILED;
+        /* Incompressible block, store it so the member fits BSIZE */
+        stored = 1;
+        if (deflateParams(strm, Z_NO_COMPRESSION, strategy) != Z_OK)
+            return TEST_FAILED;
+    }
+    if (stored && deflateParams(strm, level, strategy) != Z_OK)
+        return TEST_FAILED;
+
+    *out_len = BGZF_HEADER_SIZE + deflated + BGZF_TRAILER_SIZE;
+
+    /* ID1 ID2 CM FLG(FEXTRA) MTIME XFL OS XLEN, then the BC subfield */
+    out[0] = 0x1f;
+    out[1] = 0x8b;
+    out[2] = 0x08;
+    out[3] = 0x04;
+    put_le32(out + 4, 0);
+    out[8] = 0x00;
+    out[9] = 0xff;
+    put_le16(out + 10, 6);
+    out[12] = 'B';
+    out[13] = 'C';
+    put_le16(out + 14, 2);
+    put_le16(out + 16, *out_len - 1);
+
+    put_le32(out + *out_len - 8, crc32(0, in, (uInt)in_len));
+    put_le32(out + *out_len - 4, in_len);
+
+    return TEST_PASSED;
+}
+
+static void *
+bgzf_worker(void *arg)
+{
+    bgzf_worker_t *w = (bgzf_worker_t *)arg;
+    test_parameters_t *test_parameters = w->test_parameters;
+    z_stream strm;
+    unsigned long b = 0, len = 0;
+
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit2(&strm, test_parameters->level, 8, -test_parameters->window_bits,
+                     test_parameters->mem_level, test_parameters->strategy) != Z_OK) {
+        w->failed = TEST_FAILED;
+        return NULL;
+    }
+
+    for (b = w->first; b < w->blocks && TEST_PASSED == w->failed; b += w->stride) {
+        len = test_parameters->input_buflen - b * BGZF_BLOCK_SIZE;
+        if (len > BGZF_BLOCK_SIZE)
+            len = BGZF_BLOCK_SIZE;
+        w->failed = bgzf_member(&strm, test_parameters->input_buf + b * BGZF_BLOCK_SIZE, len,
+                                w->slots + b * w->slot_size, w->slot_size,
+                                test_parameters->level, test_parameters->strategy,
+                                &w->member_len[b]);
+    }
+
+    deflateEnd(&strm);
+    return NULL;
+}
+
+static void *
+bgzf_helper(void *arg)
+{
+    bgzf_worker_t *w = (bgzf_worker_t *)arg;
+    bgzf_pool_t *pool = w->pool;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        bgzf_worker(w);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void
+bgzf_pool_stop(test_parameters_t* test_parameters)
+{
+    bgzf_pool_t *pool = test_parameters->bgzf_pool;
+    int t;
+
+    if (NULL == pool)
+        return;
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    for (t = 1; t <= pool->started; t++)
+        pthread_join(pool->worker[t].th, NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->member_len);
+    free(pool->slots);
+    free(pool);
+    test_parameters->bgzf_pool = NULL;
+}
+
+/******************************************************************************
+* function:
+*     tests_bgzf_pool_start (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*
+* description:
+*   allocate the member slots of a worker and start its block threads, one
+*   less than its share of the cores as the worker compresses blocks too.
+*   Thread t compresses blocks t, t + threads, t + 2 * threads and so on.
+******************************************************************************/
+int
+tests_bgzf_pool_start(test_parameters_t* test_parameters)
+{
+    bgzf_pool_t *pool = NULL;
+    unsigned long blocks = bgzf_blocks(test_parameters);
+    int threads = test_parameters->cores;
+    int t;
+
+    if (test_parameters->threads > 1)
+        threads /= test_parameters->threads;
+    if (threads > BGZF_MAX_THREADS)
+        threads = BGZF_MAX_THREADS;
+    if ((unsigned long)threads > blocks)
+        threads = blocks;
+    if (threads < 1)
+        threads = 1;
+
+    pool = calloc(1, sizeof(bgzf_pool_t));
+    if (pool) {
+        pool->member_len = calloc(blocks, sizeof(*pool->member_len));
+        pool->slots = malloc(blocks * BGZF_MAX_MEMBER);
+    }
+    if (NULL == pool || NULL == pool->member_len || NULL == pool->slots) {
+        fprintf(stderr, "# FAIL: Could not allocate BGZF block slots.\n");
+        if (pool) {
+            free(pool->member_len);
+            free(pool->slots);
+            free(pool);
+        }
+        return TEST_FAILED;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->threads = threads;
+    test_parameters->bgzf_pool = pool;
+
+    for (t = 0; t < threads; t++) {
+        pool->worker[t].test_parameters = test_parameters;
+        pool->worker[t].first = t;
+        pool->worker[t].stride = threads;
+        pool->worker[t].blocks = blocks;
+        pool->worker[t].slots = pool->slots;
+        pool->worker[t].slot_size = BGZF_MAX_MEMBER;
+        pool->worker[t].member_len = pool->member_len;
+        pool->worker[t].failed = TEST_PASSED;
+        pool->worker[t].pool = pool;
+        if (t > 0) {
+            if (pthread_create(&pool->worker[t].th, NULL, bgzf_helper, &pool->worker[t]) != 0) {
+                fprintf(stderr, "# FAIL: Could not create BGZF block thread\n");
+                bgzf_pool_stop(test_parameters);
+                return TEST_FAILED;
+            }
+            pool->started++;
+        }
+    }
+    return TEST_PASSED;
+}
+
+/******************************************************************************
+* function:
+*     bgzf_verify (test_parameters_t* test_parameters,
+*                  unsigned long object_len)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+* @param object_len      [IN] - length of the BGZF object in output_buf
+*
+* description:
+*   check every index entry points at a member whose BSIZE leads to the
+*   next entry, then inflate the members one after the other and check the
+*   result against the corpus
+******************************************************************************/
+static int
+bgzf_verify(test_parameters_t* test_parameters, unsigned long object_len)
+{
+    z_stream strm;
+    unsigned char *out = NULL;
+    unsigned char *member = NULL;
+    verify_span_t span;
+    unsigned long blocks = bgzf_blocks(test_parameters);
+    unsigned long b = 0, offset = 0, entry = 0;
+    int failed = TEST_PASSED;
+    int ret = Z_OK;
+
+    out = tests_verify_buffer(test_parameters);
+    if (NULL == out)
+        return TEST_FAILED;
+
+    tests_verify_start(&span);
+    for (b = 0; b < blocks && TEST_PASSED == failed; b++) {
+        member = test_parameters->output_buf + offset;
+        if (b > 0) {
+            entry = 8 + 16 * (b - 1);
+            if (get_le64(test_parameters->index_buf + entry) != offset ||
+                get_le64(test_parameters->index_buf + entry + 8) != b * BGZF_BLOCK_SIZE) {
+                fprintf(stderr, "# FAIL: BGZF index entry %lu does not match member at %lu\n",
+                        b, offset);
+                failed = TEST_FAILED;
+            }
+        }
+        if (member[0] != 0x1f || member[1] != 0x8b || member[12] != 'B' || member[13] != 'C') {
+            fprintf(stderr, "# FAIL: BGZF member %lu at %lu has no BC header\n", b, offset);
+            failed = TEST_FAILED;
+        }
+        offset += get_le16(member + 16) + 1;
+    }
+    if (TEST_PASSED == failed &&
+        (offset + sizeof(bgzf_eof) != object_len ||
+         memcmp(test_parameters->output_buf + offset, bgzf_eof, sizeof(bgzf_eof)))) {
+        fprintf(stderr, "# FAIL: BGZF object does not end with the EOF member\n");
+        failed = TEST_FAILED;
+    }
+
+    memset(&strm, 0, sizeof(strm));
+    if (TEST_PASSED == failed && inflateInit2(&strm, 16 + MAX_WBITS) != Z_OK) {
+        fprintf(stderr, "# FAIL: inflateInit2 for verify failed\n");
+        failed = TEST_FAILED;
+    }
+    if (TEST_PASSED == failed) {
+        strm.next_in = test_parameters->output_buf;
+        strm.avail_in = object_len;
+        strm.next_out = out;
+        strm.avail_out = test_parameters->input_buflen + 100;
+        do {
+            ret = inflate(&strm, Z_FINISH);
+            if (ret == Z_STREAM_END && strm.avail_in > 0)
+                ret = inflateReset(&strm);
+        } while (ret == Z_OK);
+        if (ret != Z_STREAM_END) {
+            fprintf(stderr, "# FAIL: BGZF inflate failed, ret:%d\n", ret);
+            failed = TEST_FAILED;
+        }
+        inflateEnd(&strm);
+    }
+    tests_verify_stop(test_parameters, &span);
+
+    if (TEST_PASSED == failed)
+        failed = tests_verify_data(test_parameters, out,
+                                   (unsigned long)(strm.next_out - out));
+    return failed;
+}
+
+
+
+int
+startup_corpus_bgzf(test_parameters_t* test_parameters)
+{
+    z_stream strm;
+    unsigned long blocks = 0;
+    int ret = Z_OK;
+
+    if (TEST_PASSED != tests_startup_corpus_compression(test_parameters))
+        return TEST_FAILED;
+
+    /* The single gzip stream of the corpus the block format is compared
+       against, compressed here so it is not part of the timing */
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, test_parameters->level, 8, 16 + test_parameters->window_bits,
+                       test_parameters->mem_level, test_parameters->strategy);
+    if (ret != Z_OK) {
+        fprintf(stderr, "# FAIL: deflateInit2 failed, ret:%d\n", ret);
+        return TEST_FAILED;
+    }
+    strm.next_in = test_parameters->input_buf;
+    strm.avail_in = test_parameters->input_buflen;
+    strm.next_out = test_parameters->output_buf;
+    strm.avail_out = test_parameters->output_buflen;
+    ret = deflate(&strm, Z_FINISH);
+    test_parameters->reference_len = strm.total_out;
+    deflateEnd(&strm);
+    if (ret != Z_STREAM_END) {
+        fprintf(stderr, "# FAIL: single stream deflate failed, ret:%d\n", ret);
+        return TEST_FAILED;
+    }
+
+    /* Room for every member at its largest plus the EOF member */
+    blocks = bgzf_blocks(test_parameters);
+    free(test_parameters->output_buf);
+    test_parameters->output_buflen = blocks * BGZF_MAX_MEMBER + sizeof(bgzf_eof);
+    test_parameters->output_buf = malloc(test_parameters->output_buflen);
+    test_parameters->index_len = bgzf_index_size(blocks);
+    test_parameters->index_buf = malloc(test_parameters->index_len);
+    if (NULL == test_parameters->output_buf || NULL == test_parameters->index_buf) {
+        fprintf(stderr, "# FAIL: Could not allocate BGZF buffers.\n");
+        return TEST_FAILED;
+    }
+
+    return tests_bgzf_pool_start(test_parameters);
+}
+
+
+
+int
+run_corpus_bgzf(test_parameters_t* test_parameters)
+{
+    bgzf_pool_t *pool = test_parameters->bgzf_pool;
+    unsigned long blocks = bgzf_blocks(test_parameters);
+    unsigned long *member_len = pool->member_len;
+    unsigned char *slots = pool->slots;
+    unsigned long object_len = 0, uncompressed = 0, b = 0;
+    unsigned char *entry = NULL;
+    unsigned long long block_ns = 0, assemble_ns = 0, t0 = 0;
+    int threads = pool->threads;
+    int failed = TEST_PASSED;
+    int i = 0, t = 0;
+
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        t0 = tests_nsec();
+        pthread_mutex_lock(&pool->lock);
+        for (t = 0; t < threads; t++)
+            pool->worker[t].failed = TEST_PASSED;
+        pool->pending = threads - 1;
+        pool->generation++;
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+
+        /* The worker thread compresses its own share of the blocks */
+        bgzf_worker(&pool->worker[0]);
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending > 0)
+            pthread_cond_wait(&pool->done, &pool->lock);
+        pthread_mutex_unlock(&pool->lock);
+        for (t = 0; t < threads; t++) {
+            if (TEST_PASSED != pool->worker[t].failed) {
+                fprintf(stderr, "# FAIL: BGZF block compression failed\n");
+                failed = TEST_FAILED;
+            }
+        }
+        if (TEST_PASSED != failed)
+            break;
+        block_ns += tests_nsec() - t0;
+
+        t0 = tests_nsec();
+        object_len = 0;
+        uncompressed = 0;
+        put_le64(test_parameters->index_buf, blocks - 1);
+        entry = test_parameters->index_buf + 8;
+        for (b = 0; b < blocks; b++) {
+            if (b > 0) {
+                put_le64(entry, object_len);
+                put_le64(entry + 8, uncompressed);
+                entry += 16;
+            }
+            memcpy(test_parameters->output_buf + object_len,
+                   slots + b * BGZF_MAX_MEMBER, member_len[b]);
+            object_len += member_len[b];
+            uncompressed += BGZF_BLOCK_SIZE;
+        }
+        memcpy(test_parameters->output_buf + object_len, bgzf_eof, sizeof(bgzf_eof));
+        object_len += sizeof(bgzf_eof);
+        assemble_ns += tests_nsec() - t0;
+
+        test_parameters->single_call_bytes = test_parameters->input_buflen;
+        test_parameters->ratio = (float)object_len / test_parameters->input_buflen;
+
+        if (tests_verify_due(test_parameters, i))
+            failed = bgzf_verify(test_parameters, object_len);
+    }
+
+    if (TEST_PASSED == failed) {
+        flockfile(stdout);
+        printf("\nThread %d BGZF results:\n", test_parameters->id);
+        printf("Blocks             = %lu of %d bytes, compressed by %d threads\n",
+               blocks, BGZF_BLOCK_SIZE, threads);
+        printf("BGZF object        = %lu bytes (ratio %.4f)\n",
+               object_len, (float)object_len / test_parameters->input_buflen);
+        printf("Single stream      = %lu bytes (ratio %.4f)\n",
+               test_parameters->reference_len,
+               (float)test_parameters->reference_len / test_parameters->input_buflen);
+        printf("Block format cost  = %+.2f%%\n",
+               100.0 * ((double)object_len - test_parameters->reference_len) /
+               test_parameters->reference_len);
+        printf("Index              = %lu bytes (%.3f%% of the object)\n",
+               test_parameters->index_len,
+               100.0 * test_parameters->index_len / object_len);
+        printf("Block compression  = %.2f Mbps\n",
+               (double)test_parameters->input_buflen * i * 8 * 1000 / (block_ns + 1));
+        printf("Assembly           = %.3f msec per object\n",
+               (double)assemble_ns / i / 1000000);
+        funlockfile(stdout);
+    }
+
+    /* Keep the length of the object for shutdown */
+    test_parameters->output_buflen = object_len;
+
+    return failed;
+}
+
+
+
+static int
+write_bgzf_file(const char *path, const unsigned char *buf, unsigned long len)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (NULL == f) {
+        fprintf(stderr, "# FAIL: Could not open %s\n", path);
+        return TEST_FAILED;
+    }
+    if (len && fwrite(buf, len, 1, f) != 1) {
+        fprintf(stderr, "# FAIL: Could not write %s\n", path);
+        fclose(f);
+        return TEST_FAILED;
+    }
+    fclose(f);
+    return TEST_PASSED;
+}
+
+
+
+int
+shutdown_corpus_bgzf(test_parameters_t* test_parameters)
+{
+    char *path = NULL;
+    int failed = TEST_PASSED;
+
+    /* Keep the object and its index as path.<id> and path.<id>.gzi */
+    if (test_parameters->bgzf_path && test_parameters->bgzf_path[0] != '\0' &&
+        test_parameters->output_buf && test_parameters->index_buf) {
+        path = malloc(strlen(test_parameters->bgzf_path) + 32);
+        if (NULL == path) {
+            fprintf(stderr, "# FAIL: Could not allocate space for filename.\n");
+            failed = TEST_FAILED;
+        }
+        else {
+            sprintf(path, "%s.%d", test_parameters->bgzf_path, test_parameters->id);
+            failed |= write_bgzf_file(path, test_parameters->output_buf,
+                                      test_parameters->output_buflen);
+            strcat(path, ".gzi");
+            failed |= write_bgzf_file(path, test_parameters->index_buf,
+                                      test_parameters->index_len);
+            free(path);
+        }
+    }
+
+    bgzf_pool_stop(test_parameters);
+    if (test_parameters->index_buf) {
+        free(test_parameters->index_buf);
+        test_parameters->index_buf = NULL;
+        test_parameters->index_len = 0;
+    }
+
+    if (TEST_PASSED != tests_shutdown_corpus_compression(test_parameters))
+        failed = TEST_FAILED;
+    return failed;
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_bgzf  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a block gzip compression job over a buffer of concatinated corpus files
+*
+******************************************************************************/
+int
+tests_startup_corpus_bgzf(test_parameters_t* test_parameters)
+{
+   return startup_corpus_bgzf(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_bgzf  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	run a block gzip compression job, compressing the blocks in parallel
+*
+******************************************************************************/
+int
+tests_run_corpus_bgzf(test_parameters_t* test_parameters)
+{
+    return run_corpus_bgzf(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_bgzf  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a block gzip compression job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_bgzf(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_bgzf(test_parameters);
+}
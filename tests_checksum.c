@@ -0,0 +1,274 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+#define CHECKSUM_MIN_SIZE       64
+#define CHECKSUM_MAX_SIZE       (64 * 1024 * 1024)
+/* Bytes checksummed per buffer size and algorithm in every iteration */
+#define CHECKSUM_BYTES_PER_SIZE CHECKSUM_MAX_SIZE
+/* Buffers smaller than this are walked through a region this big, so
+   small checksums are measured on cache resident data as they would be
+   right after the data was produced */
+#define CHECKSUM_HOT_REGION     (256 * 1024)
+#define CHECKSUM_COMBINE_CALLS  4096
+/* Smallest slice worth handing to a thread of the parallel crc32 */
+#define CHECKSUM_MIN_SLICE      (64 * 1024)
+/* Sizes go up by a factor of four from CHECKSUM_MIN_SIZE to CHECKSUM_MAX_SIZE */
+#define CHECKSUM_NUM_SIZES      11
+
+typedef struct
+{
+    unsigned long size;
+    unsigned long long crc_bytes;
+    unsigned long long crc_ns;
+    unsigned long long crc_cycles;
+    unsigned long long adler_bytes;
+    unsigned long long adler_ns;
+    unsigned long long adler_cycles;
+    unsigned long long crc_combine_calls;
+    unsigned long long crc_combine_ns;
+    unsigned long long adler_combine_calls;
+    unsigned long long adler_combine_ns;
+    unsigned long long parallel_bytes;
+    unsigned long long parallel_ns;
+}
+checksum_result_t;
+
+/* keeps the compiler from dropping checksums nobody looks at */
+static volatile unsigned long checksum_sink;
+
+
+
+int
+startup_corpus_checksum(test_parameters_t* test_parameters)
+{
+    unsigned char *buf = NULL;
+    unsigned long filled = 0, part = 0;
+
+    if (TEST_PASSED != tests_startup_corpus_compression(test_parameters))
+        return TEST_FAILED;
+
+    buf = malloc(CHECKSUM_MAX_SIZE);
+    if (NULL == buf) {
+        fprintf(stderr, "# FAIL: Could not allocate checksum buffer.\n");
+        return TEST_FAILED;
+    }
+
+    /* Repeat the corpus up to the largest size measured */
+    while (filled < CHECKSUM_MAX_SIZE) {
+        part = test_parameters->input_buflen;
+        if (part > CHECKSUM_MAX_SIZE - filled)
+            part = CHECKSUM_MAX_SIZE - filled;
+        memcpy(buf + filled, test_parameters->input_buf, part);
+        filled += part;
+    }
+
+    free(test_parameters->input_buf);
+    test_parameters->input_buf = buf;
+    test_parameters->input_buflen = CHECKSUM_MAX_SIZE;
+
+    /* The parallel crc32 helpers are started here, never while timing */
+    tests_crc_pool_start(test_parameters);
+
+    return TEST_PASSED;
+}
+
+
+
+static void
+print_checksum_results(test_parameters_t* test_parameters, checksum_result_t *results,
+                       int pool_slices)
+{
+    int s;
+    checksum_result_t *r;
+
+    flockfile(stdout);
+    printf("\nThread %d checksum results:\n", test_parameters->id);
+    printf("%10s %10s %8s %10s %8s %12s %12s %14s\n",
+           "Size", "crc32_GB/s", "crc_c/B", "adler_GB/s", "adler_c/B",
+           "crc_comb_ns", "adl_comb_ns", "par_crc_GB/s");
+    for (s = 0; s < CHECKSUM_NUM_SIZES; s++) {
+        r = &results[s];
+        printf("%10lu %10.3f %8.3f %10.3f %8.3f %12.1f %12.1f ",
+               r->size,
+               (double)r->crc_bytes / (r->crc_ns + 1),
+               (double)r->crc_cycles / r->crc_bytes,
+               (double)r->adler_bytes / (r->adler_ns + 1),
+               (double)r->adler_cycles / r->adler_bytes,
+               (double)r->crc_combine_ns / r->crc_combine_calls,
+               (double)r->adler_combine_ns / r->adler_combine_calls);
+        if (r->parallel_bytes)
+            printf("%14.3f\n", (double)r->parallel_bytes / (r->parallel_ns + 1));
+        else
+            printf("%14s\n", "-");
+    }
+    printf("Parallel crc32 uses up to %d slices merged with crc32_combine\n",
+           pool_slices);
+    funlockfile(stdout);
+}
+
+
+
+int
+run_corpus_checksum(test_parameters_t* test_parameters)
+{
+    checksum_result_t results[CHECKSUM_NUM_SIZES];
+    checksum_result_t *r;
+    unsigned long size = 0, region = 0, offset = 0, reps = 0, n = 0;
+    unsigned long check = 0, parallel = 0;
+    unsigned long long t0 = 0, c0 = 0;
+    unsigned long long total = 0;
+    int i = 0, s = 0, slices = 0;
+    int failed = TEST_PASSED;
+    const unsigned char *buf = test_parameters->input_buf;
+    /* The helpers were started by startup, this only counts them */
+    int pool_slices = tests_crc_pool_start(test_parameters);
+
+    memset(results, 0, sizeof(results));
+
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        total = 0;
+        for (s = 0, size = CHECKSUM_MIN_SIZE; s < CHECKSUM_NUM_SIZES; s++, size *= 4) {
+            r = &results[s];
+            r->size = size;
+            reps = CHECKSUM_BYTES_PER_SIZE / size;
+            region = (size < CHECKSUM_HOT_REGION) ? CHECKSUM_HOT_REGION : CHECKSUM_MAX_SIZE;
+
+            check = 0;
+            t0 = tests_nsec();
+            c0 = rdtsc();
+            for (n = 0, offset = 0; n < reps; n++) {
+                check ^= crc32(0, buf + offset, (uInt)size);
+                offset += size;
+                if (offset + size > region)
+                    offset = 0;
+            }
+            r->crc_cycles += rdtsc() - c0;
+            r->crc_ns += tests_nsec() - t0;
+            r->crc_bytes += reps * size;
+
+            t0 = tests_nsec();
+            c0 = rdtsc();
+            for (n = 0, offset = 0; n < reps; n++) {
+                check ^= adler32(1, buf + offset, (uInt)size);
+                offset += size;
+                if (offset + size > region)
+                    offset = 0;
+            }
+            r->adler_cycles += rdtsc() - c0;
+            r->adler_ns += tests_nsec() - t0;
+            r->adler_bytes += reps * size;
+            total += 2 * reps * size;
+
+            /* The cost of combining depends on the length of the second
+               checksum only */
+            t0 = tests_nsec();
+            for (n = 0; n < CHECKSUM_COMBINE_CALLS; n++)
+                check = crc32_combine(check, n, size);
+            r->crc_combine_ns += tests_nsec() - t0;
+            r->crc_combine_calls += CHECKSUM_COMBINE_CALLS;
+
+            t0 = tests_nsec();
+            for (n = 0; n < CHECKSUM_COMBINE_CALLS; n++)
+                check = adler32_combine(check, n, size);
+            r->adler_combine_ns += tests_nsec() - t0;
+            r->adler_combine_calls += CHECKSUM_COMBINE_CALLS;
+
+            slices = pool_slices;
+            if ((unsigned long)slices > size / CHECKSUM_MIN_SLICE)
+                slices = size / CHECKSUM_MIN_SLICE;
+            if (slices > 1) {
+                t0 = tests_nsec();
+                parallel = tests_crc32_pool(test_parameters->crc_pool, buf, size,
+                                            slices, NULL);
+                r->parallel_ns += tests_nsec() - t0;
+                r->parallel_bytes += size;
+                total += size;
+                if (parallel != crc32(0, buf, (uInt)size)) {
+                    fprintf(stderr, "# FAIL: parallel crc32 of %lu bytes does not match\n", size);
+                    failed = TEST_FAILED;
+                    break;
+                }
+            }
+            checksum_sink = check;
+        }
+
+        test_parameters->single_call_bytes = total;
+        test_parameters->ratio = 1;
+    }
+
+    if (TEST_PASSED == failed)
+        print_checksum_results(test_parameters, results, pool_slices);
+
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_checksum(test_parameters_t* test_parameters)
+{
+    /* Nothing is compressed by this test */
+    test_parameters->verify = 0;
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_checksum  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a checksum job over a buffer of repeated corpus files
+*
+******************************************************************************/
+int
+tests_startup_corpus_checksum(test_parameters_t* test_parameters)
+{
+   return startup_corpus_checksum(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_checksum  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	run a checksum job across buffer sizes from 64 bytes to 64 MB
+*
+******************************************************************************/
+int
+tests_run_corpus_checksum(test_parameters_t* test_parameters)
+{
+    return run_corpus_checksum(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_checksum  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a checksum job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_checksum(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_checksum(test_parameters);
+}
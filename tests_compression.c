@@ -146,6 +146,12 @@ startup_corpus_compression(test_parameters_t* test_parameters)
        that won't compress it will slightly expand. The magic numbers to ensure
        enough space are to multiply by 9 then dividing by 8 and then add 5. */
     test_parameters->output_buflen=((test_parameters->input_buflen*9)/8) + 5;
+    /* Every flush of a flush schedule ends the current block and may add
+       an empty one */
+    if (test_parameters->flush_policy != FLUSH_POLICY_OFF ||
+        test_parameters->type == TEST_CORPUS_FLUSH)
+        test_parameters->output_buflen += (test_parameters->input_buflen /
+                                           test_parameters->chunksize + 1) * FLUSH_MARKER_ROOM;
     test_parameters->output_buf=(unsigned char*)malloc(test_parameters->output_buflen);
     spaceRemaining = test_parameters->input_buflen;
 
@@ -200,6 +206,80 @@ startup_corpus_compression(test_parameters_t* test_parameters)
 
 
 
+/******************************************************************************
+* function:
+*     compress_bounded (test_parameters_t* test_parameters,
+*                       z_stream *strm,
+*                       output_sink_t *sink,
+*                       int flush,
+*                       unsigned long *calls,
+*                       unsigned char *capture,
+*                       unsigned long capture_len)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+* @param strm            [IN] - initialised deflate stream
+* @param sink            [IN] - sink the output buffer is drained to
+* @param flush           [IN] - flush value used for all but the last chunk,
+*                               unless there is a -flush schedule
+* @param calls           [OUT] - incremented for every deflate call
+* @param capture         [OUT] - when not NULL the whole stream is also copied
+*                                here so the iteration can be verified
+* @param capture_len     [IN] - size of the capture buffer
+*
+* description:
+*   compress the input buffer the way a streaming consumer does. deflate
+*   writes into the first outbuf_size bytes of the output buffer which are
+*   drained to the sink every time deflate returns, and deflate is called
+*   again for as long as it fills the buffer.
+******************************************************************************/
+static int
+compress_bounded(test_parameters_t* test_parameters, z_stream *strm,
+                 output_sink_t *sink, int flush, unsigned long *calls,
+                 unsigned char *capture, unsigned long capture_len)
+{
+    int ret = Z_OK;
+    unsigned long have = 0;
+    unsigned long chunks = 0, pending = 0, chunk = 0;
+
+    tests_sink_rewind(sink);
+    do {
+        chunk = tests_sizes_next(test_parameters);
+        strm->next_in = (void *)test_parameters->input_buf+strm->total_in;
+        if (test_parameters->flush_policy != FLUSH_POLICY_OFF)
+            flush = tests_flush_schedule(test_parameters, &chunks, &pending, chunk);
+        if (strm->total_in+chunk >= test_parameters->input_buflen) {
+            strm->avail_in = test_parameters->input_buflen - strm->total_in;
+            flush = Z_FINISH;
+        }
+        else {
+            strm->avail_in = chunk;
+        }
+
+        do {
+            strm->next_out = (void *)test_parameters->output_buf;
+            strm->avail_out = test_parameters->outbuf_size;
+            ret = deflate(strm, flush);
+            (*calls)++;
+            if (ret == Z_STREAM_ERROR)
+                return ret;
+
+            have = test_parameters->outbuf_size - strm->avail_out;
+            if (have > 0 &&
+                TEST_PASSED != tests_sink_drain(sink, test_parameters->output_buf, have))
+                return Z_ERRNO;
+            if (capture && have > 0) {
+                if (strm->total_out > capture_len)
+                    return Z_BUF_ERROR;
+                memcpy(capture + strm->total_out - have, test_parameters->output_buf, have);
+            }
+        } while (strm->avail_out == 0);
+    } while (flush != Z_FINISH);
+
+    return ret;
+}
+
+
+
 int
 run_corpus_compression(test_parameters_t* test_parameters)
 {
@@ -209,8 +289,34 @@ run_corpus_compression(test_parameters_t* test_parameters)
    int failed=TEST_PASSED;
    int windowbits;
    unsigned long totalout = 0;
+   unsigned long calls = 0;
+   unsigned long long start_cycles = 0;
+   unsigned char *capture = NULL;
+   int verify_now = 0;
+   unsigned long long run_start = 0, iter_start = 0;
+   unsigned long long iter_trace = 0, call_trace = 0;
+   unsigned long chunks = 0, pending = 0, chunk = 0;
+   int iter_failed = TEST_PASSED;
+   output_sink_t sink;
+   zalloc_count_t zcount;
+
+   if (test_parameters->outbuf_size) {
+       /* Verified iterations keep a copy of the stream drained to the sink */
+       if (test_parameters->verify) {
+           capture = malloc(test_parameters->output_buflen);
+           if (NULL == capture) {
+               fprintf(stderr, "# FAIL: Could not allocate verify capture buffer.\n");
+               return TEST_FAILED;
+           }
+       }
+       if (TEST_PASSED != tests_sink_open(&sink, test_parameters, test_parameters->output_buflen)) {
+           free(capture);
+           return TEST_FAILED;
+       }
+       start_cycles = rdtsc();
+   }
 
-   windowbits = MAX_WBITS;
+   windowbits = test_parameters->window_bits;
 
    switch(test_parameters->streamtype)
    {
@@ -229,11 +335,16 @@ run_corpus_compression(test_parameters_t* test_parameters)
            break;
    }
 
-   for (i = 0; i < test_parameters->count; i++) {
+   run_start = tests_nsec();
+   for (i = 0; tests_running(test_parameters, i); i++) {
         z_stream strm;
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
+        tests_pace(test_parameters, i, run_start);
+        iter_start = tests_nsec();
+        iter_trace = tests_trace_start(test_parameters->trace);
+        iter_failed = failed;
+        verify_now = tests_verify_due(test_parameters, i);
+        memset(&zcount, 0, sizeof(zcount));
+        tests_zalloc_use(&strm, &zcount);
         strm.next_out = (void *)test_parameters->output_buf;
         strm.avail_out = test_parameters->output_buflen;
         strm.total_out = 0;
@@ -245,22 +356,41 @@ run_corpus_compression(test_parameters_t* test_parameters)
         else
             flush=Z_SYNC_FLUSH;
 
-        ret = deflateInit2(&strm, test_parameters->level, 8, windowbits, 8, 0);
+        call_trace = tests_trace_start(test_parameters->trace_calls);
+        ret = deflateInit2(&strm, test_parameters->level, 8, windowbits,
+                           test_parameters->mem_level, test_parameters->strategy);
+        tests_trace_stop(test_parameters->trace_calls, "deflateInit2", call_trace);
         if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR) {
             failed=TEST_FAILED;
         }
 
-        if (TEST_PASSED == failed) {
+        if (TEST_PASSED == failed && test_parameters->outbuf_size) {
+            ret = compress_bounded(test_parameters, &strm, &sink, flush, &calls,
+                                   verify_now ? capture : NULL,
+                                   test_parameters->output_buflen);
+            if (ret != Z_STREAM_END) {
+                printf("# FAIL: deflate through bounded buffer failed, ret:%d \r\n", ret);
+                failed=TEST_FAILED;
+            }
+        }
+        else if (TEST_PASSED == failed) {
+            chunks = 0;
+            pending = 0;
 	    do {
+                chunk = tests_sizes_next(test_parameters);
                 strm.next_in = (void *)test_parameters->input_buf+strm.total_in;
-                if (strm.total_in+test_parameters->chunksize >= test_parameters->input_buflen) {
+                if (test_parameters->flush_policy != FLUSH_POLICY_OFF)
+                    flush = tests_flush_schedule(test_parameters, &chunks, &pending, chunk);
+                if (strm.total_in+chunk >= test_parameters->input_buflen) {
                     strm.avail_in = test_parameters->input_buflen - strm.total_in;
                     flush = Z_FINISH;
                 }
                 else {
-                    strm.avail_in = test_parameters->chunksize;
+                    strm.avail_in = chunk;
                 }
+                call_trace = tests_trace_start(test_parameters->trace_calls);
                 ret = deflate(&strm, flush);
+                tests_trace_stop(test_parameters->trace_calls, "deflate", call_trace);
                 strm.avail_out = test_parameters->output_buflen - strm.total_out;
             } while (ret == Z_OK);
 
@@ -275,12 +405,34 @@ run_corpus_compression(test_parameters_t* test_parameters)
 
 		totalout = strm.total_out;
 
+        call_trace = tests_trace_start(test_parameters->trace_calls);
         ret = deflateEnd(&strm);
+        tests_trace_stop(test_parameters->trace_calls, "deflateEnd", call_trace);
+        if (zcount.peak > test_parameters->state_bytes)
+            test_parameters->state_bytes = zcount.peak;
         if (ret != Z_OK) {
             printf("# FAIL: deflateEnd failed, ret:%d \r\n", ret);
             failed=TEST_FAILED;
         }
+        tests_trace_stop(test_parameters->trace, "deflate iteration", iter_trace);
+
+        if (TEST_PASSED == failed)
+            tests_live_op(test_parameters, strm.total_in, totalout, tests_nsec() - iter_start);
+        else if (TEST_PASSED == iter_failed)
+            tests_live_error(test_parameters);
+
+        if (verify_now && TEST_PASSED == failed)
+            failed = tests_verify_stream(test_parameters,
+                                         capture ? capture : test_parameters->output_buf,
+                                         totalout);
+    }
 
+    if (test_parameters->outbuf_size) {
+        tests_sink_report(test_parameters, &sink, "deflate", calls, rdtsc() - start_cycles);
+        tests_sink_close(&sink);
+        free(capture);
+        /* The stream went to the sink, output_buf only holds its tail */
+        return failed;
     }
 
     /* Update the compressed length, so it can be properly decompressed... */
@@ -293,90 +445,8 @@ run_corpus_compression(test_parameters_t* test_parameters)
 int
 shutdown_corpus_compression(test_parameters_t* test_parameters)
 {
-    z_stream strm;
-    int ret = 0;
-    int failed=TEST_PASSED;
-    int flush;
-    int windowbits;
-    unsigned long verify_checksum = 0;
-
+    /* The output was verified while running, see tests_verify_stream */
     if (test_parameters->input_buf) {
-        if (test_parameters->verify) {
-            windowbits = MAX_WBITS;
-
-            switch(test_parameters->streamtype)
-            {
-                case RAW_DEFLATE_STREAM:
-                    windowbits = -windowbits;
-                break;
-                case ZLIB_DEFLATE_STREAM:
-                    /* Do nothing windowbits is correct */
-                break;
-                case GZIP_DEFLATE_STREAM:
-                    windowbits += 16;
-                break;
-                default:
-                    /* Default to gzip encoding */
-                    windowbits += 16;
-                break;
-            }
-
-            ret = Z_OK;
-            strm.zalloc = Z_NULL;
-            strm.zfree = Z_NULL;
-            strm.opaque = Z_NULL;
-            /* Note: Input buffer and Output Buffer are swapped over for the decompression. */
-            strm.next_out = (void *)test_parameters->input_buf;
-            /* Add one hundred to strm.avail_out to work around the fact that for performance timings
-               we are not emptying the buffer we decompress to (input buffer in this
-               case) */
-            strm.avail_out = test_parameters->input_buflen+100;
-            strm.total_out = 0;
-
-            /* Set the flush flag according to command line parameter..
-             * default value is to buffer within zlib shim */
-            if (test_parameters->enable_inflate_buffering)
-                flush=Z_NO_FLUSH;
-            else
-                flush=Z_SYNC_FLUSH;
-
-            ret = inflateInit2(&strm, windowbits);
-            if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR) {
-                fprintf(stderr,"# FAIL: deflate stream corrupt on Inflate init\n");
-                failed = TEST_FAILED;
-            }
-            strm.next_in = (void *)test_parameters->output_buf;
-            strm.avail_in = test_parameters->output_buflen;
-            if (TEST_PASSED == failed) {
-                do {
-                    strm.next_in = (void *)test_parameters->output_buf+strm.total_in;
-                    if (strm.total_in+test_parameters->chunksize >= test_parameters->output_buflen) {
-                        strm.avail_in = test_parameters->output_buflen - strm.total_in;
-                        flush = Z_FINISH;
-                    }
-                    else {
-                        strm.avail_in = test_parameters->chunksize;
-                    }
-                    ret = inflate(&strm, flush);
-                } while (ret == Z_OK);
-
-                if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR) {
-                   fprintf(stderr,"# FAIL: deflate stream corrupt on Inflate\n");
-                   failed = TEST_FAILED;
-                }
-            }
-            inflateEnd(&strm);
-
-            verify_checksum = crc32(0, test_parameters->input_buf, (uInt)test_parameters->input_buflen);
-            if (test_parameters->verify_checksum == verify_checksum && TEST_PASSED == failed) {
-                fprintf(stderr, "\nVerification: PASS\n\n");
-            }
-            else {
-                fprintf(stderr, "\nVerification: FAIL\n\n");
-                failed = TEST_FAILED;
-            }
-        }
-
         free(test_parameters->input_buf);
         test_parameters->input_buf = NULL;
         test_parameters->input_buflen = 0;
@@ -386,7 +456,7 @@ shutdown_corpus_compression(test_parameters_t* test_parameters)
         test_parameters->output_buf = NULL;
         test_parameters->output_buflen = 0;
     }
-    return failed;
+    return TEST_PASSED;
 }
 
 
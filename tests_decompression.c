@@ -86,7 +86,7 @@ startup_corpus_decompression(test_parameters_t* test_parameters)
             break;
     }
 
-    windowbits = MAX_WBITS; 
+    windowbits = test_parameters->window_bits; 
    
     switch(test_parameters->streamtype)
     {
@@ -242,7 +242,8 @@ startup_corpus_decompression(test_parameters_t* test_parameters)
         flush=Z_SYNC_FLUSH;
     }
 
-    ret = deflateInit2(&strm, test_parameters->level, 8, windowbits, 8, 0);
+    ret = deflateInit2(&strm, test_parameters->level, 8, windowbits,
+                       test_parameters->mem_level, test_parameters->strategy);
     if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR) {
         fprintf(stderr, "# FAIL: deflate stream corrupt\n");
         failed=TEST_FAILED;
@@ -276,6 +277,78 @@ startup_corpus_decompression(test_parameters_t* test_parameters)
 
 
 
+/******************************************************************************
+* function:
+*     decompress_bounded (test_parameters_t* test_parameters,
+*                         z_stream *strm,
+*                         output_sink_t *sink,
+*                         unsigned char *outbuf,
+*                         int flush,
+*                         unsigned long *calls,
+*                         unsigned char *capture)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+* @param strm            [IN] - initialised inflate stream
+* @param sink            [IN] - sink the output buffer is drained to
+* @param outbuf          [IN] - output buffer of outbuf_size bytes
+* @param flush           [IN] - flush value used for all but the last chunk
+* @param calls           [OUT] - incremented for every inflate call
+* @param capture         [OUT] - when not NULL the whole output is also copied
+*                                here, it must hold input_buflen+100 bytes
+*
+* description:
+*   decompress the compressed buffer into a bounded output buffer that is
+*   drained to the sink every time inflate returns, calling inflate again
+*   for as long as it fills the buffer.
+******************************************************************************/
+static int
+decompress_bounded(test_parameters_t* test_parameters, z_stream *strm,
+                   output_sink_t *sink, unsigned char *outbuf, int flush,
+                   unsigned long *calls, unsigned char *capture)
+{
+    int ret = Z_OK;
+    unsigned long have = 0, chunk = 0;
+
+    tests_sink_rewind(sink);
+    do {
+        if (strm->total_in >= test_parameters->output_buflen)
+            return Z_DATA_ERROR;
+
+        chunk = tests_sizes_next(test_parameters);
+        strm->next_in = (void *)test_parameters->output_buf+strm->total_in;
+        if (strm->total_in+chunk >= test_parameters->output_buflen) {
+            strm->avail_in = test_parameters->output_buflen - strm->total_in;
+            flush = Z_FINISH;
+        }
+        else {
+            strm->avail_in = chunk;
+        }
+
+        do {
+            strm->next_out = outbuf;
+            strm->avail_out = test_parameters->outbuf_size;
+            ret = inflate(strm, flush);
+            (*calls)++;
+            if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR ||
+                ret == Z_NEED_DICT || ret == Z_MEM_ERROR)
+                return ret;
+
+            have = test_parameters->outbuf_size - strm->avail_out;
+            if (have > 0 && TEST_PASSED != tests_sink_drain(sink, outbuf, have))
+                return Z_ERRNO;
+            if (capture && have > 0) {
+                if (strm->total_out > test_parameters->input_buflen + 100)
+                    return Z_BUF_ERROR;
+                memcpy(capture + strm->total_out - have, outbuf, have);
+            }
+        } while (strm->avail_out == 0 && ret != Z_STREAM_END);
+    } while (ret != Z_STREAM_END);
+
+    return ret;
+}
+
+
+
 int
 run_corpus_decompression(test_parameters_t* test_parameters)
 {
@@ -285,8 +358,39 @@ run_corpus_decompression(test_parameters_t* test_parameters)
     int failed=TEST_PASSED;
     int flush;
     int windowbits;
+    unsigned long calls = 0, chunk = 0;
+    unsigned long long start_cycles = 0;
+    unsigned char *outbuf = NULL;
+    unsigned char *verify_out = NULL;
+    unsigned char *window = NULL;
+    zalloc_count_t zcount;
+    unsigned long long run_start = 0, iter_start = 0;
+    unsigned long long iter_trace = 0, call_trace = 0;
+    int iter_failed = TEST_PASSED;
+    output_sink_t sink;
+
+    if (test_parameters->outbuf_size) {
+        outbuf = malloc(test_parameters->outbuf_size);
+        if (NULL == outbuf) {
+            fprintf(stderr, "# FAIL: Could not allocate output buffer.\n");
+            return TEST_FAILED;
+        }
+        if (TEST_PASSED != tests_sink_open(&sink, test_parameters, test_parameters->input_buflen)) {
+            free(outbuf);
+            return TEST_FAILED;
+        }
+        start_cycles = rdtsc();
+    }
+
+    if (INFLATE_ENGINE_BACK == test_parameters->inflate_engine) {
+        window = malloc(1 << MAX_WBITS);
+        if (NULL == window) {
+            fprintf(stderr, "# FAIL: Could not allocate inflateBack window.\n");
+            return TEST_FAILED;
+        }
+    }
 
-    windowbits = MAX_WBITS; 
+    windowbits = test_parameters->window_bits; 
    
     switch(test_parameters->streamtype)
     {
@@ -305,13 +409,29 @@ run_corpus_decompression(test_parameters_t* test_parameters)
             break;
     }
 
-    for (i = 0; i < test_parameters->count; i++) {
+    run_start = tests_nsec();
+    for (i = 0; tests_running(test_parameters, i); i++) {
+        tests_pace(test_parameters, i, run_start);
+        iter_start = tests_nsec();
+        iter_trace = tests_trace_start(test_parameters->trace);
+        iter_failed = failed;
         ret = Z_OK;
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
+        /* A verified iteration decompresses into a cleared buffer of its
+           own, input_buf already holds the expected data */
+        verify_out = NULL;
+        if (tests_verify_due(test_parameters, i)) {
+            verify_out = tests_verify_buffer(test_parameters);
+            if (NULL == verify_out) {
+                failed = TEST_FAILED;
+                break;
+            }
+        }
+        memset(&zcount, 0, sizeof(zcount));
+        tests_zalloc_use(&strm, &zcount);
         /* Note: Input buffer and Output Buffer are swapped over for the decompression. */
         strm.next_out = (void *)test_parameters->input_buf;
+        if (verify_out && !outbuf)
+            strm.next_out = verify_out;
         /* Add one hundred to strm.avail_out to work around the fact that for performance timings
            we are not emptying the buffer we decompress to (input buffer in this
            case) */
@@ -325,24 +445,54 @@ run_corpus_decompression(test_parameters_t* test_parameters)
 	else
 	    flush=Z_SYNC_FLUSH;
         
-        ret = inflateInit2(&strm, windowbits);
-        if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR) {
-            fprintf(stderr,"# FAIL: deflate stream corrupt on Inflate init\n");
-            failed = TEST_FAILED;
+        if (window) {
+            /* inflateBack sets up and ends its stream itself */
+            call_trace = tests_trace_start(test_parameters->trace_calls);
+            ret = tests_inflate_back(&strm, window, test_parameters->output_buf,
+                                     test_parameters->output_buflen, test_parameters->streamtype,
+                                     test_parameters->chunksize, strm.next_out, strm.avail_out);
+            tests_trace_stop(test_parameters->trace_calls, "inflateBack", call_trace);
+            if (ret != Z_STREAM_END) {
+                fprintf(stderr,"# FAIL: inflateBack failed, ret:%d\n", ret);
+                failed = TEST_FAILED;
+            }
+        }
+        else {
+            call_trace = tests_trace_start(test_parameters->trace_calls);
+            ret = inflateInit2(&strm, windowbits);
+            tests_trace_stop(test_parameters->trace_calls, "inflateInit2", call_trace);
+            if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR) {
+                fprintf(stderr,"# FAIL: deflate stream corrupt on Inflate init\n");
+                failed = TEST_FAILED;
+            }
         }
         strm.next_in = (void *)test_parameters->output_buf;
         strm.avail_in = test_parameters->output_buflen;
-        if (TEST_PASSED == failed) { 
+        if (window) {
+            /* decompressed above */
+        }
+        else if (TEST_PASSED == failed && outbuf) {
+            ret = decompress_bounded(test_parameters, &strm, &sink, outbuf, flush, &calls,
+                                     verify_out);
+            if (ret != Z_STREAM_END) {
+                fprintf(stderr,"# FAIL: inflate through bounded buffer failed, ret:%d\n", ret);
+                failed = TEST_FAILED;
+            }
+        }
+        else if (TEST_PASSED == failed) { 
             do {
+                chunk = tests_sizes_next(test_parameters);
                 strm.next_in = (void *)test_parameters->output_buf+strm.total_in;
-                if (strm.total_in+test_parameters->chunksize >= test_parameters->output_buflen) {
+                if (strm.total_in+chunk >= test_parameters->output_buflen) {
                     strm.avail_in = test_parameters->output_buflen - strm.total_in;
                     flush = Z_FINISH;
                 }
                 else {
-                    strm.avail_in = test_parameters->chunksize;
+                    strm.avail_in = chunk;
                 }
+                call_trace = tests_trace_start(test_parameters->trace_calls);
                 ret = inflate(&strm, flush);
+                tests_trace_stop(test_parameters->trace_calls, "inflate", call_trace);
             } while (ret == Z_OK);
 
             if (ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR) {
@@ -353,8 +503,30 @@ run_corpus_decompression(test_parameters_t* test_parameters)
 
         test_parameters->single_call_bytes = strm.total_out;
         test_parameters->ratio = (float)strm.total_out / strm.total_in;
-        inflateEnd(&strm);
+        if (!window) {
+            call_trace = tests_trace_start(test_parameters->trace_calls);
+            inflateEnd(&strm);
+            tests_trace_stop(test_parameters->trace_calls, "inflateEnd", call_trace);
+            if (zcount.peak > test_parameters->state_bytes)
+                test_parameters->state_bytes = zcount.peak;
+        }
+        tests_trace_stop(test_parameters->trace, "inflate iteration", iter_trace);
+
+        if (TEST_PASSED == failed)
+            tests_live_op(test_parameters, strm.total_in, strm.total_out, tests_nsec() - iter_start);
+        else if (TEST_PASSED == iter_failed)
+            tests_live_error(test_parameters);
+
+        if (verify_out && TEST_PASSED == failed)
+            failed = tests_verify_data(test_parameters, verify_out, strm.total_out);
+    }
+
+    if (outbuf) {
+        tests_sink_report(test_parameters, &sink, "inflate", calls, rdtsc() - start_cycles);
+        tests_sink_close(&sink);
+        free(outbuf);
     }
+    free(window);
     return failed;
 }
 
@@ -363,20 +535,17 @@ run_corpus_decompression(test_parameters_t* test_parameters)
 int
 shutdown_corpus_decompression(test_parameters_t* test_parameters)
 {
-    unsigned long verify_checksum = 0;
     int failed=TEST_PASSED;
 
+    /* The engine comparison runs once the timed run is over, and only from
+       one thread so the threads do not skew each other's timings */
+    if (TEST_CORPUS_DECOMPRESSION == test_parameters->type &&
+        INFLATE_ENGINE_BACK == test_parameters->inflate_engine &&
+        0 == test_parameters->id && test_parameters->input_buf)
+        failed = tests_inflate_back_compare(test_parameters);
+
+    /* The output was verified while running, see tests_verify_data */
     if (test_parameters->input_buf) {
-        if (test_parameters->verify) {
-            verify_checksum = crc32(0, test_parameters->input_buf, (uInt)test_parameters->input_buflen);
-            if (test_parameters->verify_checksum == verify_checksum) {
-                fprintf(stderr, "\nVerification: PASS\n\n");
-            }
-            else {
-                fprintf(stderr, "\nVerification: FAIL\n\n");
-                failed = TEST_FAILED;
-            }
-        }
         free(test_parameters->input_buf);
         test_parameters->input_buf = NULL;
         test_parameters->input_buflen = 0;
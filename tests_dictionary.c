@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* Size of the trained dictionary, the largest preset dictionary a 32K
+   window can make use of */
+#define DICT_SIZE               32768
+/* Length of the substrings counted when training */
+#define DICT_GRAM               8
+/* Length of the corpus segments the dictionary is assembled from */
+#define DICT_SEGMENT            64
+#define DICT_HASH_BITS          20
+/* Training only samples a DICT_SAMPLE_BLOCK sized block out of every
+   DICT_SAMPLE_STRIDE bytes of the corpus, the messages are taken from the
+   rest so none is compressed with a dictionary made of its own bytes */
+#define DICT_SAMPLE_BLOCK       16384
+#define DICT_SAMPLE_STRIDE      65536
+/* Upper bound of messages compressed per message size and iteration */
+#define DICT_MAX_MESSAGES       4096
+
+static const unsigned int dict_message_sizes[] =
+{
+    256, 512, 1024, 2048, 4096, 8192
+};
+
+#define DICT_NUM_SIZES (sizeof(dict_message_sizes)/sizeof(dict_message_sizes[0]))
+
+typedef struct
+{
+    unsigned long offset;
+    unsigned long score;
+}
+dict_segment_t;
+
+typedef struct
+{
+    unsigned long messages;
+    unsigned long bytes;
+    unsigned long plain_out;
+    unsigned long dict_out;
+    unsigned long long plain_deflate_ns;
+    unsigned long long dict_deflate_ns;
+    unsigned long long plain_inflate_ns;
+    unsigned long long dict_inflate_ns;
+    unsigned long long deflate_setdict_cycles;
+    unsigned long long inflate_setdict_cycles;
+}
+dict_result_t;
+
+
+static unsigned int
+dict_hash(const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+    return (unsigned int)((v * 0x9E3779B97F4A7C15ULL) >> (64 - DICT_HASH_BITS));
+}
+
+static unsigned long
+dict_score(const unsigned int *counts, const unsigned char *segment)
+{
+    unsigned long score = 0;
+    int p;
+
+    for (p = 0; p + DICT_GRAM <= DICT_SEGMENT; p++)
+        score += counts[dict_hash(segment + p)];
+
+    return score;
+}
+
+/* Number of messages of size bytes the corpus holds outside the blocks
+   training samples */
+static unsigned long
+dict_messages(unsigned long len, unsigned int size)
+{
+    unsigned long per = (DICT_SAMPLE_STRIDE - DICT_SAMPLE_BLOCK) / size;
+    unsigned long full = len / DICT_SAMPLE_STRIDE;
+    unsigned long tail = len - full * DICT_SAMPLE_STRIDE;
+    unsigned long count = full * per;
+
+    if (tail > DICT_SAMPLE_BLOCK)
+        count += (tail - DICT_SAMPLE_BLOCK) / size;
+    return count;
+}
+
+/* Offset of message m of size bytes, the messages follow the sampled block
+   of every stride one after the other */
+static unsigned long
+dict_message_offset(unsigned long m, unsigned int size)
+{
+    unsigned long per = (DICT_SAMPLE_STRIDE - DICT_SAMPLE_BLOCK) / size;
+
+    return (m / per) * DICT_SAMPLE_STRIDE + DICT_SAMPLE_BLOCK + (m % per) * size;
+}
+
+static int
+dict_segment_compare(const void *a, const void *b)
+{
+    const dict_segment_t *sa = a;
+    const dict_segment_t *sb = b;
+
+    if (sa->score == sb->score)
+        return (sa->offset < sb->offset) ? -1 : (sa->offset > sb->offset);
+    return (sa->score > sb->score) ? -1 : 1;
+}
+
+/******************************************************************************
+* function:
+*     train_dictionary (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               the dictionary and its length are set within
+*                               this function.
+*
+* description:
+*   build a preset dictionary of up to DICT_SIZE bytes. Substrings of the
+*   sampled corpus are counted, the sampled segments are ranked by how common
+*   their substrings are and the best ones are copied into the dictionary.
+*   The highest ranked segments are placed at the end of the dictionary where
+*   matches against them are the cheapest to encode.
+******************************************************************************/
+static int
+train_dictionary(test_parameters_t* test_parameters)
+{
+    unsigned int *counts = NULL;
+    dict_segment_t *segments = NULL;
+    unsigned char *dict = NULL;
+    unsigned long numSegments = 0, block = 0, end = 0, p = 0, i = 0;
+    unsigned long fill = DICT_SIZE;
+    unsigned long score = 0;
+    const unsigned char *in = test_parameters->input_buf;
+
+    counts = calloc(1 << DICT_HASH_BITS, sizeof(unsigned int));
+    segments = malloc(((test_parameters->input_buflen / DICT_SEGMENT) + 1) * sizeof(dict_segment_t));
+    dict = malloc(DICT_SIZE);
+    if (NULL == counts || NULL == segments || NULL == dict) {
+        fprintf(stderr, "# FAIL: Could not allocate space for dictionary training.\n");
+        free(counts);
+        free(segments);
+        free(dict);
+        return TEST_FAILED;
+    }
+
+    /* Count the substrings of the sample */
+    for (block = 0; block < test_parameters->input_buflen; block += DICT_SAMPLE_STRIDE) {
+        end = block + DICT_SAMPLE_BLOCK;
+        if (end > test_parameters->input_buflen)
+            end = test_parameters->input_buflen;
+        for (p = block; p + DICT_GRAM <= end; p++)
+            counts[dict_hash(in + p)]++;
+    }
+
+    /* Rank the segments of the sample */
+    for (block = 0; block < test_parameters->input_buflen; block += DICT_SAMPLE_STRIDE) {
+        end = block + DICT_SAMPLE_BLOCK;
+        if (end > test_parameters->input_buflen)
+            end = test_parameters->input_buflen;
+        for (p = block; p + DICT_SEGMENT <= end; p += DICT_SEGMENT) {
+            segments[numSegments].offset = p;
+            segments[numSegments].score = dict_score(counts, in + p);
+            numSegments++;
+        }
+    }
+    qsort(segments, numSegments, sizeof(dict_segment_t), dict_segment_compare);
+
+    /* Take the best segments. Substrings already in the dictionary have
+       their count cleared so repeated content is only added once, a segment
+       whose substrings mostly occur once is not worth adding at all. */
+    for (i = 0; i < numSegments && fill >= DICT_SEGMENT; i++) {
+        score = dict_score(counts, in + segments[i].offset);
+        if ((score * 2 < segments[i].score) ||
+            (score <= DICT_SEGMENT - DICT_GRAM + 1))
+            continue;
+
+        fill -= DICT_SEGMENT;
+        memcpy(dict + fill, in + segments[i].offset, DICT_SEGMENT);
+        for (p = 0; p + DICT_GRAM <= DICT_SEGMENT; p++)
+            counts[dict_hash(in + segments[i].offset + p)] = 0;
+    }
+
+    if (fill > 0)
+        memmove(dict, dict + fill, DICT_SIZE - fill);
+
+    test_parameters->dictionary = dict;
+    test_parameters->dictionary_len = DICT_SIZE - fill;
+
+    free(counts);
+    free(segments);
+    return TEST_PASSED;
+}
+
+
+
+int
+startup_corpus_dictionary(test_parameters_t* test_parameters)
+{
+    unsigned long long start = 0;
+
+    test_parameters->dictionary = NULL;
+    test_parameters->dictionary_len = 0;
+
+    if (TEST_PASSED != tests_startup_corpus_compression(test_parameters))
+        return TEST_FAILED;
+
+    if (GZIP_DEFLATE_STREAM == test_parameters->streamtype && 0 == test_parameters->id) {
+        printf("Gzip streams can not carry a preset dictionary, "
+               "using raw deflate streams for the dictionary test\n");
+    }
+
+    if (0 == dict_messages(test_parameters->input_buflen, dict_message_sizes[0])) {
+        fprintf(stderr, "# FAIL: corpus of %lu bytes leaves no messages outside the "
+                "training sample.\n", test_parameters->input_buflen);
+        return TEST_FAILED;
+    }
+
+    start = tests_nsec();
+    if (TEST_PASSED != train_dictionary(test_parameters))
+        return TEST_FAILED;
+
+    if (0 == test_parameters->id) {
+        printf("Trained %u byte dictionary in %.3f msec\n",
+               test_parameters->dictionary_len,
+               (float)(tests_nsec() - start) / 1000000);
+    }
+
+    return TEST_PASSED;
+}
+
+
+
+static void
+print_dictionary_results(test_parameters_t* test_parameters, dict_result_t *results)
+{
+    unsigned int s;
+    dict_result_t *r;
+
+    flockfile(stdout);
+    printf("\nThread %d dictionary results (%u byte dictionary):\n",
+           test_parameters->id, test_parameters->dictionary_len);
+    printf("%8s %8s %10s %10s %13s %13s %13s %13s %12s %12s\n",
+           "Msg_size", "Messages", "Ratio", "Ratio_dict",
+           "Deflate_MB/s", "Def_dict_MB/s", "Inflate_MB/s", "Inf_dict_MB/s",
+           "Set_dict_cyc", "Inf_dict_cyc");
+    for (s = 0; s < DICT_NUM_SIZES; s++) {
+        r = &results[s];
+        if (0 == r->messages)
+            continue;
+        printf("%8u %8lu %10.3f %10.3f %13.2f %13.2f %13.2f %13.2f %12llu %12llu\n",
+               dict_message_sizes[s],
+               r->messages,
+               (float)r->plain_out / r->bytes,
+               (float)r->dict_out / r->bytes,
+               (double)r->bytes * 1000 / (r->plain_deflate_ns + 1),
+               (double)r->bytes * 1000 / (r->dict_deflate_ns + 1),
+               (double)r->bytes * 1000 / (r->plain_inflate_ns + 1),
+               (double)r->bytes * 1000 / (r->dict_inflate_ns + 1),
+               r->deflate_setdict_cycles / r->messages,
+               r->inflate_setdict_cycles / r->messages);
+    }
+    funlockfile(stdout);
+}
+
+
+
+int
+run_corpus_dictionary(test_parameters_t* test_parameters)
+{
+    z_stream dstrm;
+    z_stream istrm;
+    int ret = 0;
+    int i = 0;
+    int use_dict = 0;
+    int failed = TEST_PASSED;
+    int windowbits;
+    unsigned int s = 0, size = 0;
+    unsigned long m = 0, numMessages = 0, stride = 0, clen = 0;
+    unsigned long cbuflen = 0;
+    unsigned long total_in = 0, total_out = 0;
+    unsigned long long t0 = 0, t1 = 0, t2 = 0, c0 = 0;
+    unsigned char *msg = NULL;
+    unsigned char *cbuf = NULL;
+    unsigned char *dbuf = NULL;
+    dict_result_t results[DICT_NUM_SIZES];
+
+    memset(results, 0, sizeof(results));
+
+    /* The gzip wrapper has no way to signal a preset dictionary */
+    if (GZIP_DEFLATE_STREAM == test_parameters->streamtype)
+        windowbits = tests_window_bits(RAW_DEFLATE_STREAM, MAX_WBITS);
+    else
+        windowbits = tests_window_bits(test_parameters->streamtype, MAX_WBITS);
+
+    size = dict_message_sizes[DICT_NUM_SIZES - 1];
+    cbuflen = ((size * 9) / 8) + 64;
+    cbuf = malloc(cbuflen);
+    dbuf = malloc(size);
+    if (NULL == cbuf || NULL == dbuf) {
+        fprintf(stderr, "# FAIL: Could not allocate message buffers.\n");
+        free(cbuf);
+        free(dbuf);
+        return TEST_FAILED;
+    }
+
+    dstrm.zalloc = Z_NULL;
+    dstrm.zfree = Z_NULL;
+    dstrm.opaque = Z_NULL;
+    istrm.zalloc = Z_NULL;
+    istrm.zfree = Z_NULL;
+    istrm.opaque = Z_NULL;
+    istrm.next_in = Z_NULL;
+    istrm.avail_in = 0;
+
+    ret = deflateInit2(&dstrm, test_parameters->level, 8, windowbits,
+                       test_parameters->mem_level, test_parameters->strategy);
+    if (ret != Z_OK) {
+        fprintf(stderr, "# FAIL: deflateInit2 failed, ret:%d\n", ret);
+        free(cbuf);
+        free(dbuf);
+        return TEST_FAILED;
+    }
+    ret = inflateInit2(&istrm, windowbits);
+    if (ret != Z_OK) {
+        fprintf(stderr, "# FAIL: inflateInit2 failed, ret:%d\n", ret);
+        deflateEnd(&dstrm);
+        free(cbuf);
+        free(dbuf);
+        return TEST_FAILED;
+    }
+
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        total_in = 0;
+        total_out = 0;
+
+        for (s = 0; s < DICT_NUM_SIZES && TEST_PASSED == failed; s++) {
+            size = dict_message_sizes[s];
+            numMessages = dict_messages(test_parameters->input_buflen, size);
+            stride = 1;
+            if (numMessages > DICT_MAX_MESSAGES) {
+                stride = numMessages / DICT_MAX_MESSAGES;
+                numMessages = DICT_MAX_MESSAGES;
+            }
+
+            for (m = 0; m < numMessages && TEST_PASSED == failed; m++) {
+                msg = test_parameters->input_buf + dict_message_offset(m * stride, size);
+
+                for (use_dict = 0; use_dict <= 1; use_dict++) {
+                    /* Each message is an independent stream, as it would
+                       be for a single RPC payload */
+                    t0 = tests_nsec();
+                    deflateReset(&dstrm);
+                    if (use_dict) {
+                        c0 = rdtsc();
+                        ret = deflateSetDictionary(&dstrm, test_parameters->dictionary,
+                                                   test_parameters->dictionary_len);
+                        results[s].deflate_setdict_cycles += rdtsc() - c0;
+                        if (ret != Z_OK) {
+                            fprintf(stderr, "# FAIL: deflateSetDictionary failed, ret:%d\n", ret);
+                            failed = TEST_FAILED;
+                            break;
+                        }
+                    }
+                    dstrm.next_in = msg;
+                    dstrm.avail_in = size;
+                    dstrm.next_out = cbuf;
+                    dstrm.avail_out = cbuflen;
+                    ret = deflate(&dstrm, Z_FINISH);
+                    if (ret != Z_STREAM_END) {
+                        fprintf(stderr, "# FAIL: deflate of message failed, ret:%d\n", ret);
+                        failed = TEST_FAILED;
+                        break;
+                    }
+                    clen = cbuflen - dstrm.avail_out;
+                    t1 = tests_nsec();
+
+                    inflateReset(&istrm);
+                    istrm.next_in = cbuf;
+                    istrm.avail_in = clen;
+                    istrm.next_out = dbuf;
+                    istrm.avail_out = size;
+                    if (use_dict && windowbits < 0) {
+                        /* Raw streams need the dictionary up front */
+                        c0 = rdtsc();
+                        ret = inflateSetDictionary(&istrm, test_parameters->dictionary,
+                                                   test_parameters->dictionary_len);
+                        results[s].inflate_setdict_cycles += rdtsc() - c0;
+                        if (ret != Z_OK) {
+                            fprintf(stderr, "# FAIL: inflateSetDictionary failed, ret:%d\n", ret);
+                            failed = TEST_FAILED;
+                            break;
+                        }
+                    }
+                    ret = inflate(&istrm, Z_FINISH);
+                    if (ret == Z_NEED_DICT) {
+                        c0 = rdtsc();
+                        ret = inflateSetDictionary(&istrm, test_parameters->dictionary,
+                                                   test_parameters->dictionary_len);
+                        results[s].inflate_setdict_cycles += rdtsc() - c0;
+                        if (ret == Z_OK)
+                            ret = inflate(&istrm, Z_FINISH);
+                    }
+                    t2 = tests_nsec();
+                    if (ret != Z_STREAM_END || istrm.total_out != size) {
+                        fprintf(stderr, "# FAIL: inflate of message failed, ret:%d\n", ret);
+                        failed = TEST_FAILED;
+                        break;
+                    }
+
+                    if (test_parameters->verify && memcmp(dbuf, msg, size)) {
+                        fprintf(stderr, "\nVerification: FAIL (message of %u bytes)\n\n", size);
+                        failed = TEST_FAILED;
+                        break;
+                    }
+
+                    if (use_dict) {
+                        results[s].dict_out += clen;
+                        results[s].dict_deflate_ns += t1 - t0;
+                        results[s].dict_inflate_ns += t2 - t1;
+                        total_in += size;
+                        total_out += clen;
+                    }
+                    else {
+                        results[s].plain_out += clen;
+                        results[s].plain_deflate_ns += t1 - t0;
+                        results[s].plain_inflate_ns += t2 - t1;
+                    }
+                }
+                results[s].messages++;
+                results[s].bytes += size;
+            }
+        }
+
+        test_parameters->single_call_bytes = total_in;
+        test_parameters->ratio = total_in ? (float)total_out / total_in : 0;
+    }
+
+    deflateEnd(&dstrm);
+    inflateEnd(&istrm);
+    free(cbuf);
+    free(dbuf);
+
+    if (TEST_PASSED == failed)
+        print_dictionary_results(test_parameters, results);
+
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_dictionary(test_parameters_t* test_parameters)
+{
+    if (test_parameters->dictionary) {
+        free(test_parameters->dictionary);
+        test_parameters->dictionary = NULL;
+        test_parameters->dictionary_len = 0;
+    }
+    /* Every message was already compared against the corpus in the run,
+       the whole buffer was never compressed into output_buf */
+    test_parameters->verify = 0;
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_dictionary  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers, the
+*                               dictionary and their lengths will get created/set within this function.
+*
+* description:
+*	setup a dictionary job, loading the corpus and training a preset dictionary from it
+*
+******************************************************************************/
+int
+tests_startup_corpus_dictionary(test_parameters_t* test_parameters)
+{
+   return startup_corpus_dictionary(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_dictionary  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	run a dictionary job where small messages are compressed with and without the preset dictionary
+*
+******************************************************************************/
+int
+tests_run_corpus_dictionary(test_parameters_t* test_parameters)
+{
+    return run_corpus_dictionary(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_dictionary  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the buffers and the dictionary
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a dictionary job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_dictionary(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_dictionary(test_parameters);
+}
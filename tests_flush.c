@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+typedef struct
+{
+    const char *name;
+    int flush;
+}
+flush_policy_t;
+
+static const flush_policy_t flush_policies[] =
+{
+    { "none",    Z_NO_FLUSH },
+    { "partial", Z_PARTIAL_FLUSH },
+    { "sync",    Z_SYNC_FLUSH },
+    { "full",    Z_FULL_FLUSH },
+    { "block",   Z_BLOCK },
+};
+
+#define FLUSH_POLICIES (int)(sizeof(flush_policies) / sizeof(flush_policies[0]))
+
+typedef struct
+{
+    unsigned long long ns;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long last_out;
+    unsigned long streams;
+    unsigned long flushes;
+    unsigned long long call_ns;
+    unsigned long calls;
+    histogram_t flush_latency;
+}
+flush_result_t;
+
+
+
+int
+startup_corpus_flush(test_parameters_t* test_parameters)
+{
+    /* The compression startup leaves room in output_buf for the flushes */
+    return tests_startup_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     flush_stream (test_parameters_t* test_parameters, int windowbits,
+*                   flush_result_t *result)
+*
+* @param test_parameters [IN] - parameters of one worker, flush_policy is the
+*                               policy under test
+* @param windowbits      [IN] - windowBits for deflateInit2
+* @param result          [OUT] - totals of the policy, updated
+*
+* description:
+*   compress the corpus once under the flush schedule, timing each deflate
+*   call on its own so the calls that flush can be told from the others
+******************************************************************************/
+static int
+flush_stream(test_parameters_t* test_parameters, int windowbits, flush_result_t *result)
+{
+    z_stream strm;
+    unsigned long chunks = 0, pending = 0;
+    unsigned long long start = 0, t0 = 0;
+    int flush = Z_NO_FLUSH;
+    int ret = Z_OK;
+
+    memset(&strm, 0, sizeof(strm));
+    start = tests_nsec();
+    ret = deflateInit2(&strm, test_parameters->level, 8, windowbits,
+                       test_parameters->mem_level, test_parameters->strategy);
+    if (ret != Z_OK)
+        return ret;
+
+    strm.next_out = test_parameters->output_buf;
+    strm.avail_out = test_parameters->output_buflen;
+    do {
+        strm.next_in = test_parameters->input_buf + strm.total_in;
+        flush = tests_flush_schedule(test_parameters, &chunks, &pending,
+                                     test_parameters->chunksize);
+        if (strm.total_in + test_parameters->chunksize >= test_parameters->input_buflen) {
+            strm.avail_in = test_parameters->input_buflen - strm.total_in;
+            flush = Z_FINISH;
+        }
+        else {
+            strm.avail_in = test_parameters->chunksize;
+        }
+
+        t0 = tests_nsec();
+        ret = deflate(&strm, flush);
+        t0 = tests_nsec() - t0;
+
+        if (Z_NO_FLUSH == flush) {
+            result->call_ns += t0;
+            result->calls++;
+        }
+        else if (Z_FINISH != flush) {
+            result->flushes++;
+            tests_histogram_add(&result->flush_latency, t0);
+        }
+        strm.avail_out = test_parameters->output_buflen - strm.total_out;
+    } while (ret == Z_OK);
+
+    deflateEnd(&strm);
+    if (ret != Z_STREAM_END)
+        return ret == Z_OK ? Z_BUF_ERROR : ret;
+
+    result->ns += tests_nsec() - start;
+    result->bytes_in += strm.total_in;
+    result->bytes_out += strm.total_out;
+    result->last_out = strm.total_out;
+    result->streams++;
+    tests_live_op(test_parameters, strm.total_in, strm.total_out, tests_nsec() - start);
+    return Z_OK;
+}
+
+
+
+int
+run_corpus_flush(test_parameters_t* test_parameters)
+{
+    flush_result_t results[FLUSH_POLICIES];
+    flush_result_t *r, *base = &results[0];
+    int policy = test_parameters->flush_policy;
+    int windowbits = tests_window_bits(test_parameters->streamtype,
+                                       test_parameters->window_bits);
+    double ratio = 0, base_ratio = 0, mbps = 0, base_mbps = 0;
+    unsigned long long bytes_in = 0, bytes_out = 0;
+    int failed = TEST_PASSED;
+    int i, p, ret;
+
+    memset(results, 0, sizeof(results));
+    for (p = 0; p < FLUSH_POLICIES; p++)
+        tests_histogram_init(&results[p].flush_latency);
+
+    /* The policies take turns within every iteration so a change in the
+       machine over the run is shared between them */
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        for (p = 0; p < FLUSH_POLICIES && TEST_PASSED == failed; p++) {
+            test_parameters->flush_policy = flush_policies[p].flush;
+            ret = flush_stream(test_parameters, windowbits, &results[p]);
+            if (ret != Z_OK) {
+                fprintf(stderr, "# FAIL: deflate with %s flushes failed, ret:%d\n",
+                        flush_policies[p].name, ret);
+                tests_live_error(test_parameters);
+                failed = TEST_FAILED;
+            }
+            else if (tests_verify_due(test_parameters, i)) {
+                failed = tests_verify_stream(test_parameters, test_parameters->output_buf,
+                                             results[p].last_out);
+            }
+        }
+    }
+    test_parameters->flush_policy = policy;
+
+    if (TEST_PASSED != failed || 0 == base->streams)
+        return failed;
+
+    base_ratio = (double)base->bytes_out / base->bytes_in;
+    base_mbps = (double)base->bytes_in * 8 * 1000 / base->ns;
+
+    flockfile(stdout);
+    printf("\nThread %d flush policies, a flush every %lu %s (chunk %d bytes):\n",
+           test_parameters->id, test_parameters->flush_every,
+           test_parameters->flush_bytes ? "bytes" : "chunks", test_parameters->chunksize);
+    printf("%8s %10s %8s %10s %10s %10s %10s %10s %10s\n", "Policy", "Flushes",
+           "Ratio", "Ratio_%", "Mbps", "Tput_%", "Flush_p50", "Flush_p99", "Call_us");
+    for (p = 0; p < FLUSH_POLICIES; p++) {
+        r = &results[p];
+        ratio = (double)r->bytes_out / r->bytes_in;
+        mbps = (double)r->bytes_in * 8 * 1000 / r->ns;
+        printf("%8s %10.1f %8.4f %+10.2f %10.2f %+10.2f %10.1f %10.1f %10.1f\n",
+               flush_policies[p].name, (double)r->flushes / r->streams, ratio,
+               (ratio - base_ratio) * 100 / base_ratio, mbps,
+               (mbps - base_mbps) * 100 / base_mbps,
+               (double)tests_histogram_percentile(&r->flush_latency, 50) / 1000,
+               (double)tests_histogram_percentile(&r->flush_latency, 99) / 1000,
+               r->calls ? (double)r->call_ns / r->calls / 1000 : 0);
+        bytes_in += r->bytes_in;
+        bytes_out += r->bytes_out;
+    }
+    printf("Ratio_%% and Tput_%% are against no flushes, flush latencies and Call_us "
+           "(calls without a flush) in usec\n");
+    funlockfile(stdout);
+
+    /* An operation compresses the corpus once under every policy */
+    test_parameters->single_call_bytes = test_parameters->input_buflen * FLUSH_POLICIES;
+    test_parameters->ratio = (float)bytes_out / bytes_in;
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_flush(test_parameters_t* test_parameters)
+{
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_flush  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a flush policy job
+*
+******************************************************************************/
+int
+tests_startup_corpus_flush(test_parameters_t* test_parameters)
+{
+   return startup_corpus_flush(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_flush  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	compare the flush policies at the -flush interval
+*
+******************************************************************************/
+int
+tests_run_corpus_flush(test_parameters_t* test_parameters)
+{
+    return run_corpus_flush(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_flush  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a flush policy job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_flush(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_flush(test_parameters);
+}
@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/perf_event.h>
+#include "tests.h"
+
+#define FREQ_SYSFS_CPU          "/sys/devices/system/cpu/cpu%d/"
+#define FREQ_MSR_PMU            "/sys/bus/event_source/devices/msr/"
+
+/* A worker core whose clock stays more than this far under nominal is
+   reported as throttled */
+#define FREQ_THROTTLE_PERCENT   90
+
+/******************************************************************************
+* function:
+*     freq_read_ulong (const char *fmt, int cpu, unsigned long long *value)
+*
+* @param fmt   [IN] - path of the file with a %d for the cpu
+* @param cpu   [IN] - cpu number
+* @param value [OUT] - number the file starts with
+*
+* description:
+*   read a sysfs number of one cpu, returns 0 or -1 when it is not there
+******************************************************************************/
+static int freq_read_ulong(const char *fmt, int cpu, unsigned long long *value)
+{
+    char path[256];
+    FILE *f;
+    int ok;
+
+    snprintf(path, sizeof(path), fmt, cpu);
+    f = fopen(path, "r");
+    if (NULL == f)
+        return -1;
+    ok = fscanf(f, "%llu", value) == 1;
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/* Thermal throttle events of a cpu, its core and its package counted */
+static int freq_read_throttle(int cpu, unsigned long long *count)
+{
+    unsigned long long core = 0, package = 0;
+
+    if (freq_read_ulong(FREQ_SYSFS_CPU "thermal_throttle/core_throttle_count", cpu, &core) != 0)
+        return -1;
+    freq_read_ulong(FREQ_SYSFS_CPU "thermal_throttle/package_throttle_count", cpu, &package);
+    *count = core + package;
+    return 0;
+}
+
+/******************************************************************************
+* function:
+*     freq_msr_open (int cpu, const char *event)
+*
+* @param cpu   [IN] - cpu to count on
+* @param event [IN] - "aperf" or "mperf"
+*
+* description:
+*   returns a perf event counting the event of the msr PMU on the cpu, or -1
+*   where the PMU does not have it or perf_event_paranoid does not let a
+*   user count a whole cpu
+******************************************************************************/
+static int freq_msr_open(int cpu, const char *event)
+{
+    struct perf_event_attr attr;
+    char path[256];
+    unsigned int config = 0;
+    int type = 0;
+    FILE *f;
+
+    f = fopen(FREQ_MSR_PMU "type", "r");
+    if (NULL == f)
+        return -1;
+    if (fscanf(f, "%d", &type) != 1)
+        type = -1;
+    fclose(f);
+
+    snprintf(path, sizeof(path), FREQ_MSR_PMU "events/%s", event);
+    f = fopen(path, "r");
+    if (NULL == f)
+        return -1;
+    if (fscanf(f, "event=%x", &config) != 1)
+        type = -1;
+    fclose(f);
+    if (type < 0)
+        return -1;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    return syscall(SYS_perf_event_open, &attr, -1, cpu, -1, 0);
+}
+
+static unsigned long long freq_msr_read(int fd)
+{
+    unsigned long long count = 0;
+
+    if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+        return 0;
+    return count;
+}
+
+static void freq_add(freq_core_t *core, unsigned long khz)
+{
+    if (0 == khz)
+        return;
+    core->khz_sum += khz;
+    if (0 == core->samples || khz < core->khz_min)
+        core->khz_min = khz;
+    if (khz > core->khz_max)
+        core->khz_max = khz;
+    core->samples++;
+}
+
+/******************************************************************************
+* function:
+*     freq_sample (freq_monitor_t *monitor)
+*
+* @param monitor [IN] - monitor the sample is added to
+*
+* description:
+*   add the current clock of every core, from cpufreq scaling_cur_freq or,
+*   where the kernel has no cpufreq driver (most virtual machines), from
+*   the "cpu MHz" lines of /proc/cpuinfo
+******************************************************************************/
+static void freq_sample(freq_monitor_t *monitor)
+{
+    unsigned long long khz = 0;
+    char line[256];
+    double mhz = 0;
+    int cpu = -1;
+    FILE *f;
+    int i;
+
+    if (NULL == monitor->source)
+        return;
+
+    if (0 == strcmp(monitor->source, "cpufreq")) {
+        for (i = 0; i < monitor->cores; i++)
+            if (freq_read_ulong(FREQ_SYSFS_CPU "cpufreq/scaling_cur_freq", i, &khz) == 0)
+                freq_add(&monitor->core[i], khz);
+        return;
+    }
+
+    f = fopen("/proc/cpuinfo", "r");
+    if (NULL == f)
+        return;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "processor : %d", &cpu) == 1)
+            continue;
+        if (cpu >= 0 && cpu < monitor->cores && sscanf(line, "cpu MHz : %lf", &mhz) == 1)
+            freq_add(&monitor->core[cpu], (unsigned long)(mhz * 1000));
+    }
+    fclose(f);
+}
+
+static void *freq_thread(void *arg)
+{
+    freq_monitor_t *monitor = (freq_monitor_t *)arg;
+    struct timespec interval;
+
+    /* The sampler should not take time away from the workers */
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+    interval.tv_sec = monitor->interval_msec / 1000;
+    interval.tv_nsec = (monitor->interval_msec % 1000) * 1000000L;
+    while (!__atomic_load_n(&monitor->stop, __ATOMIC_RELAXED)) {
+        nanosleep(&interval, NULL);
+        freq_sample(monitor);
+    }
+    return NULL;
+}
+
+/******************************************************************************
+* function:
+*     tests_freq_start (freq_monitor_t *monitor, int interval_msec)
+*
+* @param monitor       [IN] - monitor, its counts are cleared
+* @param interval_msec [IN] - time between two samples
+*
+* description:
+*   open the APERF/MPERF counters of every core where perf gives them, note
+*   the thermal throttle counts and start the thread sampling the clocks.
+*   A monitor can be started again once stopped.
+******************************************************************************/
+int tests_freq_start(freq_monitor_t *monitor, int interval_msec)
+{
+    unsigned long long khz = 0;
+    int i;
+
+    if (NULL == monitor->core) {
+        monitor->cores = sysconf(_SC_NPROCESSORS_CONF);
+        if (monitor->cores < 1)
+            monitor->cores = 1;
+        monitor->core = calloc(monitor->cores, sizeof(freq_core_t));
+        if (NULL == monitor->core) {
+            fprintf(stderr, "# FAIL: could not allocate the frequency monitor\n");
+            return TEST_FAILED;
+        }
+        if (freq_read_ulong(FREQ_SYSFS_CPU "cpufreq/scaling_cur_freq", 0, &khz) == 0)
+            monitor->source = "cpufreq";
+        else if (access("/proc/cpuinfo", R_OK) == 0)
+            monitor->source = "/proc/cpuinfo";
+    }
+
+    monitor->interval_msec = interval_msec;
+    monitor->stop = 0;
+    for (i = 0; i < monitor->cores; i++) {
+        freq_core_t *core = &monitor->core[i];
+
+        memset(core, 0, sizeof(*core));
+        core->aperf_fd = freq_msr_open(i, "aperf");
+        core->mperf_fd = core->aperf_fd >= 0 ? freq_msr_open(i, "mperf") : -1;
+        core->aperf = freq_msr_read(core->aperf_fd);
+        core->mperf = freq_msr_read(core->mperf_fd);
+        if (freq_read_throttle(i, &core->throttle) != 0)
+            core->throttle = FREQ_THROTTLE_UNKNOWN;
+    }
+
+    monitor->tsc_start = rdtsc();
+    monitor->nsec_start = tests_nsec();
+    freq_sample(monitor);
+    if (pthread_create(&monitor->th, NULL, freq_thread, monitor) != 0) {
+        fprintf(stderr, "# FAIL: could not start the frequency monitor thread\n");
+        return TEST_FAILED;
+    }
+    monitor->running = 1;
+    return TEST_PASSED;
+}
+
+/******************************************************************************
+* function:
+*     tests_freq_stop (freq_monitor_t *monitor)
+*
+* @param monitor [IN] - monitor to stop
+*
+* description:
+*   stop the sampling thread and turn the counters into what they counted
+*   since the start
+******************************************************************************/
+void tests_freq_stop(freq_monitor_t *monitor)
+{
+    unsigned long long nsec = 0, throttle = 0;
+    int i;
+
+    if (!monitor->running)
+        return;
+
+    __atomic_store_n(&monitor->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(monitor->th, NULL);
+    monitor->running = 0;
+    freq_sample(monitor);
+
+    /* the TSC ticks at the nominal clock, whatever the cores run at */
+    nsec = tests_nsec() - monitor->nsec_start;
+    monitor->tsc_ghz = nsec ? (double)(rdtsc() - monitor->tsc_start) / nsec : 0;
+
+    for (i = 0; i < monitor->cores; i++) {
+        freq_core_t *core = &monitor->core[i];
+
+        if (core->mperf_fd >= 0) {
+            core->aperf = freq_msr_read(core->aperf_fd) - core->aperf;
+            core->mperf = freq_msr_read(core->mperf_fd) - core->mperf;
+        }
+        else {
+            core->aperf = 0;
+            core->mperf = 0;
+        }
+        if (core->aperf_fd >= 0)
+            close(core->aperf_fd);
+        if (core->mperf_fd >= 0)
+            close(core->mperf_fd);
+        core->aperf_fd = -1;
+        core->mperf_fd = -1;
+
+        if (core->throttle != FREQ_THROTTLE_UNKNOWN) {
+            if (freq_read_throttle(i, &throttle) == 0 && throttle >= core->throttle)
+                core->throttle = throttle - core->throttle;
+            else
+                core->throttle = FREQ_THROTTLE_UNKNOWN;
+        }
+    }
+}
+
+/* Clock of a core while it was busy, from APERF/MPERF, or 0 */
+static double freq_busy_ghz(freq_monitor_t *monitor, freq_core_t *core)
+{
+    return core->mperf ? monitor->tsc_ghz * core->aperf / core->mperf : 0;
+}
+
+/******************************************************************************
+* function:
+*     tests_freq_summary (freq_monitor_t *monitor, const unsigned char *cores,
+*                         double *avg_ghz, double *min_ghz)
+*
+* @param monitor [IN] - stopped monitor
+* @param cores   [IN] - flag per core, set for the cores the workers were
+*                       pinned to, NULL when they were not pinned
+* @param avg_ghz [OUT] - average clock of the worker cores, 0 if unknown
+* @param min_ghz [OUT] - lowest clock sampled on a worker core, 0 if unknown
+*
+* description:
+*   returns 1 when throttling was seen on a worker core: a thermal throttle
+*   event, a busy clock (APERF/MPERF) under nominal, or for pinned workers
+*   a sampled clock under nominal. Sampled clocks of cores that are not
+*   known to have run a worker are not held against the run as an idle
+*   core is clocked down by design.
+******************************************************************************/
+int tests_freq_summary(freq_monitor_t *monitor, const unsigned char *cores,
+                       double *avg_ghz, double *min_ghz)
+{
+    double sum = 0, busy = 0, low = monitor->tsc_ghz * FREQ_THROTTLE_PERCENT / 100;
+    int counted = 0, throttled = 0;
+    int i;
+
+    *avg_ghz = 0;
+    *min_ghz = 0;
+    for (i = 0; i < monitor->cores; i++) {
+        freq_core_t *core = &monitor->core[i];
+
+        if (cores && !cores[i])
+            continue;
+        if (core->throttle != FREQ_THROTTLE_UNKNOWN && core->throttle > 0)
+            throttled = 1;
+        busy = freq_busy_ghz(monitor, core);
+        if (busy > 0 && busy < low)
+            throttled = 1;
+        if (0 == core->samples)
+            continue;
+        /* the busy clock is the better average where there is one */
+        sum += busy > 0 ? busy : (double)core->khz_sum / core->samples / 1e6;
+        if (0 == counted || (double)core->khz_min / 1e6 < *min_ghz)
+            *min_ghz = (double)core->khz_min / 1e6;
+        counted++;
+        if (cores && (double)core->khz_sum / core->samples / 1e6 < low)
+            throttled = 1;
+    }
+    if (counted)
+        *avg_ghz = sum / counted;
+    return throttled;
+}
+
+/******************************************************************************
+* function:
+*     tests_freq_report (freq_monitor_t *monitor, const unsigned char *cores)
+*
+* @param monitor [IN] - stopped monitor
+* @param cores   [IN] - flag per core for the cores the workers were pinned
+*                       to, NULL when they were not pinned
+*
+* description:
+*   print the clock of the worker cores (every core when the workers were
+*   not pinned) and flag a run that was throttled
+******************************************************************************/
+void tests_freq_report(freq_monitor_t *monitor, const unsigned char *cores)
+{
+    double avg = 0, min = 0, busy = 0;
+    int throttled = 0;
+    int i;
+
+    throttled = tests_freq_summary(monitor, cores, &avg, &min);
+
+    printf("\nCPU frequency, sampled from %s every %d msec, nominal %.2f GHz (TSC):\n",
+           monitor->source ? monitor->source : "nothing", monitor->interval_msec,
+           monitor->tsc_ghz);
+    printf("%6s %8s %8s %8s %8s %9s %9s\n", "Core", "Samples", "Avg_GHz",
+           "Min_GHz", "Max_GHz", "Busy_GHz", "Throttle");
+    for (i = 0; i < monitor->cores; i++) {
+        freq_core_t *core = &monitor->core[i];
+
+        if (cores && !cores[i])
+            continue;
+        printf("%6d %8lu", i, core->samples);
+        if (core->samples)
+            printf(" %8.3f %8.3f %8.3f", (double)core->khz_sum / core->samples / 1e6,
+                   (double)core->khz_min / 1e6, (double)core->khz_max / 1e6);
+        else
+            printf(" %8s %8s %8s", "n/a", "n/a", "n/a");
+        busy = freq_busy_ghz(monitor, core);
+        if (busy > 0)
+            printf(" %9.3f", busy);
+        else
+            printf(" %9s", "n/a");
+        if (core->throttle != FREQ_THROTTLE_UNKNOWN)
+            printf(" %9llu\n", core->throttle);
+        else
+            printf(" %9s\n", "n/a");
+    }
+    if (!cores)
+        printf("The workers were not pinned (-af), every core is shown\n");
+
+    if (avg > 0)
+        printf("CPU clock      = %.3f GHz average, %.3f GHz lowest\n", avg, min);
+    else
+        printf("CPU clock      = not readable on this machine\n");
+    if (throttled)
+        printf("# WARNING: CPU throttling detected during the run, the clock fell under "
+               "%d%% of nominal or the thermal throttle count rose\n", FREQ_THROTTLE_PERCENT);
+}
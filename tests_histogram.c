@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tests.h"
+
+/******************************************************************************
+* function:
+*     histogram_bucket (unsigned long long value)
+*
+* @param value [IN] - sample to place
+*
+* description:
+*   values below HIST_SUB_BUCKETS get a bucket each, above that every power
+*   of two is split into HIST_SUB_BUCKETS linear buckets so a bucket is
+*   never wider than 1/HIST_SUB_BUCKETS of its value
+******************************************************************************/
+static int histogram_bucket(unsigned long long value)
+{
+    int msb = 63 - __builtin_clzll(value | 1);
+    int bucket = 0;
+
+    if (value < HIST_SUB_BUCKETS)
+        return (int)value;
+
+    bucket = (msb - HIST_SUB_BITS + 1) * HIST_SUB_BUCKETS +
+             (int)((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+    if (bucket >= HIST_BUCKETS)
+        bucket = HIST_BUCKETS - 1;
+    return bucket;
+}
+
+/* Smallest value that falls in a bucket */
+static unsigned long long histogram_bucket_value(int bucket)
+{
+    int msb = 0;
+
+    if (bucket < HIST_SUB_BUCKETS)
+        return bucket;
+
+    msb = bucket / HIST_SUB_BUCKETS + HIST_SUB_BITS - 1;
+    return (1ULL << msb) |
+           ((unsigned long long)(bucket % HIST_SUB_BUCKETS) << (msb - HIST_SUB_BITS));
+}
+
+void tests_histogram_init(histogram_t *histogram)
+{
+    memset(histogram, 0, sizeof(*histogram));
+    histogram->min = ~0ULL;
+}
+
+void tests_histogram_add(histogram_t *histogram, unsigned long long value)
+{
+    histogram->buckets[histogram_bucket(value)]++;
+    histogram->count++;
+    histogram->sum += value;
+    if (value < histogram->min)
+        histogram->min = value;
+    if (value > histogram->max)
+        histogram->max = value;
+}
+
+void tests_histogram_merge(histogram_t *histogram, const histogram_t *other)
+{
+    int i;
+
+    for (i = 0; i < HIST_BUCKETS; i++)
+        histogram->buckets[i] += other->buckets[i];
+    histogram->count += other->count;
+    histogram->sum += other->sum;
+    if (other->min < histogram->min)
+        histogram->min = other->min;
+    if (other->max > histogram->max)
+        histogram->max = other->max;
+}
+
+/******************************************************************************
+* function:
+*     tests_histogram_percentile (const histogram_t *histogram,
+*                                 double percentile)
+*
+* @param histogram  [IN] - histogram to read
+* @param percentile [IN] - 0 to 100
+*
+* description:
+*   returns the lower bound of the bucket holding the given percentile,
+*   clamped to the smallest and largest values seen
+******************************************************************************/
+unsigned long long tests_histogram_percentile(const histogram_t *histogram,
+                                              double percentile)
+{
+    unsigned long long rank = 0, seen = 0, value = 0;
+    int i;
+
+    if (0 == histogram->count)
+        return 0;
+
+    rank = (unsigned long long)(percentile / 100.0 * histogram->count);
+    if (rank >= histogram->count)
+        rank = histogram->count - 1;
+
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen > rank)
+            break;
+    }
+
+    value = histogram_bucket_value(i < HIST_BUCKETS ? i : HIST_BUCKETS - 1);
+    if (value < histogram->min)
+        value = histogram->min;
+    if (value > histogram->max)
+        value = histogram->max;
+    return value;
+}
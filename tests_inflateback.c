@@ -0,0 +1,389 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* inflateBack needs a window as large as any the stream was made with */
+#define BACK_WINDOW_BITS        15
+
+/* Repeats of each engine, stream type and chunk size in the comparison,
+   the fastest of them is kept */
+#define BACK_COMPARE_REPEATS    3
+
+#define BACK_CHECK_NONE         0
+#define BACK_CHECK_CRC32        1
+#define BACK_CHECK_ADLER32      2
+
+static const char *back_stream_name[] = { "raw", "zlib", "gzip" };
+
+/* Input and output of one inflateBack call, the callbacks hand out the
+   compressed buffer chunk by chunk and copy the output into place */
+typedef struct
+{
+    const unsigned char *in;
+    unsigned long in_len;
+    unsigned long in_pos;
+    unsigned long chunk;
+    unsigned char *out;
+    unsigned long out_len;
+    unsigned long out_pos;
+    int check;
+    unsigned long sum;
+}
+back_io_t;
+
+static unsigned back_in(void *desc, z_const unsigned char **buf)
+{
+    back_io_t *io = (back_io_t *)desc;
+    unsigned long len = io->in_len - io->in_pos;
+
+    if (len > io->chunk)
+        len = io->chunk;
+    *buf = (z_const unsigned char *)io->in + io->in_pos;
+    io->in_pos += len;
+    return (unsigned)len;
+}
+
+static int back_out(void *desc, unsigned char *buf, unsigned len)
+{
+    back_io_t *io = (back_io_t *)desc;
+
+    if (len > io->out_len - io->out_pos)
+        return 1;
+
+    memcpy(io->out + io->out_pos, buf, len);
+    if (BACK_CHECK_CRC32 == io->check)
+        io->sum = crc32(io->sum, buf, len);
+    else if (BACK_CHECK_ADLER32 == io->check)
+        io->sum = adler32(io->sum, buf, len);
+    io->out_pos += len;
+    return 0;
+}
+
+static unsigned long get_le32(const unsigned char *p)
+{
+    return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+           ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static unsigned long get_be32(const unsigned char *p)
+{
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+           ((unsigned long)p[2] << 8) | (unsigned long)p[3];
+}
+
+/* Length of the gzip header at the start of in, 0 when it is not one */
+static unsigned long gzip_header_len(const unsigned char *in, unsigned long len)
+{
+    unsigned long pos = 10;
+    int flags = 0;
+
+    if (len < 10 || in[0] != 0x1f || in[1] != 0x8b || in[2] != Z_DEFLATED)
+        return 0;
+    flags = in[3];
+    if (flags & 0xe0)
+        return 0;
+
+    if (flags & 0x04) {                     /* FEXTRA */
+        if (pos + 2 > len)
+            return 0;
+        pos += 2 + (in[pos] | (in[pos + 1] << 8));
+    }
+    if (flags & 0x08) {                     /* FNAME */
+        while (pos < len && in[pos] != 0)
+            pos++;
+        pos++;
+    }
+    if (flags & 0x10) {                     /* FCOMMENT */
+        while (pos < len && in[pos] != 0)
+            pos++;
+        pos++;
+    }
+    if (flags & 0x02)                       /* FHCRC */
+        pos += 2;
+
+    return pos <= len ? pos : 0;
+}
+
+/* Length of the zlib header at the start of in, 0 when it is not one or
+   needs a preset dictionary */
+static unsigned long zlib_header_len(const unsigned char *in, unsigned long len)
+{
+    if (len < 2 || (in[0] & 0x0f) != Z_DEFLATED || (in[0] >> 4) + 8 > 15 ||
+        ((in[0] << 8) | in[1]) % 31 != 0 || (in[1] & 0x20))
+        return 0;
+    return 2;
+}
+
+/******************************************************************************
+* function:
+*     tests_inflate_back (z_stream *strm, unsigned char *window,
+*                         const unsigned char *in, unsigned long in_len,
+*                         int streamtype, unsigned long chunk,
+*                         unsigned char *out, unsigned long out_len)
+*
+* @param strm       [IN] - stream to run inflateBack on, total_in and
+*                          total_out are set on return
+* @param window     [IN] - 1 << BACK_WINDOW_BITS byte window
+* @param in         [IN] - compressed stream
+* @param in_len     [IN] - length of the compressed stream
+* @param streamtype [IN] - raw, zlib or gzip deflate stream
+* @param chunk      [IN] - bytes handed to inflateBack per input callback
+* @param out        [OUT] - buffer the stream decompresses into
+* @param out_len    [IN] - size of the output buffer
+*
+* description:
+*   decompress a whole stream with inflateBackInit/inflateBack. inflateBack
+*   only knows raw deflate, the zlib and gzip header and trailer are parsed
+*   and checked here. Returns Z_STREAM_END when the stream is complete and
+*   its check value and length match.
+******************************************************************************/
+int tests_inflate_back(z_stream *strm, unsigned char *window,
+                       const unsigned char *in, unsigned long in_len,
+                       int streamtype, unsigned long chunk,
+                       unsigned char *out, unsigned long out_len)
+{
+    back_io_t io;
+    unsigned long used = 0;
+    int ret = Z_OK;
+
+    memset(&io, 0, sizeof(io));
+    io.in = in;
+    io.in_len = in_len;
+    io.chunk = chunk ? chunk : in_len;
+    io.out = out;
+    io.out_len = out_len;
+
+    switch (streamtype) {
+        case RAW_DEFLATE_STREAM:
+            io.check = BACK_CHECK_NONE;
+            break;
+        case ZLIB_DEFLATE_STREAM:
+            io.in_pos = zlib_header_len(in, in_len);
+            io.check = BACK_CHECK_ADLER32;
+            io.sum = adler32(0, Z_NULL, 0);
+            break;
+        default:
+            io.in_pos = gzip_header_len(in, in_len);
+            io.check = BACK_CHECK_CRC32;
+            io.sum = crc32(0, Z_NULL, 0);
+            break;
+    }
+    if (BACK_CHECK_NONE != io.check && 0 == io.in_pos)
+        return Z_DATA_ERROR;
+
+    strm->zalloc = Z_NULL;
+    strm->zfree = Z_NULL;
+    strm->opaque = Z_NULL;
+    ret = inflateBackInit(strm, BACK_WINDOW_BITS, window);
+    if (ret != Z_OK)
+        return ret;
+
+    strm->next_in = Z_NULL;
+    strm->avail_in = 0;
+    ret = inflateBack(strm, back_in, &io, back_out, &io);
+    /* whatever input the last callback handed out and was not used */
+    used = io.in_pos - strm->avail_in;
+    inflateBackEnd(strm);
+
+    strm->total_out = io.out_pos;
+    if (ret != Z_STREAM_END)
+        return ret == Z_BUF_ERROR && io.out_pos == io.out_len ? Z_BUF_ERROR : Z_DATA_ERROR;
+
+    if (ZLIB_DEFLATE_STREAM == streamtype) {
+        if (used + 4 > in_len || get_be32(in + used) != io.sum)
+            return Z_DATA_ERROR;
+        used += 4;
+    }
+    else if (BACK_CHECK_CRC32 == io.check) {
+        if (used + 8 > in_len || get_le32(in + used) != io.sum ||
+            get_le32(in + used + 4) != (io.out_pos & 0xffffffffUL))
+            return Z_DATA_ERROR;
+        used += 8;
+    }
+    strm->total_in = used;
+    return Z_STREAM_END;
+}
+
+/* One timed decompression of stream with inflate() in chunks the way the
+   decompression test does it */
+static int back_time_inflate(const unsigned char *in, unsigned long in_len, int windowbits,
+                             unsigned long chunk, unsigned char *out, unsigned long out_len,
+                             unsigned long long *ns)
+{
+    z_stream strm;
+    unsigned long long start = tests_nsec();
+    int flush = Z_NO_FLUSH;
+    int ret = Z_OK;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, windowbits);
+    if (ret != Z_OK)
+        return ret;
+    strm.next_out = out;
+    strm.avail_out = out_len;
+    do {
+        strm.next_in = (z_const unsigned char *)in + strm.total_in;
+        if (strm.total_in + chunk >= in_len) {
+            strm.avail_in = in_len - strm.total_in;
+            flush = Z_FINISH;
+        }
+        else {
+            strm.avail_in = chunk;
+        }
+        ret = inflate(&strm, flush);
+    } while (ret == Z_OK);
+    inflateEnd(&strm);
+
+    *ns = tests_nsec() - start;
+    return ret;
+}
+
+/******************************************************************************
+* function:
+*     tests_inflate_back_compare (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - parameters of one worker, input_buf holds the
+*                               corpus
+*
+* description:
+*   time inflate() against inflateBack over the corpus for every stream type
+*   and a few chunk sizes, and print the speedup of inflateBack. The corpus
+*   is compressed once as raw deflate and wrapped as zlib and gzip here so
+*   all three carry the same deflate data.
+******************************************************************************/
+int tests_inflate_back_compare(test_parameters_t* test_parameters)
+{
+    unsigned long chunks[] = { 1024, 0, 65536, 0 };
+    unsigned char *stream[STREAMTYPE_MAX + 1];
+    unsigned long stream_len[STREAMTYPE_MAX + 1];
+    unsigned char *raw = NULL, *out = NULL, *window = NULL;
+    unsigned long raw_len = 0, out_len = test_parameters->input_buflen + 100;
+    unsigned long crc = 0, adler = 0, chunk = 0;
+    unsigned long long ns = 0, best_inflate = 0, best_back = 0;
+    z_stream strm;
+    int wbits = test_parameters->window_bits;
+    int failed = TEST_PASSED;
+    int s, c, r, ret, cmf;
+
+    chunks[1] = test_parameters->chunksize;
+    chunks[3] = test_parameters->input_buflen;
+    memset(stream, 0, sizeof(stream));
+
+    raw_len = compressBound(test_parameters->input_buflen);
+    raw = malloc(raw_len + 18);
+    out = malloc(out_len);
+    window = malloc(1 << BACK_WINDOW_BITS);
+    if (NULL == raw || NULL == out || NULL == window) {
+        fprintf(stderr, "# FAIL: Could not allocate inflateBack comparison buffers.\n");
+        failed = TEST_FAILED;
+        goto done;
+    }
+
+    /* Raw deflate data after a 10 byte gap a gzip header fits in */
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, test_parameters->level, Z_DEFLATED, -wbits,
+                       test_parameters->mem_level, test_parameters->strategy);
+    if (ret == Z_OK) {
+        strm.next_in = test_parameters->input_buf;
+        strm.avail_in = test_parameters->input_buflen;
+        strm.next_out = raw + 10;
+        strm.avail_out = raw_len;
+        ret = deflate(&strm, Z_FINISH);
+        raw_len = strm.total_out;
+        deflateEnd(&strm);
+    }
+    if (ret != Z_STREAM_END) {
+        fprintf(stderr, "# FAIL: Could not compress the corpus for the comparison, ret:%d\n", ret);
+        failed = TEST_FAILED;
+        goto done;
+    }
+    crc = crc32(0, test_parameters->input_buf, test_parameters->input_buflen);
+    adler = adler32(1, test_parameters->input_buf, test_parameters->input_buflen);
+
+    for (s = RAW_DEFLATE_STREAM; s <= STREAMTYPE_MAX; s++) {
+        stream[s] = malloc(raw_len + 18);
+        if (NULL == stream[s]) {
+            fprintf(stderr, "# FAIL: Could not allocate inflateBack comparison buffers.\n");
+            failed = TEST_FAILED;
+            goto done;
+        }
+    }
+    memcpy(stream[RAW_DEFLATE_STREAM], raw + 10, raw_len);
+    stream_len[RAW_DEFLATE_STREAM] = raw_len;
+
+    cmf = ((wbits - 8) << 4) | Z_DEFLATED;
+    stream[ZLIB_DEFLATE_STREAM][0] = cmf;
+    stream[ZLIB_DEFLATE_STREAM][1] = 0x80 + 31 - ((cmf << 8) | 0x80) % 31;
+    memcpy(stream[ZLIB_DEFLATE_STREAM] + 2, raw + 10, raw_len);
+    for (r = 0; r < 4; r++)
+        stream[ZLIB_DEFLATE_STREAM][2 + raw_len + r] = (adler >> (24 - 8 * r)) & 0xff;
+    stream_len[ZLIB_DEFLATE_STREAM] = raw_len + 6;
+
+    memcpy(stream[GZIP_DEFLATE_STREAM], "\x1f\x8b\x08\0\0\0\0\0\0\x03", 10);
+    memcpy(stream[GZIP_DEFLATE_STREAM] + 10, raw + 10, raw_len);
+    for (r = 0; r < 4; r++) {
+        stream[GZIP_DEFLATE_STREAM][10 + raw_len + r] = (crc >> (8 * r)) & 0xff;
+        stream[GZIP_DEFLATE_STREAM][14 + raw_len + r] =
+            (test_parameters->input_buflen >> (8 * r)) & 0xff;
+    }
+    stream_len[GZIP_DEFLATE_STREAM] = raw_len + 18;
+
+    printf("\nThread %d inflateBack against inflate(), best of %d:\n",
+           test_parameters->id, BACK_COMPARE_REPEATS);
+    printf("%8s %10s %14s %14s %10s\n", "Stream", "Chunk", "inflate_Mbps", "back_Mbps", "Speedup");
+    for (s = RAW_DEFLATE_STREAM; s <= STREAMTYPE_MAX && TEST_PASSED == failed; s++) {
+        for (c = 0; c < (int)(sizeof(chunks) / sizeof(chunks[0])); c++) {
+            chunk = chunks[c];
+            /* the -k chunk size is left out when it is one of the others */
+            if (1 == c && (chunk == chunks[0] || chunk == chunks[2] || chunk >= chunks[3]))
+                continue;
+
+            best_inflate = best_back = ~0ULL;
+            for (r = 0; r < BACK_COMPARE_REPEATS; r++) {
+                memset(out, 0, out_len);
+                ret = back_time_inflate(stream[s], stream_len[s],
+                                        tests_window_bits(s, wbits), chunk, out, out_len, &ns);
+                if (ret != Z_STREAM_END || memcmp(out, test_parameters->input_buf, test_parameters->input_buflen)) {
+                    fprintf(stderr, "# FAIL: inflate of the %s stream failed, ret:%d\n",
+                            back_stream_name[s], ret);
+                    failed = TEST_FAILED;
+                    break;
+                }
+                if (ns < best_inflate)
+                    best_inflate = ns;
+
+                memset(out, 0, out_len);
+                ns = tests_nsec();
+                ret = tests_inflate_back(&strm, window, stream[s], stream_len[s], s, chunk,
+                                         out, out_len);
+                ns = tests_nsec() - ns;
+                if (ret != Z_STREAM_END || strm.total_out != test_parameters->input_buflen ||
+                    memcmp(out, test_parameters->input_buf, test_parameters->input_buflen)) {
+                    fprintf(stderr, "# FAIL: inflateBack of the %s stream failed, ret:%d\n",
+                            back_stream_name[s], ret);
+                    failed = TEST_FAILED;
+                    break;
+                }
+                if (ns < best_back)
+                    best_back = ns;
+            }
+            if (TEST_PASSED != failed)
+                break;
+
+            printf("%8s %10lu %14.2f %14.2f %9.2fx\n", back_stream_name[s], chunk,
+                   (double)test_parameters->input_buflen * 8 * 1000 / best_inflate,
+                   (double)test_parameters->input_buflen * 8 * 1000 / best_back,
+                   (double)best_inflate / best_back);
+        }
+    }
+
+done:
+    for (s = RAW_DEFLATE_STREAM; s <= STREAMTYPE_MAX; s++)
+        free(stream[s]);
+    free(raw);
+    free(out);
+    free(window);
+    return failed;
+}
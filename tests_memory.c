@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* The profile sweeps every windowBits deflate takes and every memLevel */
+#define MEMORY_WBITS_MIN        9
+#define MEMORY_WBITS_MAX        MAX_WBITS
+#define MEMORY_LEVEL_MIN        1
+#define MEMORY_LEVEL_MAX        MAX_MEM_LEVEL
+#define MEMORY_WBITS            (MEMORY_WBITS_MAX - MEMORY_WBITS_MIN + 1)
+#define MEMORY_LEVELS           (MEMORY_LEVEL_MAX - MEMORY_LEVEL_MIN + 1)
+
+typedef struct
+{
+    unsigned long long deflate_ns;
+    unsigned long long inflate_ns;
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long deflate_state;
+    unsigned long long inflate_state;
+}
+memory_result_t;
+
+
+
+int
+startup_corpus_memory(test_parameters_t* test_parameters)
+{
+    if (TEST_PASSED != tests_startup_corpus_compression(test_parameters))
+        return TEST_FAILED;
+
+    /* Each configuration is inflated back into the scratch buffer */
+    test_parameters->scratch_buflen = test_parameters->input_buflen + 100;
+    test_parameters->scratch_buf = malloc(test_parameters->scratch_buflen);
+    if (NULL == test_parameters->scratch_buf) {
+        fprintf(stderr, "# FAIL: Could not allocate inflate output buffer.\n");
+        return TEST_FAILED;
+    }
+
+    return TEST_PASSED;
+}
+
+
+
+/******************************************************************************
+* function:
+*     memory_profile (test_parameters_t* test_parameters, int wbits,
+*                     int mem_level, int verify, memory_result_t *result)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param wbits           [IN] - base two logarithm of the window size
+* @param mem_level       [IN] - deflate memLevel
+* @param verify          [IN] - check the inflated corpus
+* @param result          [OUT] - totals of the configuration, updated
+*
+* description:
+*   deflate the corpus a chunk at a time under one configuration and inflate
+*   it again, timing both and counting the bytes the zlib state of each
+*   stream asks for through zalloc
+******************************************************************************/
+static int
+memory_profile(test_parameters_t* test_parameters, int wbits, int mem_level,
+               int verify, memory_result_t *result)
+{
+    z_stream strm;
+    zalloc_count_t count;
+    unsigned long long t0 = 0, start = 0;
+    int windowbits = tests_window_bits(test_parameters->streamtype, wbits);
+    int flush = Z_NO_FLUSH;
+    int ret = Z_OK;
+    unsigned long out_len = 0;
+
+    memset(&strm, 0, sizeof(strm));
+    memset(&count, 0, sizeof(count));
+    tests_zalloc_use(&strm, &count);
+
+    start = t0 = tests_nsec();
+    ret = deflateInit2(&strm, test_parameters->level, 8, windowbits,
+                       mem_level, test_parameters->strategy);
+    if (ret != Z_OK)
+        return ret;
+    strm.next_out = test_parameters->output_buf;
+    strm.avail_out = test_parameters->output_buflen;
+    do {
+        strm.next_in = test_parameters->input_buf + strm.total_in;
+        if (strm.total_in + test_parameters->chunksize >= test_parameters->input_buflen) {
+            strm.avail_in = test_parameters->input_buflen - strm.total_in;
+            flush = Z_FINISH;
+        }
+        else {
+            strm.avail_in = test_parameters->chunksize;
+        }
+        ret = deflate(&strm, flush);
+    } while (ret == Z_OK);
+    out_len = strm.total_out;
+    deflateEnd(&strm);
+    result->deflate_ns += tests_nsec() - t0;
+    if (ret != Z_STREAM_END)
+        return ret == Z_OK ? Z_BUF_ERROR : ret;
+    result->deflate_state = count.peak;
+
+    memset(&strm, 0, sizeof(strm));
+    memset(&count, 0, sizeof(count));
+    tests_zalloc_use(&strm, &count);
+
+    t0 = tests_nsec();
+    ret = inflateInit2(&strm, windowbits);
+    if (ret != Z_OK)
+        return ret;
+    /* Fed a chunk at a time, inflate keeps a window as it does when the
+       stream comes off the network */
+    strm.next_in = test_parameters->output_buf;
+    strm.next_out = test_parameters->scratch_buf;
+    strm.avail_out = test_parameters->scratch_buflen;
+    do {
+        strm.avail_in = out_len - strm.total_in;
+        if (strm.avail_in > (uInt)test_parameters->chunksize)
+            strm.avail_in = test_parameters->chunksize;
+        ret = inflate(&strm, Z_NO_FLUSH);
+    } while (ret == Z_OK && strm.total_in < out_len);
+    inflateEnd(&strm);
+    result->inflate_ns += tests_nsec() - t0;
+    if (ret != Z_STREAM_END)
+        return ret == Z_OK ? Z_BUF_ERROR : ret;
+    result->inflate_state = count.peak;
+
+    result->bytes_in += test_parameters->input_buflen;
+    result->bytes_out += out_len;
+    /* The live counters see the whole round trip, as for the other tests */
+    tests_live_op(test_parameters, test_parameters->input_buflen, out_len,
+                  tests_nsec() - start);
+
+    if (verify && TEST_PASSED != tests_verify_data(test_parameters,
+                                                   test_parameters->scratch_buf,
+                                                   strm.total_out))
+        return Z_DATA_ERROR;
+    return Z_OK;
+}
+
+
+
+int
+run_corpus_memory(test_parameters_t* test_parameters)
+{
+    memory_result_t results[MEMORY_WBITS][MEMORY_LEVELS];
+    memory_result_t *r;
+    unsigned long long bytes_in = 0, bytes_out = 0, trace = 0;
+    int failed = TEST_PASSED;
+    int i, w, m, ret;
+
+    memset(results, 0, sizeof(results));
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        trace = tests_trace_start(test_parameters->trace);
+        for (w = 0; w < MEMORY_WBITS && TEST_PASSED == failed; w++) {
+            for (m = 0; m < MEMORY_LEVELS && TEST_PASSED == failed; m++) {
+                ret = memory_profile(test_parameters, MEMORY_WBITS_MIN + w,
+                                     MEMORY_LEVEL_MIN + m,
+                                     tests_verify_due(test_parameters, i), &results[w][m]);
+                if (ret != Z_OK) {
+                    fprintf(stderr, "# FAIL: windowBits %d memLevel %d failed, ret:%d\n",
+                            MEMORY_WBITS_MIN + w, MEMORY_LEVEL_MIN + m, ret);
+                    tests_live_error(test_parameters);
+                    failed = TEST_FAILED;
+                }
+            }
+        }
+        tests_trace_stop(test_parameters->trace, "memory profile", trace);
+    }
+
+    if (TEST_PASSED != failed || 0 == results[0][0].bytes_in)
+        return failed;
+
+    flockfile(stdout);
+    printf("\nThread %d memory profile, level %d:\n", test_parameters->id,
+           test_parameters->level);
+    printf("%6s %7s %12s %12s %8s %10s %10s\n", "WBits", "MemLvl",
+           "Deflate_B", "Inflate_B", "Ratio", "Defl_Mbps", "Infl_Mbps");
+    for (w = 0; w < MEMORY_WBITS; w++) {
+        for (m = 0; m < MEMORY_LEVELS; m++) {
+            r = &results[w][m];
+            printf("%6d %7d %12llu %12llu %8.4f %10.2f %10.2f\n",
+                   MEMORY_WBITS_MIN + w, MEMORY_LEVEL_MIN + m,
+                   r->deflate_state, r->inflate_state,
+                   (double)r->bytes_out / r->bytes_in,
+                   (double)r->bytes_in * 8 * 1000 / r->deflate_ns,
+                   (double)r->bytes_in * 8 * 1000 / r->inflate_ns);
+            bytes_in += r->bytes_in;
+            bytes_out += r->bytes_out;
+            if (r->deflate_state > test_parameters->state_bytes)
+                test_parameters->state_bytes = r->deflate_state;
+        }
+    }
+    printf("Deflate_B and Inflate_B are the bytes zlib asked for per stream, "
+           "Mbps include the stream setup\n");
+    funlockfile(stdout);
+
+    /* An operation deflates and inflates the corpus under every configuration */
+    test_parameters->single_call_bytes = test_parameters->input_buflen *
+                                         MEMORY_WBITS * MEMORY_LEVELS;
+    test_parameters->ratio = (float)bytes_out / bytes_in;
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_memory(test_parameters_t* test_parameters)
+{
+    if (test_parameters->scratch_buf) {
+        free(test_parameters->scratch_buf);
+        test_parameters->scratch_buf = NULL;
+        test_parameters->scratch_buflen = 0;
+    }
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_memory  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a memory profile job
+*
+******************************************************************************/
+int
+tests_startup_corpus_memory(test_parameters_t* test_parameters)
+{
+   return startup_corpus_memory(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_memory  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	profile state memory, ratio and throughput over windowBits and memLevel
+*
+******************************************************************************/
+int
+tests_run_corpus_memory(test_parameters_t* test_parameters)
+{
+    return run_corpus_memory(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_memory  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a memory profile job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_memory(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_memory(test_parameters);
+}
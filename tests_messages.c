@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* Output room of a message beyond compressBound of its bytes, for a gzip
+   header and trailer */
+#define MESSAGES_ROOM(len)      (compressBound(len) + 32)
+
+typedef struct
+{
+    unsigned long messages;
+    unsigned long long bytes;
+    unsigned long long bytes_z;
+    unsigned long long deflate_ns;
+    unsigned long long inflate_ns;
+    histogram_t deflate_latency;
+    histogram_t inflate_latency;
+}
+messages_result_t;
+
+/* Largest message of a worker, no message is longer than the corpus */
+static unsigned long messages_max(test_parameters_t* test_parameters)
+{
+    unsigned long len = test_parameters->size_dist ? test_parameters->size_dist->max :
+                        (unsigned long)test_parameters->chunksize;
+
+    if (len > test_parameters->input_buflen)
+        len = test_parameters->input_buflen;
+    return len;
+}
+
+
+
+int
+startup_corpus_messages(test_parameters_t* test_parameters)
+{
+    if (TEST_PASSED != tests_startup_corpus_compression(test_parameters))
+        return TEST_FAILED;
+
+    /* scratch_buf takes the deflated message, index_buf the inflated one */
+    test_parameters->scratch_buflen = MESSAGES_ROOM(messages_max(test_parameters));
+    test_parameters->scratch_buf = malloc(test_parameters->scratch_buflen);
+    test_parameters->index_len = messages_max(test_parameters);
+    test_parameters->index_buf = malloc(test_parameters->index_len);
+    if (NULL == test_parameters->scratch_buf || NULL == test_parameters->index_buf) {
+        fprintf(stderr, "# FAIL: Could not allocate message buffers.\n");
+        return TEST_FAILED;
+    }
+
+    return TEST_PASSED;
+}
+
+
+
+/******************************************************************************
+* function:
+*     messages_one (test_parameters_t* test_parameters, z_stream *defl,
+*                   z_stream *infl, const unsigned char *data, unsigned long len,
+*                   unsigned long *out_len, messages_result_t *result)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param defl            [IN] - deflate stream of the worker
+* @param infl            [IN] - inflate stream of the worker
+* @param data            [IN] - message
+* @param len             [IN] - bytes of the message
+* @param out_len         [OUT] - bytes of the deflated message
+* @param result          [OUT] - totals of the size bucket of the message
+*
+* description:
+*   deflate one message into scratch_buf and inflate it back into index_buf,
+*   each a stream of its own fed in one call. The streams are reset between
+*   messages as a server reusing them does, so the cost per message is that
+*   of its size and not of setting up the zlib state.
+******************************************************************************/
+static int
+messages_one(test_parameters_t* test_parameters, z_stream *defl, z_stream *infl,
+             const unsigned char *data, unsigned long len, unsigned long *out_len,
+             messages_result_t *result)
+{
+    unsigned long long t0 = 0, deflate_ns = 0, inflate_ns = 0;
+    int ret = Z_OK;
+
+    t0 = tests_nsec();
+    deflateReset(defl);
+    defl->next_in = (z_const Bytef *)data;
+    defl->avail_in = len;
+    defl->next_out = test_parameters->scratch_buf;
+    defl->avail_out = test_parameters->scratch_buflen;
+    ret = deflate(defl, Z_FINISH);
+    deflate_ns = tests_nsec() - t0;
+    if (ret != Z_STREAM_END)
+        return ret == Z_OK ? Z_BUF_ERROR : ret;
+    *out_len = defl->total_out;
+
+    t0 = tests_nsec();
+    inflateReset(infl);
+    infl->next_in = test_parameters->scratch_buf;
+    infl->avail_in = *out_len;
+    infl->next_out = test_parameters->index_buf;
+    infl->avail_out = len;
+    ret = inflate(infl, Z_FINISH);
+    inflate_ns = tests_nsec() - t0;
+    if (ret != Z_STREAM_END)
+        return ret == Z_OK ? Z_BUF_ERROR : ret;
+    if (infl->total_out != len)
+        return Z_DATA_ERROR;
+
+    result->messages++;
+    result->bytes += len;
+    result->bytes_z += *out_len;
+    result->deflate_ns += deflate_ns;
+    result->inflate_ns += inflate_ns;
+    tests_histogram_add(&result->deflate_latency, deflate_ns);
+    tests_histogram_add(&result->inflate_latency, inflate_ns);
+    tests_live_op(test_parameters, len, *out_len, deflate_ns + inflate_ns);
+    return Z_OK;
+}
+
+
+
+int
+run_corpus_messages(test_parameters_t* test_parameters)
+{
+    messages_result_t *results = NULL;
+    messages_result_t *res;
+    const unsigned char *data = NULL;
+    unsigned long len = 0, out_len = 0, sent = 0, message = 0;
+    unsigned long long bytes = 0, bytes_z = 0, trace = 0;
+    verify_span_t span;
+    int windowbits = tests_window_bits(test_parameters->streamtype,
+                                       test_parameters->window_bits);
+    char dist[128];
+    z_stream defl, infl;
+    int verify_now = 0;
+    int failed = TEST_PASSED;
+    int i, b, ret;
+
+    results = calloc(SIZES_BUCKETS, sizeof(messages_result_t));
+    if (NULL == results) {
+        fprintf(stderr, "# FAIL: Could not allocate message size results.\n");
+        return TEST_FAILED;
+    }
+    for (b = 0; b < SIZES_BUCKETS; b++) {
+        tests_histogram_init(&results[b].deflate_latency);
+        tests_histogram_init(&results[b].inflate_latency);
+    }
+
+    memset(&defl, 0, sizeof(defl));
+    memset(&infl, 0, sizeof(infl));
+    if (deflateInit2(&defl, test_parameters->level, 8, windowbits,
+                     test_parameters->mem_level, test_parameters->strategy) != Z_OK ||
+        inflateInit2(&infl, windowbits) != Z_OK) {
+        fprintf(stderr, "# FAIL: Could not set up the message streams.\n");
+        deflateEnd(&defl);
+        free(results);
+        return TEST_FAILED;
+    }
+
+    /* An operation is as many messages as it takes to send the corpus once */
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        verify_now = tests_verify_due(test_parameters, i);
+        trace = tests_trace_start(test_parameters->trace);
+        bytes = 0;
+        bytes_z = 0;
+        for (sent = 0; sent < test_parameters->input_buflen && TEST_PASSED == failed;
+             sent += len, message++) {
+            len = tests_sizes_next(test_parameters);
+            if (len > test_parameters->input_buflen)
+                len = test_parameters->input_buflen;
+            data = test_parameters->input_buf +
+                   ((unsigned long long)message * 2654435761ULL) %
+                   (test_parameters->input_buflen - len + 1);
+
+            res = &results[tests_sizes_bucket(len)];
+            ret = messages_one(test_parameters, &defl, &infl, data, len, &out_len, res);
+            if (ret != Z_OK) {
+                fprintf(stderr, "# FAIL: message %lu of %lu bytes failed, ret:%d\n",
+                        message, len, ret);
+                tests_live_error(test_parameters);
+                failed = TEST_FAILED;
+                break;
+            }
+            bytes += len;
+            bytes_z += out_len;
+
+            if (verify_now) {
+                tests_verify_start(&span);
+                if (memcmp(test_parameters->index_buf, data, len) != 0) {
+                    fprintf(stderr, "# FAIL: thread %d message %lu of %lu bytes does not "
+                            "match\n", test_parameters->id, message, len);
+                    failed = TEST_FAILED;
+                }
+                tests_verify_stop(test_parameters, &span);
+            }
+        }
+        tests_trace_stop(test_parameters->trace, "messages", trace);
+        if (verify_now && TEST_PASSED == failed)
+            test_parameters->verify_checked++;
+
+        test_parameters->single_call_bytes = bytes;
+        test_parameters->ratio = bytes ? (float)bytes_z / bytes : 0;
+    }
+    deflateEnd(&defl);
+    inflateEnd(&infl);
+
+    if (TEST_PASSED == failed && i > 0) {
+        if (test_parameters->size_dist)
+            tests_sizes_describe(test_parameters->size_dist, dist, sizeof(dist));
+        else
+            snprintf(dist, sizeof(dist), "fixed %d bytes", test_parameters->chunksize);
+        flockfile(stdout);
+        printf("\nThread %d messages by size, %s:\n", test_parameters->id, dist);
+        printf("%17s %8s %10s %8s %10s %10s %10s %10s %10s %10s\n", "Size_B", "Count",
+               "MB", "Ratio", "Defl_Mbps", "Infl_Mbps", "Defl_p50us", "Defl_p99us",
+               "Infl_p50us", "Infl_p99us");
+        for (b = 0; b < SIZES_BUCKETS; b++) {
+            res = &results[b];
+            if (0 == res->messages)
+                continue;
+            printf("%8lu-%-8lu %8lu %10.3f %8.4f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                   1UL << b, (2UL << b) - 1, res->messages, (double)res->bytes / 1e6,
+                   (double)res->bytes_z / res->bytes,
+                   (double)res->bytes * 8 * 1000 / res->deflate_ns,
+                   (double)res->bytes * 8 * 1000 / res->inflate_ns,
+                   (double)tests_histogram_percentile(&res->deflate_latency, 50) / 1000,
+                   (double)tests_histogram_percentile(&res->deflate_latency, 99) / 1000,
+                   (double)tests_histogram_percentile(&res->inflate_latency, 50) / 1000,
+                   (double)tests_histogram_percentile(&res->inflate_latency, 99) / 1000);
+        }
+        funlockfile(stdout);
+    }
+
+    free(results);
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_messages(test_parameters_t* test_parameters)
+{
+    if (test_parameters->scratch_buf) {
+        free(test_parameters->scratch_buf);
+        test_parameters->scratch_buf = NULL;
+        test_parameters->scratch_buflen = 0;
+    }
+    if (test_parameters->index_buf) {
+        free(test_parameters->index_buf);
+        test_parameters->index_buf = NULL;
+        test_parameters->index_len = 0;
+    }
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_messages  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a message size job
+*
+******************************************************************************/
+int
+tests_startup_corpus_messages(test_parameters_t* test_parameters)
+{
+   return startup_corpus_messages(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_messages  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	compress and decompress messages of the -k sizes, reported per size
+*
+******************************************************************************/
+int
+tests_run_corpus_messages(test_parameters_t* test_parameters)
+{
+    return run_corpus_messages(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_messages  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a message size job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_messages(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_messages(test_parameters);
+}
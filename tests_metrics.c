@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "tests.h"
+
+/* How often the server looks for a stop request while idle */
+#define METRICS_POLL_MSEC       250
+
+#define LIVE_READ(counter)      __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+
+static const char *metrics_phase_name[] = {
+    "startup", "ready", "running", "shutdown", "done"
+};
+
+/******************************************************************************
+* function:
+*     metrics_listen (const char *endpoint)
+*
+* @param endpoint [IN] - "unix:<path>" or a path for a Unix domain socket,
+*                        otherwise a TCP port bound to localhost
+*
+* description:
+*   returns a listening socket for the endpoint or -1
+******************************************************************************/
+static int metrics_listen(const char *endpoint)
+{
+    struct sockaddr_un sun;
+    struct sockaddr_in sin;
+    const char *path = NULL;
+    int fd = -1, one = 1, port = 0;
+
+    if (0 == strncmp(endpoint, "unix:", 5))
+        path = endpoint + 5;
+    else if (strchr(endpoint, '/'))
+        path = endpoint;
+
+    if (path) {
+        memset(&sun, 0, sizeof(sun));
+        sun.sun_family = AF_UNIX;
+        if (strlen(path) >= sizeof(sun.sun_path)) {
+            fprintf(stderr, "# FAIL: metrics socket path too long: %s\n", path);
+            return -1;
+        }
+        strcpy(sun.sun_path, path);
+        unlink(path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+            goto fail;
+    }
+    else {
+        port = atoi(endpoint);
+        if (port <= 0 || port > 65535) {
+            fprintf(stderr, "# FAIL: metrics endpoint is not a port or a socket path: %s\n",
+                    endpoint);
+            return -1;
+        }
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = htons(port);
+        sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            goto fail;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) != 0)
+            goto fail;
+    }
+
+    if (listen(fd, 8) != 0)
+        goto fail;
+    return fd;
+
+fail:
+    fprintf(stderr, "# FAIL: could not listen on metrics endpoint %s: %s\n",
+            endpoint, strerror(errno));
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+/******************************************************************************
+* function:
+*     metrics_write (FILE *out, metrics_server_t *metrics,
+*                    unsigned long long *last_cpu, unsigned long long *last_wall)
+*
+* @param out       [IN] - stream the exposition is written to
+* @param metrics   [IN] - server and the live counters it reads
+* @param last_cpu  [IN] - worker cpu time at the previous scrape, updated
+* @param last_wall [IN] - wall clock at the previous scrape, updated
+*
+* description:
+*   write every metric in the Prometheus text exposition format. The counters
+*   of each worker are read one by one without stopping the worker, so one
+*   scrape is not an exact snapshot across counters.
+******************************************************************************/
+static void metrics_write(FILE *out, metrics_server_t *metrics,
+                          unsigned long long *last_cpu, unsigned long long *last_wall)
+{
+    unsigned long long latency[LIVE_BUCKETS];
+    unsigned long long count = 0, sum = 0, cpu = 0, now = 0;
+    int phase = __atomic_load_n(&metrics->phase, __ATOMIC_RELAXED);
+    int i, b;
+
+    fprintf(out, "# HELP mt_perf_phase Phase of the run, 1 for the current one.\n");
+    fprintf(out, "# TYPE mt_perf_phase gauge\n");
+    for (i = METRICS_PHASE_STARTUP; i <= METRICS_PHASE_DONE; i++)
+        fprintf(out, "mt_perf_phase{phase=\"%s\"} %d\n", metrics_phase_name[i], i == phase);
+
+    fprintf(out, "# HELP mt_perf_ops_total Operations completed by a worker.\n");
+    fprintf(out, "# TYPE mt_perf_ops_total counter\n");
+    for (i = 0; i < metrics->workers; i++)
+        fprintf(out, "mt_perf_ops_total{thread=\"%d\",test=\"%s\"} %llu\n", i,
+                metrics->live[i].test, LIVE_READ(metrics->live[i].ops));
+
+    fprintf(out, "# HELP mt_perf_bytes_in_total Bytes consumed by a worker.\n");
+    fprintf(out, "# TYPE mt_perf_bytes_in_total counter\n");
+    for (i = 0; i < metrics->workers; i++)
+        fprintf(out, "mt_perf_bytes_in_total{thread=\"%d\",test=\"%s\"} %llu\n", i,
+                metrics->live[i].test, LIVE_READ(metrics->live[i].bytes_in));
+
+    fprintf(out, "# HELP mt_perf_bytes_out_total Bytes produced by a worker.\n");
+    fprintf(out, "# TYPE mt_perf_bytes_out_total counter\n");
+    for (i = 0; i < metrics->workers; i++)
+        fprintf(out, "mt_perf_bytes_out_total{thread=\"%d\",test=\"%s\"} %llu\n", i,
+                metrics->live[i].test, LIVE_READ(metrics->live[i].bytes_out));
+
+    fprintf(out, "# HELP mt_perf_errors_total Operations of a worker that failed.\n");
+    fprintf(out, "# TYPE mt_perf_errors_total counter\n");
+    for (i = 0; i < metrics->workers; i++)
+        fprintf(out, "mt_perf_errors_total{thread=\"%d\",test=\"%s\"} %llu\n", i,
+                metrics->live[i].test, LIVE_READ(metrics->live[i].errors));
+
+    fprintf(out, "# HELP mt_perf_cpu_seconds_total CPU time of a worker thread.\n");
+    fprintf(out, "# TYPE mt_perf_cpu_seconds_total counter\n");
+    for (i = 0; i < metrics->workers; i++) {
+        unsigned long long nsec = LIVE_READ(metrics->live[i].cpu_nsec);
+
+        cpu += nsec;
+        fprintf(out, "mt_perf_cpu_seconds_total{thread=\"%d\",test=\"%s\"} %.6f\n", i,
+                metrics->live[i].test, (double)nsec / 1e9);
+    }
+
+    /* CPU% of all the workers together since the previous scrape, the cpu
+       time of a worker is brought up to date as each operation ends */
+    now = tests_nsec();
+    fprintf(out, "# HELP mt_perf_cpu_percent CPU use of the workers since the previous scrape.\n");
+    fprintf(out, "# TYPE mt_perf_cpu_percent gauge\n");
+    fprintf(out, "mt_perf_cpu_percent %.1f\n",
+            now > *last_wall ? (double)(cpu - *last_cpu) * 100 / (now - *last_wall) : 0);
+    *last_cpu = cpu;
+    *last_wall = now;
+
+    /* The latency of all the workers, in power of two buckets from 1us */
+    memset(latency, 0, sizeof(latency));
+    for (i = 0; i < metrics->workers; i++) {
+        for (b = 0; b < LIVE_BUCKETS; b++)
+            latency[b] += LIVE_READ(metrics->live[i].latency[b]);
+        sum += LIVE_READ(metrics->live[i].latency_sum);
+    }
+    fprintf(out, "# HELP mt_perf_latency_seconds Time taken by an operation.\n");
+    fprintf(out, "# TYPE mt_perf_latency_seconds histogram\n");
+    for (b = 0; b < LIVE_BUCKETS; b++) {
+        count += latency[b];
+        /* bucket b holds 2^b to 2^(b+1)-1 nanoseconds */
+        if (b >= 9 && b < 36)
+            fprintf(out, "mt_perf_latency_seconds_bucket{le=\"%.9g\"} %llu\n",
+                    (double)(1ULL << (b + 1)) / 1e9, count);
+    }
+    fprintf(out, "mt_perf_latency_seconds_bucket{le=\"+Inf\"} %llu\n", count);
+    fprintf(out, "mt_perf_latency_seconds_sum %.9f\n", (double)sum / 1e9);
+    fprintf(out, "mt_perf_latency_seconds_count %llu\n", count);
+}
+
+static void metrics_serve(metrics_server_t *metrics, int fd,
+                          unsigned long long *last_cpu, unsigned long long *last_wall)
+{
+    char request[1024];
+    char header[128];
+    char *body = NULL;
+    size_t body_len = 0;
+    FILE *out;
+    int len = 0;
+
+    /* Any request is answered with the metrics, the request line is not
+       looked at */
+    if (read(fd, request, sizeof(request)) <= 0)
+        return;
+
+    out = open_memstream(&body, &body_len);
+    if (NULL == out)
+        return;
+    metrics_write(out, metrics, last_cpu, last_wall);
+    fclose(out);
+
+    len = snprintf(header, sizeof(header),
+                   "HTTP/1.0 200 OK\r\n"
+                   "Content-Type: text/plain; version=0.0.4\r\n"
+                   "Content-Length: %zu\r\n\r\n", body_len);
+    if (write(fd, header, len) == len)
+        if (write(fd, body, body_len) < 0)
+            fprintf(stderr, "# metrics: write failed: %s\n", strerror(errno));
+    free(body);
+}
+
+static void *metrics_thread(void *arg)
+{
+    metrics_server_t *metrics = (metrics_server_t *)arg;
+    unsigned long long last_cpu = 0, last_wall = tests_nsec();
+    struct pollfd pfd;
+    struct timeval timeout = { 1, 0 };
+    int fd;
+
+    /* The server should not take time away from the workers */
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+
+    pfd.fd = metrics->fd;
+    pfd.events = POLLIN;
+    while (!__atomic_load_n(&metrics->stop, __ATOMIC_RELAXED)) {
+        if (poll(&pfd, 1, METRICS_POLL_MSEC) <= 0)
+            continue;
+        fd = accept(metrics->fd, NULL, NULL);
+        if (fd < 0)
+            continue;
+        /* a client that never sends its request does not hold up the stop */
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        metrics_serve(metrics, fd, &last_cpu, &last_wall);
+        close(fd);
+    }
+    return NULL;
+}
+
+/******************************************************************************
+* function:
+*     tests_metrics_start (metrics_server_t *metrics)
+*
+* @param metrics [IN] - endpoint, live counters and number of workers
+*
+* description:
+*   open the metrics endpoint and start the thread serving it
+******************************************************************************/
+int tests_metrics_start(metrics_server_t *metrics)
+{
+    metrics->stop = 0;
+    metrics->phase = METRICS_PHASE_STARTUP;
+    metrics->fd = metrics_listen(metrics->endpoint);
+    if (metrics->fd < 0)
+        return TEST_FAILED;
+
+    if (pthread_create(&metrics->th, NULL, metrics_thread, metrics) != 0) {
+        fprintf(stderr, "# FAIL: could not start the metrics thread\n");
+        close(metrics->fd);
+        metrics->fd = -1;
+        return TEST_FAILED;
+    }
+    return TEST_PASSED;
+}
+
+void tests_metrics_phase(metrics_server_t *metrics, int phase)
+{
+    __atomic_store_n(&metrics->phase, phase, __ATOMIC_RELAXED);
+}
+
+void tests_metrics_stop(metrics_server_t *metrics)
+{
+    if (metrics->fd < 0)
+        return;
+
+    __atomic_store_n(&metrics->stop, 1, __ATOMIC_RELAXED);
+    pthread_join(metrics->th, NULL);
+    close(metrics->fd);
+    metrics->fd = -1;
+    if (0 == strncmp(metrics->endpoint, "unix:", 5))
+        unlink(metrics->endpoint + 5);
+    else if (strchr(metrics->endpoint, '/'))
+        unlink(metrics->endpoint);
+}
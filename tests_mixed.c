@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+#define MIXED_DEFLATE           0
+#define MIXED_INFLATE           1
+
+typedef struct
+{
+    unsigned long ops;
+    unsigned long long bytes;
+    unsigned long long ns;
+    histogram_t latency;
+}
+mixed_result_t;
+
+static const char *mixed_op_name[] = { "deflate", "inflate" };
+static const char *mixed_trace_name[] = { "deflate iteration", "inflate iteration" };
+
+
+
+int
+startup_corpus_mixed(test_parameters_t* test_parameters)
+{
+    /* input_buf holds the corpus and output_buf its compressed stream, the
+       deflate operations write to a buffer of their own */
+    if (TEST_PASSED != tests_startup_corpus_decompression(test_parameters))
+        return TEST_FAILED;
+
+    test_parameters->scratch_buflen = ((test_parameters->input_buflen * 9) / 8) + 5;
+    test_parameters->scratch_buf = malloc(test_parameters->scratch_buflen);
+    if (NULL == test_parameters->scratch_buf) {
+        fprintf(stderr, "# FAIL: Could not allocate deflate output buffer.\n");
+        return TEST_FAILED;
+    }
+
+    return TEST_PASSED;
+}
+
+
+
+static int
+mixed_deflate(test_parameters_t* test_parameters, unsigned long *out_len)
+{
+    z_stream strm;
+    unsigned long long trace = 0;
+    int ret = Z_OK;
+    int flush = test_parameters->enable_deflate_buffering ? Z_NO_FLUSH : Z_SYNC_FLUSH;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, test_parameters->level, 8,
+                       tests_window_bits(test_parameters->streamtype, test_parameters->window_bits),
+                       test_parameters->mem_level, test_parameters->strategy);
+    if (ret != Z_OK)
+        return ret;
+
+    strm.next_out = test_parameters->scratch_buf;
+    strm.avail_out = test_parameters->scratch_buflen;
+    do {
+        strm.next_in = test_parameters->input_buf + strm.total_in;
+        if (strm.total_in + test_parameters->chunksize >= test_parameters->input_buflen) {
+            strm.avail_in = test_parameters->input_buflen - strm.total_in;
+            flush = Z_FINISH;
+        }
+        else {
+            strm.avail_in = test_parameters->chunksize;
+        }
+        trace = tests_trace_start(test_parameters->trace_calls);
+        ret = deflate(&strm, flush);
+        tests_trace_stop(test_parameters->trace_calls, "deflate", trace);
+    } while (ret == Z_OK);
+
+    *out_len = strm.total_out;
+    deflateEnd(&strm);
+    return ret == Z_STREAM_END ? Z_OK : ret;
+}
+
+static int
+mixed_inflate(test_parameters_t* test_parameters, unsigned char *out, unsigned long *out_len)
+{
+    z_stream strm;
+    unsigned long long trace = 0;
+    int ret = Z_OK;
+    int flush = test_parameters->enable_inflate_buffering ? Z_NO_FLUSH : Z_SYNC_FLUSH;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, tests_window_bits(test_parameters->streamtype,
+                                                test_parameters->window_bits));
+    if (ret != Z_OK)
+        return ret;
+
+    strm.next_out = out;
+    strm.avail_out = test_parameters->input_buflen + 100;
+    do {
+        strm.next_in = test_parameters->output_buf + strm.total_in;
+        if (strm.total_in + test_parameters->chunksize >= test_parameters->output_buflen) {
+            strm.avail_in = test_parameters->output_buflen - strm.total_in;
+            flush = Z_FINISH;
+        }
+        else {
+            strm.avail_in = test_parameters->chunksize;
+        }
+        trace = tests_trace_start(test_parameters->trace_calls);
+        ret = inflate(&strm, flush);
+        tests_trace_stop(test_parameters->trace_calls, "inflate", trace);
+    } while (ret == Z_OK);
+
+    *out_len = strm.total_out;
+    inflateEnd(&strm);
+    return ret == Z_STREAM_END ? Z_OK : ret;
+}
+
+
+
+int
+run_corpus_mixed(test_parameters_t* test_parameters)
+{
+    mixed_result_t results[2];
+    mixed_result_t *r;
+    unsigned char *out = NULL;
+    unsigned long out_len = 0;
+    unsigned long long t0 = 0, run_start = 0, trace = 0;
+    unsigned int seed = 0;
+    int percent = 0;
+    int op = 0, i = 0, ret = Z_OK;
+    int verify_now = 0;
+    int failed = TEST_PASSED;
+
+    memset(results, 0, sizeof(results));
+    tests_histogram_init(&results[MIXED_DEFLATE].latency);
+    tests_histogram_init(&results[MIXED_INFLATE].latency);
+
+    /* Share of the operations that are deflates */
+    percent = test_parameters->mix_deflate * 100 /
+              (test_parameters->mix_deflate + test_parameters->mix_inflate);
+    seed = (unsigned int)tests_nsec() ^ (test_parameters->id * 2654435761U);
+
+    /* With -mixthreads the threads are dedicated, the first percent of
+       them deflate and the others inflate */
+    if (test_parameters->mix_per_thread)
+        op = (test_parameters->id * 100 < percent * test_parameters->threads) ?
+             MIXED_DEFLATE : MIXED_INFLATE;
+
+    run_start = tests_nsec();
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        tests_pace(test_parameters, i, run_start);
+        if (!test_parameters->mix_per_thread)
+            op = ((int)(rand_r(&seed) % 100) < percent) ? MIXED_DEFLATE : MIXED_INFLATE;
+        verify_now = tests_verify_due(test_parameters, i);
+
+        out = test_parameters->input_buf;
+        if (verify_now && MIXED_INFLATE == op) {
+            out = tests_verify_buffer(test_parameters);
+            if (NULL == out) {
+                failed = TEST_FAILED;
+                break;
+            }
+        }
+
+        t0 = tests_nsec();
+        trace = tests_trace_start(test_parameters->trace);
+        if (MIXED_DEFLATE == op)
+            ret = mixed_deflate(test_parameters, &out_len);
+        else
+            ret = mixed_inflate(test_parameters, out, &out_len);
+        tests_trace_stop(test_parameters->trace, mixed_trace_name[op], trace);
+        t0 = tests_nsec() - t0;
+
+        if (ret != Z_OK) {
+            fprintf(stderr, "# FAIL: %s operation failed, ret:%d\n", mixed_op_name[op], ret);
+            tests_live_error(test_parameters);
+            failed = TEST_FAILED;
+            break;
+        }
+
+        r = &results[op];
+        r->ops++;
+        r->bytes += test_parameters->input_buflen;
+        r->ns += t0;
+        tests_histogram_add(&r->latency, t0);
+        if (MIXED_DEFLATE == op)
+            tests_live_op(test_parameters, test_parameters->input_buflen, out_len, t0);
+        else
+            tests_live_op(test_parameters, test_parameters->output_buflen, out_len, t0);
+
+        if (verify_now) {
+            if (MIXED_DEFLATE == op)
+                failed = tests_verify_stream(test_parameters, test_parameters->scratch_buf, out_len);
+            else
+                failed = tests_verify_data(test_parameters, out, out_len);
+        }
+
+        test_parameters->single_call_bytes = test_parameters->input_buflen;
+        test_parameters->ratio = (float)test_parameters->output_buflen /
+                                 test_parameters->input_buflen;
+    }
+
+    if (TEST_PASSED == failed) {
+        flockfile(stdout);
+        printf("\nThread %d mixed operations (%d%% deflate%s):\n", test_parameters->id,
+               percent, test_parameters->mix_per_thread ? ", dedicated threads" : "");
+        printf("%8s %8s %10s %10s %10s %10s %10s %10s\n",
+               "Op", "Count", "Mbps", "Mean_us", "p50_us", "p90_us", "p99_us", "Max_us");
+        for (op = MIXED_DEFLATE; op <= MIXED_INFLATE; op++) {
+            r = &results[op];
+            if (0 == r->ops)
+                continue;
+            printf("%8s %8lu %10.2f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                   mixed_op_name[op], r->ops,
+                   (double)r->bytes * 8 * 1000 / r->ns,
+                   (double)r->ns / r->ops / 1000,
+                   (double)tests_histogram_percentile(&r->latency, 50) / 1000,
+                   (double)tests_histogram_percentile(&r->latency, 90) / 1000,
+                   (double)tests_histogram_percentile(&r->latency, 99) / 1000,
+                   (double)r->latency.max / 1000);
+        }
+        funlockfile(stdout);
+    }
+
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_mixed(test_parameters_t* test_parameters)
+{
+    if (test_parameters->scratch_buf) {
+        free(test_parameters->scratch_buf);
+        test_parameters->scratch_buf = NULL;
+        test_parameters->scratch_buflen = 0;
+    }
+    return tests_shutdown_corpus_decompression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_mixed  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a mixed compression/decompression job
+*
+******************************************************************************/
+int
+tests_startup_corpus_mixed(test_parameters_t* test_parameters)
+{
+   return startup_corpus_mixed(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_mixed  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	run a mixed compression/decompression job following the -mix ratio
+*
+******************************************************************************/
+int
+tests_run_corpus_mixed(test_parameters_t* test_parameters)
+{
+    return run_corpus_mixed(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_mixed  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a mixed compression/decompression job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_mixed(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_mixed(test_parameters);
+}
@@ -0,0 +1,599 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* Output room of one request beyond its input, stored blocks at a low
+   memLevel and the gzip wrapper included */
+#define OFFLOAD_ROOM(len)       ((len) + ((len) >> 2) + 64)
+
+/* One engine thread of the device, it keeps its stream from one request
+   to the next and only sets it up again when the parameters change */
+typedef struct offload_engine
+{
+    offload_device_t *device;
+    pthread_t th;
+    z_stream strm;
+    int ready;
+    int level;
+    int window_bits;
+    int mem_level;
+    int strategy;
+    unsigned long long served;
+    unsigned long long busy_nsec;
+}
+offload_engine_t;
+
+static void offload_serve(offload_engine_t *engine, offload_request_t *request)
+{
+    int ret = Z_OK;
+
+    if (engine->ready && (engine->level != request->level ||
+                          engine->window_bits != request->window_bits ||
+                          engine->mem_level != request->mem_level ||
+                          engine->strategy != request->strategy)) {
+        deflateEnd(&engine->strm);
+        engine->ready = 0;
+    }
+
+    if (!engine->ready) {
+        memset(&engine->strm, 0, sizeof(engine->strm));
+        ret = deflateInit2(&engine->strm, request->level, 8, request->window_bits,
+                           request->mem_level, request->strategy);
+        if (ret != Z_OK) {
+            request->status = ret;
+            request->out_len = 0;
+            return;
+        }
+        engine->ready = 1;
+        engine->level = request->level;
+        engine->window_bits = request->window_bits;
+        engine->mem_level = request->mem_level;
+        engine->strategy = request->strategy;
+    }
+    else {
+        deflateReset(&engine->strm);
+    }
+
+    engine->strm.next_in = (z_const Bytef *)request->in;
+    engine->strm.avail_in = request->in_len;
+    engine->strm.next_out = request->out;
+    engine->strm.avail_out = request->out_room;
+    ret = deflate(&engine->strm, Z_FINISH);
+
+    request->out_len = engine->strm.total_out;
+    if (Z_STREAM_END == ret)
+        request->status = Z_OK;
+    else
+        request->status = (Z_OK == ret) ? Z_BUF_ERROR : ret;
+}
+
+static void *offload_engine_thread(void *arg)
+{
+    offload_engine_t *engine = (offload_engine_t *)arg;
+    offload_device_t *device = engine->device;
+    offload_request_t *request = NULL;
+    offload_queue_t *queue = NULL;
+
+    for (;;) {
+        pthread_mutex_lock(&device->lock);
+        while (NULL == device->head && !device->stop)
+            pthread_cond_wait(&device->work, &device->lock);
+        if (NULL == device->head) {
+            pthread_mutex_unlock(&device->lock);
+            break;
+        }
+        request = device->head;
+        device->head = request->next;
+        if (NULL == device->head)
+            device->tail = NULL;
+        pthread_mutex_unlock(&device->lock);
+
+        request->start_nsec = tests_nsec();
+        offload_serve(engine, request);
+        request->done_nsec = tests_nsec();
+        engine->served++;
+        engine->busy_nsec += request->done_nsec - request->start_nsec;
+
+        /* Completions go back on the queue of the worker that submitted them */
+        queue = request->queue;
+        request->next = NULL;
+        pthread_mutex_lock(&queue->lock);
+        if (queue->tail)
+            queue->tail->next = request;
+        else
+            queue->head = request;
+        queue->tail = request;
+        pthread_cond_signal(&queue->done);
+        pthread_mutex_unlock(&queue->lock);
+    }
+
+    if (engine->ready)
+        deflateEnd(&engine->strm);
+    return NULL;
+}
+
+/******************************************************************************
+* function:
+*     tests_offload_open (offload_device_t *device, int engines)
+*
+* @param device  [OUT] - device to start
+* @param engines [IN] - number of engine threads
+*
+* description:
+*   start a software offload device of engine threads that take deflate
+*   requests off one submission list in the order they were submitted
+******************************************************************************/
+int tests_offload_open(offload_device_t *device, int engines)
+{
+    int i;
+
+    memset(device, 0, sizeof(*device));
+    pthread_mutex_init(&device->lock, NULL);
+    pthread_cond_init(&device->work, NULL);
+    device->engine = calloc(engines, sizeof(offload_engine_t));
+    if (NULL == device->engine) {
+        fprintf(stderr, "# FAIL: Could not allocate %d offload engines\n", engines);
+        return TEST_FAILED;
+    }
+
+    device->open_nsec = tests_nsec();
+    for (i = 0; i < engines; i++) {
+        device->engine[i].device = device;
+        if (pthread_create(&device->engine[i].th, NULL, offload_engine_thread,
+                           &device->engine[i]) != 0) {
+            fprintf(stderr, "# FAIL: could not start offload engine %d\n", i);
+            tests_offload_close(device);
+            return TEST_FAILED;
+        }
+        device->engines++;
+    }
+    return TEST_PASSED;
+}
+
+/******************************************************************************
+* function:
+*     tests_offload_close (offload_device_t *device)
+*
+* @param device [IN] - device to stop
+*
+* description:
+*   let the engines finish the requests already submitted, stop them and
+*   print how busy each one was while the device was open
+******************************************************************************/
+void tests_offload_close(offload_device_t *device)
+{
+    unsigned long long open_nsec = tests_nsec() - device->open_nsec;
+    int i;
+
+    pthread_mutex_lock(&device->lock);
+    device->stop = 1;
+    pthread_cond_broadcast(&device->work);
+    pthread_mutex_unlock(&device->lock);
+
+    for (i = 0; i < device->engines; i++)
+        pthread_join(device->engine[i].th, NULL);
+
+    if (device->engines)
+        printf("\nOffload device, %d engines:\n", device->engines);
+    for (i = 0; i < device->engines; i++)
+        printf("\tEngine %-3d %10llu requests, busy %5.1f%%\n", i, device->engine[i].served,
+               open_nsec ? (double)device->engine[i].busy_nsec * 100 / open_nsec : 0);
+
+    free(device->engine);
+    device->engine = NULL;
+    device->engines = 0;
+    pthread_cond_destroy(&device->work);
+    pthread_mutex_destroy(&device->lock);
+}
+
+void tests_offload_queue_init(offload_queue_t *queue, offload_device_t *device)
+{
+    memset(queue, 0, sizeof(*queue));
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->done, NULL);
+    queue->device = device;
+}
+
+void tests_offload_queue_destroy(offload_queue_t *queue)
+{
+    pthread_cond_destroy(&queue->done);
+    pthread_mutex_destroy(&queue->lock);
+}
+
+/******************************************************************************
+* function:
+*     tests_offload_submit (offload_queue_t *queue, offload_request_t **requests,
+*                           int n)
+*
+* @param queue    [IN] - queue of the submitting worker
+* @param requests [IN] - requests to submit
+* @param n        [IN] - number of requests
+*
+* description:
+*   hand n requests to the device with one lock and one wake up, as a
+*   doorbell write covers a batch of descriptors. The call does not wait
+*   for any of them.
+******************************************************************************/
+int tests_offload_submit(offload_queue_t *queue, offload_request_t **requests, int n)
+{
+    offload_device_t *device = queue->device;
+    unsigned long long now = tests_nsec();
+    int i;
+
+    if (n <= 0)
+        return 0;
+
+    for (i = 0; i < n; i++) {
+        requests[i]->queue = queue;
+        requests[i]->submit_nsec = now;
+        requests[i]->next = (i + 1 < n) ? requests[i + 1] : NULL;
+    }
+
+    pthread_mutex_lock(&device->lock);
+    if (device->tail)
+        device->tail->next = requests[0];
+    else
+        device->head = requests[0];
+    device->tail = requests[n - 1];
+    if (n > 1)
+        pthread_cond_broadcast(&device->work);
+    else
+        pthread_cond_signal(&device->work);
+    pthread_mutex_unlock(&device->lock);
+    return n;
+}
+
+/******************************************************************************
+* function:
+*     tests_offload_poll (offload_queue_t *queue, offload_request_t **done,
+*                         int max, int wait)
+*
+* @param queue [IN] - queue of the polling worker
+* @param done  [OUT] - completed requests
+* @param max   [IN] - room in done
+* @param wait  [IN] - block until at least one request completes
+*
+* description:
+*   returns the number of completed requests taken off the queue, in the
+*   order they completed
+******************************************************************************/
+int tests_offload_poll(offload_queue_t *queue, offload_request_t **done, int max, int wait)
+{
+    int n = 0;
+
+    pthread_mutex_lock(&queue->lock);
+    while (wait && NULL == queue->head)
+        pthread_cond_wait(&queue->done, &queue->lock);
+    while (n < max && queue->head) {
+        done[n++] = queue->head;
+        queue->head = queue->head->next;
+    }
+    if (NULL == queue->head)
+        queue->tail = NULL;
+    pthread_mutex_unlock(&queue->lock);
+    return n;
+}
+
+
+
+int
+startup_corpus_offload(test_parameters_t* test_parameters)
+{
+    unsigned long chunks = 0;
+
+    if (NULL == test_parameters->offload) {
+        fprintf(stderr, "# FAIL: the offload test has no offload device\n");
+        return TEST_FAILED;
+    }
+    if (TEST_PASSED != tests_startup_corpus_compression(test_parameters))
+        return TEST_FAILED;
+
+    /* Every chunk of the corpus is one request with an output slot of its
+       own, so requests in flight never share a buffer */
+    chunks = (test_parameters->input_buflen + test_parameters->chunksize - 1) /
+             test_parameters->chunksize;
+    test_parameters->scratch_buflen = chunks * OFFLOAD_ROOM(test_parameters->chunksize);
+    test_parameters->scratch_buf = malloc(test_parameters->scratch_buflen);
+    if (NULL == test_parameters->scratch_buf) {
+        fprintf(stderr, "# FAIL: Could not allocate offload output slots.\n");
+        return TEST_FAILED;
+    }
+
+    return TEST_PASSED;
+}
+
+
+
+/******************************************************************************
+* function:
+*     offload_verify (test_parameters_t* test_parameters,
+*                     const unsigned long *slot_len, unsigned long chunks)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param slot_len        [IN] - compressed length in each output slot
+* @param chunks          [IN] - number of slots
+*
+* description:
+*   inflate every slot in chunk order into the verify buffer and check the
+*   result against the corpus. The time taken is not part of the run.
+******************************************************************************/
+static int
+offload_verify(test_parameters_t* test_parameters, const unsigned long *slot_len,
+               unsigned long chunks)
+{
+    z_stream strm;
+    unsigned char *out = NULL;
+    unsigned long slot = OFFLOAD_ROOM(test_parameters->chunksize);
+    unsigned long c, pos = 0;
+    verify_span_t span;
+    int windowbits = tests_window_bits(test_parameters->streamtype,
+                                       test_parameters->window_bits);
+    int ret = Z_OK;
+
+    out = tests_verify_buffer(test_parameters);
+    if (NULL == out)
+        return TEST_FAILED;
+
+    tests_verify_start(&span);
+    for (c = 0; c < chunks; c++) {
+        memset(&strm, 0, sizeof(strm));
+        ret = inflateInit2(&strm, windowbits);
+        if (ret != Z_OK)
+            break;
+        strm.next_in = test_parameters->scratch_buf + c * slot;
+        strm.avail_in = slot_len[c];
+        strm.next_out = out + pos;
+        strm.avail_out = test_parameters->input_buflen + 100 - pos;
+        ret = inflate(&strm, Z_FINISH);
+        pos += strm.total_out;
+        inflateEnd(&strm);
+        if (ret != Z_STREAM_END)
+            break;
+    }
+    tests_verify_stop(test_parameters, &span);
+
+    if (ret != Z_STREAM_END) {
+        fprintf(stderr, "# FAIL: thread %d verify inflate of request %lu failed, ret:%d\n",
+                test_parameters->id, c, ret);
+        return TEST_FAILED;
+    }
+    return tests_verify_data(test_parameters, out, pos);
+}
+
+
+
+int
+run_corpus_offload(test_parameters_t* test_parameters)
+{
+    offload_queue_t queue;
+    offload_request_t *requests = NULL;
+    offload_request_t **free_list = NULL, **done = NULL;
+    offload_request_t *req;
+    unsigned long *slot_len = NULL;
+    unsigned long slot = OFFLOAD_ROOM(test_parameters->chunksize);
+    unsigned long chunks = 0, next = 0, completed = 0, len = 0;
+    unsigned long long t0 = 0, iter_start = 0, run_start = 0, trace = 0;
+    unsigned long long submits = 0, submit_ns = 0, polls = 0, poll_ns = 0, empty = 0;
+    unsigned long long inflight_sum = 0, queue_ns = 0, wait_ns = 0, requests_done = 0;
+    unsigned long long bytes_in = 0, bytes_out = 0, busy_ns = 0, out_total = 0;
+    histogram_t latency;
+    int depth = test_parameters->offload_depth;
+    int batch = test_parameters->offload_batch;
+    int windowbits = tests_window_bits(test_parameters->streamtype,
+                                       test_parameters->window_bits);
+    int nfree = 0, inflight = 0, want = 0, n = 0, got = 0;
+    int failed = TEST_PASSED;
+    int i, j;
+
+    chunks = (test_parameters->input_buflen + test_parameters->chunksize - 1) /
+             test_parameters->chunksize;
+    requests = calloc(depth, sizeof(offload_request_t));
+    free_list = malloc(depth * sizeof(offload_request_t *));
+    done = malloc(depth * sizeof(offload_request_t *));
+    slot_len = malloc(chunks * sizeof(unsigned long));
+    if (NULL == requests || NULL == free_list || NULL == done || NULL == slot_len) {
+        fprintf(stderr, "# FAIL: Could not allocate %d offload requests.\n", depth);
+        free(requests);
+        free(free_list);
+        free(done);
+        free(slot_len);
+        return TEST_FAILED;
+    }
+
+    tests_histogram_init(&latency);
+    tests_offload_queue_init(&queue, test_parameters->offload);
+    run_start = tests_nsec();
+
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        tests_pace(test_parameters, i, run_start);
+        iter_start = tests_nsec();
+        trace = tests_trace_start(test_parameters->trace);
+
+        for (j = 0; j < depth; j++)
+            free_list[j] = &requests[j];
+        nfree = depth;
+        next = 0;
+        completed = 0;
+        out_total = 0;
+
+        while (completed < chunks) {
+            /* A batch is only submitted whole, or with the chunks left */
+            want = batch;
+            if ((unsigned long)want > chunks - next)
+                want = chunks - next;
+            if (want > 0 && nfree >= want) {
+                for (n = 0; n < want; n++) {
+                    req = free_list[--nfree];
+                    len = test_parameters->input_buflen - next * test_parameters->chunksize;
+                    if (len > (unsigned long)test_parameters->chunksize)
+                        len = test_parameters->chunksize;
+                    req->in = test_parameters->input_buf + next * test_parameters->chunksize;
+                    req->in_len = len;
+                    req->out = test_parameters->scratch_buf + next * slot;
+                    req->out_room = slot;
+                    req->level = test_parameters->level;
+                    req->window_bits = windowbits;
+                    req->mem_level = test_parameters->mem_level;
+                    req->strategy = test_parameters->strategy;
+                    req->tag = next++;
+                    done[n] = req;
+                }
+                t0 = tests_nsec();
+                tests_offload_submit(&queue, done, want);
+                submit_ns += tests_nsec() - t0;
+                submits++;
+                inflight += want;
+                continue;
+            }
+
+            /* Nothing more can go in: poll, and when nothing has completed
+               yet block until something does */
+            inflight_sum += inflight;
+            t0 = tests_nsec();
+            got = tests_offload_poll(&queue, done, depth, 0);
+            poll_ns += tests_nsec() - t0;
+            polls++;
+            if (0 == got) {
+                empty++;
+                t0 = tests_nsec();
+                got = tests_offload_poll(&queue, done, depth, 1);
+                wait_ns += tests_nsec() - t0;
+            }
+
+            for (n = 0; n < got; n++) {
+                req = done[n];
+                if (req->status != Z_OK && TEST_PASSED == failed) {
+                    fprintf(stderr, "# FAIL: offload request %lu failed, ret:%d\n",
+                            req->tag, req->status);
+                    tests_live_error(test_parameters);
+                    failed = TEST_FAILED;
+                }
+                slot_len[req->tag] = req->out_len;
+                out_total += req->out_len;
+                tests_histogram_add(&latency, req->done_nsec - req->submit_nsec);
+                queue_ns += req->start_nsec - req->submit_nsec;
+                busy_ns += req->done_nsec - req->start_nsec;
+                requests_done++;
+                free_list[nfree++] = req;
+                inflight--;
+                completed++;
+            }
+        }
+
+        tests_trace_stop(test_parameters->trace, "offload iteration", trace);
+        if (TEST_PASSED != failed)
+            break;
+
+        bytes_in += test_parameters->input_buflen;
+        bytes_out += out_total;
+        tests_live_op(test_parameters, test_parameters->input_buflen, out_total,
+                      tests_nsec() - iter_start);
+
+        if (tests_verify_due(test_parameters, i))
+            failed = offload_verify(test_parameters, slot_len, chunks);
+    }
+
+    tests_offload_queue_destroy(&queue);
+    free(requests);
+    free(free_list);
+    free(done);
+    free(slot_len);
+
+    if (TEST_PASSED != failed || 0 == requests_done)
+        return failed;
+
+    flockfile(stdout);
+    printf("\nThread %d offload, %lu requests of %d bytes per iteration, depth %d, batch %d:\n",
+           test_parameters->id, chunks, test_parameters->chunksize, depth, batch);
+    printf("\tRequests      = %llu\n", requests_done);
+    printf("\tSubmit calls  = %llu, %.0f nsec per call\n", submits,
+           submits ? (double)submit_ns / submits : 0);
+    printf("\tPoll calls    = %llu, %.0f nsec per call, %.1f%% empty\n", polls,
+           polls ? (double)poll_ns / polls : 0, polls ? (double)empty * 100 / polls : 0);
+    printf("\tBlocked       = %.1f msec waiting for a completion\n", (double)wait_ns / 1000000);
+    printf("\tIn flight     = %.1f mean at poll\n", polls ? (double)inflight_sum / polls : 0);
+    printf("\tQueue wait    = %.1f usec mean\n", (double)queue_ns / requests_done / 1000);
+    printf("\tService time  = %.1f usec mean\n", (double)busy_ns / requests_done / 1000);
+    printf("\tLatency       = %.1f usec p50, %.1f usec p99, %.1f usec max\n",
+           (double)tests_histogram_percentile(&latency, 50) / 1000,
+           (double)tests_histogram_percentile(&latency, 99) / 1000,
+           (double)latency.max / 1000);
+    funlockfile(stdout);
+
+    test_parameters->single_call_bytes = test_parameters->input_buflen;
+    test_parameters->ratio = (float)bytes_out / bytes_in;
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_offload(test_parameters_t* test_parameters)
+{
+    if (test_parameters->scratch_buf) {
+        free(test_parameters->scratch_buf);
+        test_parameters->scratch_buf = NULL;
+        test_parameters->scratch_buflen = 0;
+    }
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_offload  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup an offload compression job
+*
+******************************************************************************/
+int
+tests_startup_corpus_offload(test_parameters_t* test_parameters)
+{
+   return startup_corpus_offload(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_offload  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	compress the corpus through the offload device, -k bytes per request
+*
+******************************************************************************/
+int
+tests_run_corpus_offload(test_parameters_t* test_parameters)
+{
+    return run_corpus_offload(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_offload  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown an offload compression job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_offload(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_offload(test_parameters);
+}
@@ -0,0 +1,672 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* Output room of a deflate record beyond compressBound of its bytes, for
+   a gzip header and trailer */
+#define REPLAY_ROOM(len)        (compressBound(len) + 32)
+
+static const char *replay_op_name[] = { "deflate", "inflate" };
+
+/* Taken by the workers starting up while the first builds the streams */
+static pthread_mutex_t replay_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Where the compressed slice an inflate record reads is, a table of these
+   for every record of the trace starts the streams and the slices follow */
+typedef struct
+{
+    unsigned long offset;
+    unsigned long len;
+}
+replay_slot_t;
+
+typedef struct
+{
+    unsigned long ops;
+    unsigned long long bytes;
+    unsigned long long bytes_z;
+    unsigned long long ns;
+    histogram_t latency;
+}
+replay_result_t;
+
+/******************************************************************************
+* function:
+*     replay_field (char **line)
+*
+* @param line [IN] - rest of the line, moved past the field
+*
+* description:
+*   returns the next comma separated field of a line with the blanks
+*   around it taken off
+******************************************************************************/
+static char *replay_field(char **line)
+{
+    char *field = *line, *end = NULL;
+
+    if (NULL == field)
+        return "";
+    *line = strchr(field, ',');
+    if (*line)
+        *(*line)++ = '\0';
+    while (*field == ' ' || *field == '\t')
+        field++;
+    end = field + strlen(field);
+    while (end > field && (end[-1] == ' ' || end[-1] == '\t' ||
+                           end[-1] == '\r' || end[-1] == '\n'))
+        *--end = '\0';
+    return field;
+}
+
+/******************************************************************************
+* function:
+*     replay_parse (char *line, replay_record_t *record)
+*
+* @param line   [IN] - line of the trace
+* @param record [OUT] - record read from it
+*
+* description:
+*   read "timestamp_usec,operation,size,level,stream" where the operation is
+*   deflate or inflate (d or i) and the stream raw, zlib or gzip (or the -s
+*   number). Returns 0, or -1 when the line is not a record.
+******************************************************************************/
+static int replay_parse(char *line, replay_record_t *record)
+{
+    char *field = NULL, *end = NULL;
+    double usec = 0;
+    long value = 0;
+
+    field = replay_field(&line);
+    usec = strtod(field, &end);
+    if (end == field || *end != '\0' || usec < 0)
+        return -1;
+    record->usec = (unsigned long long)usec;
+
+    field = replay_field(&line);
+    if (!strcasecmp(field, "deflate") || !strcasecmp(field, "d"))
+        record->op = REPLAY_DEFLATE;
+    else if (!strcasecmp(field, "inflate") || !strcasecmp(field, "i"))
+        record->op = REPLAY_INFLATE;
+    else
+        return -1;
+
+    field = replay_field(&line);
+    value = strtol(field, &end, 10);
+    if (end == field || *end != '\0' || value < 1)
+        return -1;
+    record->size = value;
+
+    field = replay_field(&line);
+    value = strtol(field, &end, 10);
+    if (end == field || *end != '\0' || value < -1 || value > 9)
+        return -1;
+    record->level = value;
+
+    field = replay_field(&line);
+    if (!strcasecmp(field, "raw"))
+        record->stream = RAW_DEFLATE_STREAM;
+    else if (!strcasecmp(field, "zlib"))
+        record->stream = ZLIB_DEFLATE_STREAM;
+    else if (!strcasecmp(field, "gzip"))
+        record->stream = GZIP_DEFLATE_STREAM;
+    else {
+        value = strtol(field, &end, 10);
+        if (end == field || *end != '\0' || value < 0 || value > STREAMTYPE_MAX)
+            return -1;
+        record->stream = value;
+    }
+
+    return line ? -1 : 0;
+}
+
+/******************************************************************************
+* function:
+*     tests_replay_load (const char *path, replay_trace_t *trace)
+*
+* @param path  [IN] - CSV file of the trace
+* @param trace [OUT] - records of the trace, times taken from the first
+*
+* description:
+*   read a trace of recorded traffic, one record a line. Blank lines, lines
+*   starting with # and one header line before the first record are
+*   skipped, any other line that is not a record is an error. The records
+*   must be in time order.
+******************************************************************************/
+int tests_replay_load(const char *path, replay_trace_t *trace)
+{
+    replay_record_t *grown = NULL;
+    replay_record_t record;
+    char line[512];
+    char *start = NULL;
+    int room = 0, lineno = 0, header = 0, i;
+    FILE *f;
+
+    memset(trace, 0, sizeof(*trace));
+    f = fopen(path, "r");
+    if (NULL == f) {
+        fprintf(stderr, "Error: could not open replay trace %s\n", path);
+        return TEST_FAILED;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        lineno++;
+        for (start = line; *start == ' ' || *start == '\t'; start++)
+            ;
+        if (*start == '#' || *start == '\n' || *start == '\r' || *start == '\0')
+            continue;
+
+        if (replay_parse(start, &record) != 0) {
+            /* a header naming the columns may come first */
+            if (0 == trace->count && !header && (*start < '0' || *start > '9')) {
+                header = 1;
+                continue;
+            }
+            fprintf(stderr, "Error: %s:%d: expected timestamp_usec,deflate|inflate,size,"
+                            "level,raw|zlib|gzip\n", path, lineno);
+            goto fail;
+        }
+        if (trace->count && record.usec < trace->records[trace->count - 1].usec) {
+            fprintf(stderr, "Error: %s:%d: the records are not in time order\n", path, lineno);
+            goto fail;
+        }
+
+        if (trace->count == room) {
+            room = room ? room * 2 : 1024;
+            grown = realloc(trace->records, room * sizeof(replay_record_t));
+            if (NULL == grown) {
+                fprintf(stderr, "Error: could not allocate the replay trace\n");
+                goto fail;
+            }
+            trace->records = grown;
+        }
+        trace->records[trace->count++] = record;
+        if (record.size > trace->max_size)
+            trace->max_size = record.size;
+    }
+    fclose(f);
+
+    if (0 == trace->count) {
+        fprintf(stderr, "Error: %s holds no records\n", path);
+        tests_replay_free(trace);
+        return TEST_FAILED;
+    }
+
+    /* times are kept from the first record */
+    for (i = trace->count - 1; i >= 0; i--)
+        trace->records[i].usec -= trace->records[0].usec;
+    trace->span_usec = trace->records[trace->count - 1].usec;
+    return TEST_PASSED;
+
+fail:
+    fclose(f);
+    tests_replay_free(trace);
+    return TEST_FAILED;
+}
+
+void tests_replay_free(replay_trace_t *trace)
+{
+    free(trace->records);
+    free(trace->streams);
+    trace->records = NULL;
+    trace->streams = NULL;
+    trace->count = 0;
+}
+
+/* Records the worker replays, every threads-th one from its id */
+static int replay_mine(test_parameters_t* test_parameters)
+{
+    int count = test_parameters->replay->count;
+
+    if (test_parameters->id >= count)
+        return 0;
+    return (count - test_parameters->id + test_parameters->threads - 1) /
+           test_parameters->threads;
+}
+
+/* A record is replayed on a slice of the corpus of its size, from a place
+   picked by its index so the records do not all see the same bytes. The
+   startup made sure no record is larger than the corpus. */
+static unsigned long replay_slice(test_parameters_t* test_parameters, int r,
+                                  const unsigned char **data)
+{
+    unsigned long len = test_parameters->replay->records[r].size;
+
+    *data = test_parameters->input_buf +
+            ((unsigned long long)r * 2654435761ULL) % (test_parameters->input_buflen - len + 1);
+    return len;
+}
+
+
+
+/******************************************************************************
+* function:
+*     replay_streams (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - parameters of the first worker to start up
+*
+* description:
+*   compress the slices the inflate records read, at the level and in the
+*   stream type they were recorded with, into the streams of the trace.
+*   Every worker reads them all: worker processes share the startup of the
+*   first and -scale changes how the records are split between the threads
+*   after it. The slices are the same for every worker as they all load
+*   the same corpus, so they are only compressed once.
+******************************************************************************/
+static int
+replay_streams(test_parameters_t* test_parameters)
+{
+    replay_trace_t *trace = test_parameters->replay;
+    replay_slot_t *slot = NULL;
+    unsigned char *streams = NULL;
+    const unsigned char *data = NULL;
+    unsigned long len = 0, room = 0, used = 0;
+    uLongf out_len = 0;
+    z_stream strm;
+    int r = 0, ret = Z_OK;
+
+    room = trace->count * sizeof(replay_slot_t);
+    for (r = 0; r < trace->count; r++)
+        if (REPLAY_INFLATE == trace->records[r].op)
+            room += REPLAY_ROOM(replay_slice(test_parameters, r, &data));
+    streams = malloc(room ? room : 1);
+    if (NULL == streams) {
+        fprintf(stderr, "# FAIL: Could not allocate replay inflate streams.\n");
+        return TEST_FAILED;
+    }
+    slot = (replay_slot_t *)streams;
+    used = trace->count * sizeof(replay_slot_t);
+
+    for (r = 0; r < trace->count; r++) {
+        slot[r].offset = used;
+        slot[r].len = 0;
+        if (REPLAY_DEFLATE == trace->records[r].op)
+            continue;
+
+        len = replay_slice(test_parameters, r, &data);
+        memset(&strm, 0, sizeof(strm));
+        ret = deflateInit2(&strm, trace->records[r].level, 8,
+                           tests_window_bits(trace->records[r].stream,
+                                             test_parameters->window_bits),
+                           test_parameters->mem_level, test_parameters->strategy);
+        if (ret != Z_OK)
+            break;
+        strm.next_in = (z_const Bytef *)data;
+        strm.avail_in = len;
+        strm.next_out = streams + used;
+        strm.avail_out = room - used;
+        ret = deflate(&strm, Z_FINISH);
+        out_len = strm.total_out;
+        deflateEnd(&strm);
+        if (ret != Z_STREAM_END)
+            break;
+        slot[r].len = out_len;
+        used += out_len;
+        ret = Z_OK;
+    }
+    if (ret != Z_OK) {
+        fprintf(stderr, "# FAIL: compressing replay record %d failed, ret:%d\n", r, ret);
+        free(streams);
+        return TEST_FAILED;
+    }
+
+    trace->streams = streams;
+    return TEST_PASSED;
+}
+
+
+
+int
+startup_corpus_replay(test_parameters_t* test_parameters)
+{
+    replay_trace_t *trace = test_parameters->replay;
+    int failed = TEST_PASSED;
+
+    if (NULL == trace) {
+        fprintf(stderr, "# FAIL: the replay test has no trace, use -replay <file>\n");
+        return TEST_FAILED;
+    }
+    if (TEST_PASSED != tests_startup_corpus_compression(test_parameters))
+        return TEST_FAILED;
+
+    /* A record cut down to the corpus would not be the recorded workload */
+    if (trace->max_size > test_parameters->input_buflen) {
+        fprintf(stderr, "# FAIL: the replay trace has records of up to %lu bytes, larger than "
+                "the %lu byte corpus\n", trace->max_size, test_parameters->input_buflen);
+        return TEST_FAILED;
+    }
+
+    /* One buffer takes the output of a record of any size and operation */
+    test_parameters->scratch_buflen = REPLAY_ROOM(trace->max_size);
+    test_parameters->scratch_buf = malloc(test_parameters->scratch_buflen);
+    if (NULL == test_parameters->scratch_buf) {
+        fprintf(stderr, "# FAIL: Could not allocate replay output buffer.\n");
+        return TEST_FAILED;
+    }
+
+    pthread_mutex_lock(&replay_lock);
+    if (NULL == trace->streams)
+        failed = replay_streams(test_parameters);
+    pthread_mutex_unlock(&replay_lock);
+
+    return failed;
+}
+
+
+
+/******************************************************************************
+* function:
+*     replay_record (test_parameters_t* test_parameters, int r,
+*                    const replay_slot_t *slot, unsigned long *in_len,
+*                    unsigned long *out_len)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param r               [IN] - index of the record in the trace
+* @param slot            [IN] - compressed slice of an inflate record
+* @param in_len          [OUT] - bytes the operation consumed
+* @param out_len         [OUT] - bytes written to scratch_buf
+*
+* description:
+*   replay one record as the service would handle one message: a stream of
+*   its own set up, fed the whole message in one call and torn down
+******************************************************************************/
+static int
+replay_record(test_parameters_t* test_parameters, int r, const replay_slot_t *slot,
+              unsigned long *in_len, unsigned long *out_len)
+{
+    replay_record_t *record = &test_parameters->replay->records[r];
+    const unsigned char *data = NULL;
+    unsigned long len = replay_slice(test_parameters, r, &data);
+    int windowbits = tests_window_bits(record->stream, test_parameters->window_bits);
+    z_stream strm;
+    int ret = Z_OK;
+
+    memset(&strm, 0, sizeof(strm));
+    if (REPLAY_DEFLATE == record->op) {
+        ret = deflateInit2(&strm, record->level, 8, windowbits,
+                           test_parameters->mem_level, test_parameters->strategy);
+        if (ret != Z_OK)
+            return ret;
+        strm.next_in = (z_const Bytef *)data;
+        strm.avail_in = len;
+        strm.next_out = test_parameters->scratch_buf;
+        strm.avail_out = test_parameters->scratch_buflen;
+        ret = deflate(&strm, Z_FINISH);
+        *in_len = strm.total_in;
+        *out_len = strm.total_out;
+        deflateEnd(&strm);
+    }
+    else {
+        ret = inflateInit2(&strm, windowbits);
+        if (ret != Z_OK)
+            return ret;
+        strm.next_in = test_parameters->replay->streams + slot->offset;
+        strm.avail_in = slot->len;
+        strm.next_out = test_parameters->scratch_buf;
+        strm.avail_out = len;
+        ret = inflate(&strm, Z_FINISH);
+        *in_len = strm.total_in;
+        *out_len = strm.total_out;
+        inflateEnd(&strm);
+        if (Z_STREAM_END == ret && *out_len != len)
+            ret = Z_DATA_ERROR;
+    }
+    return ret == Z_STREAM_END ? Z_OK : (ret == Z_OK ? Z_BUF_ERROR : ret);
+}
+
+/******************************************************************************
+* function:
+*     replay_verify (test_parameters_t* test_parameters, int r,
+*                    unsigned char *out, unsigned long out_len)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param r               [IN] - index of the record in the trace
+* @param out             [IN] - verify buffer
+* @param out_len         [IN] - bytes the record left in scratch_buf
+*
+* description:
+*   check a replayed record against its slice of the corpus, inflating the
+*   output of a deflate record first. The time taken is not part of the run.
+******************************************************************************/
+static int
+replay_verify(test_parameters_t* test_parameters, int r, unsigned char *out,
+              unsigned long out_len)
+{
+    replay_record_t *record = &test_parameters->replay->records[r];
+    const unsigned char *data = NULL;
+    unsigned long len = replay_slice(test_parameters, r, &data);
+    verify_span_t span;
+    z_stream strm;
+    int ret = Z_STREAM_END;
+
+    tests_verify_start(&span);
+    if (REPLAY_DEFLATE == record->op) {
+        memset(out, 0, len);
+        memset(&strm, 0, sizeof(strm));
+        ret = inflateInit2(&strm, tests_window_bits(record->stream,
+                                                    test_parameters->window_bits));
+        if (Z_OK == ret) {
+            strm.next_in = test_parameters->scratch_buf;
+            strm.avail_in = out_len;
+            strm.next_out = out;
+            strm.avail_out = len;
+            ret = inflate(&strm, Z_FINISH);
+            out_len = strm.total_out;
+            inflateEnd(&strm);
+        }
+    }
+    else {
+        out = test_parameters->scratch_buf;
+    }
+
+    tests_verify_stop(test_parameters, &span);
+    if (ret != Z_STREAM_END || out_len != len || memcmp(out, data, len) != 0) {
+        fprintf(stderr, "# FAIL: thread %d replay record %d (%s of %lu bytes) does not "
+                "match, ret:%d\n", test_parameters->id, r, replay_op_name[record->op],
+                len, ret);
+        return TEST_FAILED;
+    }
+    return TEST_PASSED;
+}
+
+
+
+int
+run_corpus_replay(test_parameters_t* test_parameters)
+{
+    replay_trace_t *trace = test_parameters->replay;
+    replay_slot_t *slot = (replay_slot_t *)trace->streams;
+    replay_result_t results[2];
+    replay_result_t *res;
+    histogram_t lag;
+    unsigned char *out = NULL;
+    unsigned long in_len = 0, out_len = 0;
+    unsigned long long t0 = 0, trace_span = 0, run_start = 0, pass_start = 0;
+    unsigned long long due = 0, now = 0, bytes = 0, bytes_z = 0;
+    struct timespec ts;
+    int mine = replay_mine(test_parameters);
+    int verify_now = 0;
+    int failed = TEST_PASSED;
+    int i, k, r, op, ret;
+
+    memset(results, 0, sizeof(results));
+    tests_histogram_init(&results[REPLAY_DEFLATE].latency);
+    tests_histogram_init(&results[REPLAY_INFLATE].latency);
+    tests_histogram_init(&lag);
+
+    run_start = tests_nsec();
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        verify_now = tests_verify_due(test_parameters, i);
+        out = verify_now ? tests_verify_buffer(test_parameters) : NULL;
+        if (verify_now && NULL == out) {
+            failed = TEST_FAILED;
+            break;
+        }
+
+        /* A paced pass starts when the previous one was due to end */
+        pass_start = run_start + i * trace->span_usec * 1000;
+        bytes = 0;
+        bytes_z = 0;
+        for (k = 0, r = test_parameters->id; k < mine && TEST_PASSED == failed;
+             k++, r += test_parameters->threads) {
+            if (tests_stop_requested())
+                break;
+            if (trace->paced) {
+                due = pass_start + trace->records[r].usec * 1000;
+                now = tests_nsec();
+                if (now < due) {
+                    ts.tv_sec = (due - now) / 1000000000ULL;
+                    ts.tv_nsec = (due - now) % 1000000000ULL;
+                    nanosleep(&ts, NULL);
+                    now = tests_nsec();
+                }
+                /* how late the record started, a worker that falls behind
+                   runs the records that are due without pauses */
+                tests_histogram_add(&lag, now > due ? now - due : 0);
+            }
+
+            op = trace->records[r].op;
+            t0 = tests_nsec();
+            trace_span = tests_trace_start(test_parameters->trace);
+            ret = replay_record(test_parameters, r, &slot[r], &in_len, &out_len);
+            tests_trace_stop(test_parameters->trace, replay_op_name[op], trace_span);
+            t0 = tests_nsec() - t0;
+
+            if (ret != Z_OK) {
+                fprintf(stderr, "# FAIL: replay record %d %s failed, ret:%d\n", r,
+                        replay_op_name[op], ret);
+                tests_live_error(test_parameters);
+                failed = TEST_FAILED;
+                break;
+            }
+
+            res = &results[op];
+            res->ops++;
+            res->ns += t0;
+            tests_histogram_add(&res->latency, t0);
+            tests_live_op(test_parameters, in_len, out_len, t0);
+            if (REPLAY_DEFLATE == op) {
+                res->bytes += in_len;
+                res->bytes_z += out_len;
+            }
+            else {
+                res->bytes += out_len;
+                res->bytes_z += in_len;
+            }
+            bytes += REPLAY_DEFLATE == op ? in_len : out_len;
+            bytes_z += REPLAY_DEFLATE == op ? out_len : in_len;
+
+            if (verify_now)
+                failed = replay_verify(test_parameters, r, out, out_len);
+        }
+        if (verify_now && TEST_PASSED == failed)
+            test_parameters->verify_checked++;
+
+        test_parameters->single_call_bytes = bytes;
+        test_parameters->ratio = bytes ? (float)bytes_z / bytes : 0;
+    }
+
+    if (TEST_PASSED == failed && mine > 0) {
+        flockfile(stdout);
+        printf("\nThread %d replay of %d of %d records, %s:\n", test_parameters->id, mine,
+               trace->count, trace->paced ? "at the recorded times" : "as fast as possible");
+        printf("%8s %8s %10s %8s %10s %10s %10s %10s %10s %10s\n", "Op", "Count", "MB",
+               "Ratio", "Mbps", "Mean_us", "p50_us", "p90_us", "p99_us", "Max_us");
+        for (op = REPLAY_DEFLATE; op <= REPLAY_INFLATE; op++) {
+            res = &results[op];
+            if (0 == res->ops)
+                continue;
+            printf("%8s %8lu %10.2f %8.4f %10.2f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                   replay_op_name[op], res->ops, (double)res->bytes / 1e6,
+                   (double)res->bytes_z / res->bytes,
+                   res->ns ? (double)res->bytes * 8 * 1000 / res->ns : 0,
+                   (double)res->ns / res->ops / 1000,
+                   (double)tests_histogram_percentile(&res->latency, 50) / 1000,
+                   (double)tests_histogram_percentile(&res->latency, 90) / 1000,
+                   (double)tests_histogram_percentile(&res->latency, 99) / 1000,
+                   (double)res->latency.max / 1000);
+        }
+        if (trace->paced && lag.count)
+            printf("Start lag: p50 %.1f us, p99 %.1f us, max %.1f us behind the recorded times\n",
+                   (double)tests_histogram_percentile(&lag, 50) / 1000,
+                   (double)tests_histogram_percentile(&lag, 99) / 1000,
+                   (double)lag.max / 1000);
+        funlockfile(stdout);
+    }
+
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_replay(test_parameters_t* test_parameters)
+{
+    if (test_parameters->scratch_buf) {
+        free(test_parameters->scratch_buf);
+        test_parameters->scratch_buf = NULL;
+        test_parameters->scratch_buflen = 0;
+    }
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_replay  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a traffic replay job
+*
+******************************************************************************/
+int
+tests_startup_corpus_replay(test_parameters_t* test_parameters)
+{
+   return startup_corpus_replay(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_replay  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	replay the recorded traffic of the -replay trace
+*
+******************************************************************************/
+int
+tests_run_corpus_replay(test_parameters_t* test_parameters)
+{
+    return run_corpus_replay(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_replay  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a traffic replay job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_replay(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_replay(test_parameters);
+}
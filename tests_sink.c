@@ -0,0 +1,380 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "tests.h"
+
+/* Size of the ring the SINK_RING sink copies into, big enough not to stay
+   in the L1/L2 cache like a real consumer buffer would not */
+#define SINK_RING_SIZE          (4 * 1024 * 1024)
+#define SINK_PATH_LENGTH        4096
+/* O_DIRECT writes must be aligned in memory, offset and length */
+#define SINK_DIRECT_ALIGN       4096
+#define SINK_DIRECT_STAGE       (1024 * 1024)
+/* Pipe used between vmsplice and splice */
+#define SINK_PIPE_SIZE          (1024 * 1024)
+
+static int
+sink_is_file(int type)
+{
+    return (SINK_FILE == type || SINK_PWRITEV == type ||
+            SINK_SPLICE == type || SINK_DIRECT == type);
+}
+
+/******************************************************************************
+* function:
+*     sink_direct_flush (output_sink_t *sink, int tail)
+*
+* @param sink [IN] - O_DIRECT sink
+* @param tail [IN] - also write the partial block at the end of the stage
+*
+* description:
+*   write the whole blocks in the staging buffer, and when tail is set the
+*   last partial block padded to the alignment. The file is truncated back
+*   to the stream length when the sink is closed.
+******************************************************************************/
+static int
+sink_direct_flush(output_sink_t *sink, int tail)
+{
+    unsigned long len = sink->stage_len;
+    unsigned long rest = 0;
+    ssize_t written = 0;
+
+    if (!tail)
+        len -= len % SINK_DIRECT_ALIGN;
+    else if (len % SINK_DIRECT_ALIGN) {
+        memset(sink->stage + len, 0, SINK_DIRECT_ALIGN - (len % SINK_DIRECT_ALIGN));
+        len += SINK_DIRECT_ALIGN - (len % SINK_DIRECT_ALIGN);
+    }
+    if (0 == len)
+        return TEST_PASSED;
+
+    written = pwrite(sink->fd, sink->stage, len, sink->offset);
+    if (written != (ssize_t)len) {
+        fprintf(stderr, "# FAIL: O_DIRECT write to sink failed: %s\n", strerror(errno));
+        return TEST_FAILED;
+    }
+
+    if (tail) {
+        sink->offset += sink->stage_len;
+        sink->stage_len = 0;
+    }
+    else {
+        rest = sink->stage_len - len;
+        memmove(sink->stage, sink->stage + len, rest);
+        sink->offset += len;
+        sink->stage_len = rest;
+    }
+    return TEST_PASSED;
+}
+
+/******************************************************************************
+* function:
+*     tests_sink_open (output_sink_t *sink,
+*                      test_parameters_t* test_parameters,
+*                      unsigned long expected)
+*
+* @param sink            [OUT] - sink to set up
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+* @param expected        [IN] - upper bound of the bytes one stream drains
+*
+* description:
+*   set up the sink the bounded output buffer is drained to. File sinks open
+*   sink_path with the thread id appended, unless the path is a pipe or a
+*   device in which case every thread writes to it directly. Regular files
+*   are preallocated with fallocate so block allocation is not part of the
+*   measured write cost.
+******************************************************************************/
+int
+tests_sink_open(output_sink_t *sink, test_parameters_t* test_parameters,
+                unsigned long expected)
+{
+    char path[SINK_PATH_LENGTH];
+    struct stat st;
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+    memset(sink, 0, sizeof(output_sink_t));
+    sink->type = test_parameters->sink_type;
+    sink->fd = -1;
+    sink->pipe_fd[0] = -1;
+    sink->pipe_fd[1] = -1;
+
+    if (SINK_DISCARD == sink->type)
+        return TEST_PASSED;
+
+    if (SINK_RING == sink->type) {
+        sink->ring_size = SINK_RING_SIZE;
+        sink->ring = malloc(sink->ring_size);
+        if (NULL == sink->ring) {
+            fprintf(stderr, "# FAIL: Could not allocate sink ring.\n");
+            return TEST_FAILED;
+        }
+        return TEST_PASSED;
+    }
+
+    if (!sink_is_file(sink->type)) {
+        fprintf(stderr, "# FAIL: Unknown sink type %d\n", sink->type);
+        return TEST_FAILED;
+    }
+
+    if (NULL == test_parameters->sink_path || test_parameters->sink_path[0] == '\0') {
+        fprintf(stderr, "# FAIL: File sink selected without -sinkfile\n");
+        return TEST_FAILED;
+    }
+    if (0 == stat(test_parameters->sink_path, &st) &&
+        (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode))) {
+        snprintf(path, sizeof(path), "%s", test_parameters->sink_path);
+        sink->seekable = 0;
+    }
+    else {
+        snprintf(path, sizeof(path), "%s.%d", test_parameters->sink_path,
+                 test_parameters->id);
+        sink->seekable = 1;
+    }
+    if ((SINK_PWRITEV == sink->type || SINK_DIRECT == sink->type) && !sink->seekable) {
+        fprintf(stderr, "# FAIL: sink %d needs a regular file, %s is not one\n",
+                sink->type, path);
+        return TEST_FAILED;
+    }
+
+    if (SINK_DIRECT == sink->type) {
+        flags |= O_DIRECT;
+        if (posix_memalign((void **)&sink->stage, SINK_DIRECT_ALIGN,
+                           SINK_DIRECT_STAGE + SINK_DIRECT_ALIGN)) {
+            fprintf(stderr, "# FAIL: Could not allocate O_DIRECT staging buffer.\n");
+            return TEST_FAILED;
+        }
+    }
+
+    sink->fd = open(path, flags, 0644);
+    if (sink->fd < 0) {
+        fprintf(stderr, "# FAIL: Could not open sink %s: %s\n", path, strerror(errno));
+        tests_sink_close(sink);
+        return TEST_FAILED;
+    }
+
+    if (sink->seekable && expected > 0 &&
+        fallocate(sink->fd, FALLOC_FL_KEEP_SIZE, 0,
+                  expected + SINK_DIRECT_ALIGN) != 0 && 0 == test_parameters->id) {
+        printf("fallocate of %s failed (%s), writes will allocate blocks\n",
+               path, strerror(errno));
+    }
+
+    if (SINK_SPLICE == sink->type) {
+        if (pipe(sink->pipe_fd) != 0) {
+            fprintf(stderr, "# FAIL: Could not create splice pipe: %s\n", strerror(errno));
+            tests_sink_close(sink);
+            return TEST_FAILED;
+        }
+        /* A larger pipe lets a whole drain move in one vmsplice/splice pair,
+           this is best effort as it is capped by /proc/sys/fs/pipe-max-size */
+        fcntl(sink->pipe_fd[1], F_SETPIPE_SZ, SINK_PIPE_SIZE);
+    }
+
+    return TEST_PASSED;
+}
+
+/******************************************************************************
+* function:
+*     tests_sink_rewind (output_sink_t *sink)
+*
+* @param sink [IN] - sink to rewind
+*
+* description:
+*   start a new stream, file sinks are overwritten from the start on every
+*   iteration so the file does not grow with the iteration count
+******************************************************************************/
+void
+tests_sink_rewind(output_sink_t *sink)
+{
+    if (SINK_DIRECT == sink->type && sink->stage_len)
+        sink_direct_flush(sink, 1);
+
+    if (sink->offset > sink->length)
+        sink->length = sink->offset;
+    sink->offset = 0;
+
+    if (SINK_FILE == sink->type && sink->seekable)
+        lseek(sink->fd, 0, SEEK_SET);
+}
+
+/******************************************************************************
+* function:
+*     tests_sink_drain (output_sink_t *sink,
+*                       const unsigned char *buf,
+*                       unsigned long len)
+*
+* @param sink [IN] - sink to drain to
+* @param buf  [IN] - output buffer zlib has written to
+* @param len  [IN] - number of bytes to drain
+*
+* description:
+*   empty the output buffer into the sink, accounting the cycles spent
+******************************************************************************/
+int
+tests_sink_drain(output_sink_t *sink, const unsigned char *buf, unsigned long len)
+{
+    unsigned long long start = rdtsc();
+    unsigned long part = 0;
+    ssize_t written = 0;
+    ssize_t moved = 0;
+    struct iovec iov;
+
+    sink->bytes += len;
+
+    while (len > 0) {
+        switch (sink->type)
+        {
+            case SINK_RING:
+                part = sink->ring_size - sink->ring_pos;
+                if (part > len)
+                    part = len;
+                memcpy(sink->ring + sink->ring_pos, buf, part);
+                sink->ring_pos = (sink->ring_pos + part) % sink->ring_size;
+                written = part;
+                break;
+            case SINK_FILE:
+                written = write(sink->fd, buf, len);
+                break;
+            case SINK_PWRITEV:
+                iov.iov_base = (void *)buf;
+                iov.iov_len = len;
+                written = pwritev(sink->fd, &iov, 1, sink->offset);
+                break;
+            case SINK_SPLICE:
+                /* Map the output buffer pages into the pipe and move them
+                   from the pipe into the file, so they are only copied once
+                   into the page cache. The pipe is emptied before returning
+                   so zlib can safely reuse the buffer. */
+                iov.iov_base = (void *)buf;
+                iov.iov_len = len;
+                written = vmsplice(sink->pipe_fd[1], &iov, 1, 0);
+                part = 0;
+                while (written > 0 && part < (unsigned long)written) {
+                    moved = splice(sink->pipe_fd[0], NULL, sink->fd,
+                                   sink->seekable ? (loff_t *)&sink->offset : NULL,
+                                   written - part, SPLICE_F_MOVE);
+                    if (moved <= 0) {
+                        if (moved < 0 && errno == EINTR)
+                            continue;
+                        written = -1;
+                        break;
+                    }
+                    part += moved;
+                }
+                if (written > 0 && sink->seekable)
+                    sink->offset -= written;
+                break;
+            case SINK_DIRECT:
+                part = SINK_DIRECT_STAGE - sink->stage_len;
+                if (part > len)
+                    part = len;
+                memcpy(sink->stage + sink->stage_len, buf, part);
+                sink->stage_len += part;
+                written = part;
+                if (sink->stage_len == SINK_DIRECT_STAGE &&
+                    TEST_PASSED != sink_direct_flush(sink, 0))
+                    return TEST_FAILED;
+                /* sink_direct_flush moves the offset itself */
+                sink->offset -= written;
+                break;
+            default:
+                written = len;
+                break;
+        }
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            fprintf(stderr, "# FAIL: drain to sink %d failed: %s\n", sink->type, strerror(errno));
+            return TEST_FAILED;
+        }
+        sink->offset += written;
+        buf += written;
+        len -= written;
+    }
+
+    sink->drains++;
+    sink->cycles += rdtsc() - start;
+    return TEST_PASSED;
+}
+
+/******************************************************************************
+* function:
+*     tests_sink_close (output_sink_t *sink)
+*
+* @param sink [IN] - sink to close
+*
+* description:
+*   release the resources of the sink, file sinks are cut back to the
+*   length of the longest stream written to them
+******************************************************************************/
+void
+tests_sink_close(output_sink_t *sink)
+{
+    tests_sink_rewind(sink);
+
+    if (sink->ring) {
+        free(sink->ring);
+        sink->ring = NULL;
+    }
+    if (sink->pipe_fd[0] >= 0) {
+        close(sink->pipe_fd[0]);
+        close(sink->pipe_fd[1]);
+        sink->pipe_fd[0] = -1;
+        sink->pipe_fd[1] = -1;
+    }
+    if (sink->fd >= 0) {
+        if (sink->seekable)
+            ftruncate(sink->fd, sink->length);
+        close(sink->fd);
+        sink->fd = -1;
+    }
+    if (sink->stage) {
+        free(sink->stage);
+        sink->stage = NULL;
+    }
+}
+
+/******************************************************************************
+* function:
+*     tests_sink_report (test_parameters_t* test_parameters,
+*                        output_sink_t *sink,
+*                        const char *call,
+*                        unsigned long calls,
+*                        unsigned long long total_cycles)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+* @param sink            [IN] - sink drained during the run
+* @param call            [IN] - name of the zlib call made in the run
+* @param calls           [IN] - number of zlib calls made in the run
+* @param total_cycles    [IN] - cycles spent in the run
+*
+* description:
+*   print the cost of draining the bounded output buffer
+******************************************************************************/
+void
+tests_sink_report(test_parameters_t* test_parameters, output_sink_t *sink,
+                  const char *call, unsigned long calls, unsigned long long total_cycles)
+{
+    double mb = (double)test_parameters->single_call_bytes * test_parameters->completed / (1024 * 1024);
+
+    if (mb <= 0)
+        return;
+
+    printf("Thread %d output buffer %lu bytes, sink %d: %.1f %s calls/MB, %.1f drains/MB, "
+           "%.1f cycles/drain, drain %.2f%% of cycles\n",
+           test_parameters->id, test_parameters->outbuf_size, sink->type,
+           calls / mb, call, sink->drains / mb,
+           sink->drains ? (double)sink->cycles / sink->drains : 0.0,
+           total_cycles ? (double)sink->cycles * 100 / total_cycles : 0.0);
+}
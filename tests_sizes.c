@@ -0,0 +1,325 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tests.h"
+
+/* Seed of the draws when the spec does not give one, so runs repeat */
+#define SIZES_SEED              0x5eed
+
+/* Standard deviations above the median a log-normal reaches by default */
+#define SIZES_LOGNORMAL_SPAN    4.0
+
+/* Draws of a log-normal size outside its bounds before it is clamped.
+   Bounds that take in little of the distribution would otherwise loop
+   for ever; with them, the sizes pile up on the nearer bound */
+#define SIZES_LOGNORMAL_TRIES   64
+
+static const char *sizes_kind_name[] = {
+    "fixed", "uniform", "lognormal", "zipf", "bimodal"
+};
+
+/******************************************************************************
+* function:
+*     sizes_number (const char **p, unsigned long *value)
+*
+* @param p     [IN] - text to read, moved past the number
+* @param value [OUT] - bytes read
+*
+* description:
+*   read a size in bytes with an optional k or m suffix. Returns 0, or -1
+*   when there is no size or it is out of range.
+******************************************************************************/
+static int sizes_number(const char **p, unsigned long *value)
+{
+    char *end = NULL;
+    unsigned long v = strtoul(*p, &end, 10);
+
+    if (end == *p || **p == '-')
+        return -1;
+    if (*end == 'k' || *end == 'K') {
+        v <<= 10;
+        end++;
+    }
+    else if (*end == 'm' || *end == 'M') {
+        v <<= 20;
+        end++;
+    }
+    if (v < 1 || v > SIZES_MAX)
+        return -1;
+    *p = end;
+    *value = v;
+    return 0;
+}
+
+static int sizes_double(const char **p, double *value)
+{
+    char *end = NULL;
+
+    *value = strtod(*p, &end);
+    if (end == *p)
+        return -1;
+    *p = end;
+    return 0;
+}
+
+/* Read "<min>-<max>" */
+static int sizes_range(const char **p, size_dist_t *dist)
+{
+    if (sizes_number(p, &dist->min) != 0 || **p != '-')
+        return -1;
+    (*p)++;
+    if (sizes_number(p, &dist->max) != 0 || dist->max < dist->min)
+        return -1;
+    return 0;
+}
+
+/******************************************************************************
+* function:
+*     tests_sizes_parse (const char *spec, size_dist_t *dist)
+*
+* @param spec [IN] - -k argument
+* @param dist [OUT] - distribution it names
+*
+* description:
+*   read a size distribution, sizes in bytes with an optional k or m suffix:
+*     <size> or fixed:<size>
+*     uniform:<min>-<max>
+*     lognormal:<median>:<sigma>[:<min>-<max>]
+*     zipf:<min>-<max>[:<s>]         (P(size) falls as 1/size^s, s 1 by default)
+*     bimodal:<a>:<b>[:<pct>]        (pct percent of a, 50 by default)
+*   any of them followed by @<seed> for other draws than the default ones.
+*   Returns 0, or -1 when the spec is not one of these.
+******************************************************************************/
+int tests_sizes_parse(const char *spec, size_dist_t *dist)
+{
+    const char *p = spec;
+    const char *colon = strchr(spec, ':');
+    char *end = NULL;
+    double median = 0;
+    int kind = 0;
+
+    memset(dist, 0, sizeof(*dist));
+    dist->seed = SIZES_SEED;
+
+    if (NULL == colon) {
+        dist->kind = SIZE_DIST_FIXED;
+    }
+    else {
+        for (kind = 0; kind <= SIZE_DIST_MAX; kind++)
+            if (strlen(sizes_kind_name[kind]) == (size_t)(colon - spec) &&
+                !strncmp(spec, sizes_kind_name[kind], colon - spec))
+                break;
+        if (kind > SIZE_DIST_MAX)
+            return -1;
+        dist->kind = kind;
+        p = colon + 1;
+    }
+
+    switch (dist->kind)
+    {
+        case SIZE_DIST_FIXED:
+            if (sizes_number(&p, &dist->min) != 0)
+                return -1;
+            dist->max = dist->min;
+            break;
+        case SIZE_DIST_UNIFORM:
+            if (sizes_range(&p, dist) != 0)
+                return -1;
+            break;
+        case SIZE_DIST_LOGNORMAL:
+            if (sizes_number(&p, &dist->a) != 0 || *p++ != ':' ||
+                sizes_double(&p, &dist->sigma) != 0 || dist->sigma < 0 || dist->sigma > 8)
+                return -1;
+            median = (double)dist->a;
+            dist->min = 1;
+            dist->max = median * exp(SIZES_LOGNORMAL_SPAN * dist->sigma) > SIZES_MAX ?
+                        SIZES_MAX : (unsigned long)ceil(median * exp(SIZES_LOGNORMAL_SPAN *
+                                                                    dist->sigma));
+            if (*p == ':') {
+                p++;
+                if (sizes_range(&p, dist) != 0)
+                    return -1;
+            }
+            if (dist->a < dist->min || dist->a > dist->max)
+                return -1;
+            break;
+        case SIZE_DIST_ZIPF:
+            if (sizes_range(&p, dist) != 0)
+                return -1;
+            dist->s = 1.0;
+            if (*p == ':') {
+                p++;
+                if (sizes_double(&p, &dist->s) != 0 || dist->s <= 0)
+                    return -1;
+            }
+            break;
+        case SIZE_DIST_BIMODAL:
+            if (sizes_number(&p, &dist->a) != 0 || *p++ != ':' ||
+                sizes_number(&p, &dist->b) != 0)
+                return -1;
+            dist->pct = 50;
+            if (*p == ':') {
+                p++;
+                dist->pct = strtol(p, &end, 10);
+                if (end == p || dist->pct < 0 || dist->pct > 100)
+                    return -1;
+                p = end;
+            }
+            dist->min = dist->a < dist->b ? dist->a : dist->b;
+            dist->max = dist->a < dist->b ? dist->b : dist->a;
+            break;
+    }
+
+    if (*p == '@') {
+        p++;
+        dist->seed = strtoul(p, &end, 0);
+        if (end == p)
+            return -1;
+        p = end;
+    }
+    return *p == '\0' ? 0 : -1;
+}
+
+/******************************************************************************
+* function:
+*     tests_sizes_describe (const size_dist_t *dist, char *text, int len)
+*
+* @param dist [IN] - distribution
+* @param text [OUT] - one line description of it
+* @param len  [IN] - room in text
+******************************************************************************/
+void tests_sizes_describe(const size_dist_t *dist, char *text, int len)
+{
+    int n = 0;
+
+    switch (dist->kind)
+    {
+        case SIZE_DIST_FIXED:
+            n = snprintf(text, len, "fixed %lu bytes", dist->min);
+            break;
+        case SIZE_DIST_UNIFORM:
+            n = snprintf(text, len, "uniform %lu-%lu bytes", dist->min, dist->max);
+            break;
+        case SIZE_DIST_LOGNORMAL:
+            n = snprintf(text, len, "log-normal median %lu sigma %.2f, %lu-%lu bytes",
+                         dist->a, dist->sigma, dist->min, dist->max);
+            break;
+        case SIZE_DIST_ZIPF:
+            n = snprintf(text, len, "Zipf s %.2f over %lu-%lu bytes",
+                         dist->s, dist->min, dist->max);
+            break;
+        case SIZE_DIST_BIMODAL:
+            n = snprintf(text, len, "bimodal %d%% %lu bytes, %d%% %lu bytes",
+                         dist->pct, dist->a, 100 - dist->pct, dist->b);
+            break;
+    }
+    if (n >= 0 && n < len)
+        snprintf(text + n, len - n, ", seed %u", dist->seed);
+}
+
+/* Uniform in (0, 1), never 0 so the log-normal can take its log */
+static double sizes_uniform(unsigned int *seed)
+{
+    return ((double)rand_r(seed) + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+/******************************************************************************
+* function:
+*     sizes_draw (const size_dist_t *dist, unsigned int *seed)
+*
+* @param dist [IN] - distribution
+* @param seed [IN] - rand_r seed, updated
+*
+* description:
+*   returns one size of the distribution. The Zipf sizes are drawn by
+*   inverting the CDF of the bounded power law, the log-normal ones by the
+*   Box-Muller transform and drawn again while outside min and max, so the
+*   bounds cut the tails off. After SIZES_LOGNORMAL_TRIES draws outside
+*   them the last one is clamped to the nearer bound, which only biases
+*   the sizes when the bounds leave out most of the distribution.
+******************************************************************************/
+static unsigned long sizes_draw(const size_dist_t *dist, unsigned int *seed)
+{
+    double u = sizes_uniform(seed);
+    double x = 0, lo = 0, hi = 0;
+    int tries = 0;
+
+    switch (dist->kind)
+    {
+        case SIZE_DIST_UNIFORM:
+            x = dist->min + u * (dist->max - dist->min + 1);
+            break;
+        case SIZE_DIST_LOGNORMAL:
+            do {
+                x = (double)dist->a * exp(dist->sigma * sqrt(-2.0 * log(u)) *
+                                          cos(2.0 * M_PI * sizes_uniform(seed)));
+                u = sizes_uniform(seed);
+            } while ((x < dist->min || x >= dist->max + 1) &&
+                     ++tries < SIZES_LOGNORMAL_TRIES);
+            break;
+        case SIZE_DIST_ZIPF:
+            lo = (double)dist->min;
+            hi = (double)dist->max + 1;
+            if (fabs(dist->s - 1.0) < 1e-9)
+                x = lo * pow(hi / lo, u);
+            else
+                x = pow(pow(lo, 1 - dist->s) + u * (pow(hi, 1 - dist->s) -
+                                                    pow(lo, 1 - dist->s)),
+                        1 / (1 - dist->s));
+            break;
+        case SIZE_DIST_BIMODAL:
+            return u * 100 < dist->pct ? dist->a : dist->b;
+        default:
+            return dist->min;
+    }
+
+    if (x < dist->min)
+        return dist->min;
+    if (x >= dist->max)
+        return dist->max;
+    return (unsigned long)x;
+}
+
+/******************************************************************************
+* function:
+*     tests_sizes_init (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - parameters of one worker
+*
+* description:
+*   draw the SIZES_COUNT sizes a worker cycles through from the -k
+*   distribution, seeded by the worker id so the workers do not all see the
+*   same sequence and a run repeats. Done before the start barrier, the run
+*   only reads them. A fixed size leaves sizes NULL and the tests take
+*   chunksize as they always did.
+******************************************************************************/
+int tests_sizes_init(test_parameters_t* test_parameters)
+{
+    const size_dist_t *dist = test_parameters->size_dist;
+    unsigned int seed = 0;
+    int i;
+
+    test_parameters->sizes_next = 0;
+    if (NULL == dist || SIZE_DIST_FIXED == dist->kind)
+        return TEST_PASSED;
+
+    if (NULL == test_parameters->sizes) {
+        test_parameters->sizes = malloc(SIZES_COUNT * sizeof(unsigned int));
+        if (NULL == test_parameters->sizes) {
+            fprintf(stderr, "# FAIL: Could not allocate the message sizes.\n");
+            return TEST_FAILED;
+        }
+    }
+
+    seed = dist->seed ^ ((test_parameters->id + 1) * 2654435761U);
+    for (i = 0; i < SIZES_COUNT; i++)
+        test_parameters->sizes[i] = sizes_draw(dist, &seed);
+    return TEST_PASSED;
+}
+
+void tests_sizes_free(test_parameters_t* test_parameters)
+{
+    free(test_parameters->sizes);
+    test_parameters->sizes = NULL;
+}
@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* Bytes every stream of a set compresses, from an offset of its own */
+#define STREAMS_BYTES           (64 * 1024)
+
+/* Streams of a set whose output is kept for -v, spread over the set */
+#define STREAMS_VERIFY_MAX      8
+
+/* Output a stream has room for in one deflate call, drained after each
+   call as a server writes it to the socket */
+#define STREAMS_SEND_ROOM(len)  ((len) + ((len) >> 2) + 64)
+
+typedef struct
+{
+    unsigned long long bytes_in;
+    unsigned long long bytes_out;
+    unsigned long long ns;
+    unsigned long long setup_ns;
+    unsigned long long llc_misses;
+    unsigned long long state_bytes;
+    unsigned long sets;
+}
+streams_result_t;
+
+/******************************************************************************
+* function:
+*     streams_llc_open (void)
+*
+* description:
+*   returns a perf event counting the last level cache read misses of the
+*   calling thread, or the generic cache misses where the cache event is not
+*   there, or -1 when the kernel or the machine gives neither
+******************************************************************************/
+static int streams_llc_open(void)
+{
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd >= 0)
+        return fd;
+
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static unsigned long long streams_llc_read(int fd)
+{
+    unsigned long long count = 0;
+
+    if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count))
+        return 0;
+    return count;
+}
+
+
+
+int
+startup_corpus_streams(test_parameters_t* test_parameters)
+{
+    return tests_startup_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     streams_verify (test_parameters_t* test_parameters, const unsigned char *in,
+*                     unsigned long in_len, const unsigned char *out,
+*                     unsigned long out_len)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param in              [IN] - corpus slice the stream was fed
+* @param in_len          [IN] - length of the slice
+* @param out             [IN] - output kept for the stream
+* @param out_len         [IN] - length of the output
+*
+* description:
+*   inflate the output of one stream of a set and check it against its
+*   slice of the corpus. The time taken is not part of the run.
+******************************************************************************/
+static int
+streams_verify(test_parameters_t* test_parameters, const unsigned char *in,
+               unsigned long in_len, const unsigned char *out, unsigned long out_len)
+{
+    z_stream strm;
+    unsigned char *buf = NULL;
+    verify_span_t span;
+    int failed = TEST_PASSED;
+    int ret = Z_OK;
+
+    buf = tests_verify_buffer(test_parameters);
+    if (NULL == buf)
+        return TEST_FAILED;
+
+    tests_verify_start(&span);
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, tests_window_bits(test_parameters->streamtype,
+                                                test_parameters->window_bits));
+    if (ret == Z_OK) {
+        strm.next_in = (z_const Bytef *)out;
+        strm.avail_in = out_len;
+        strm.next_out = buf;
+        strm.avail_out = test_parameters->input_buflen + 100;
+        ret = inflate(&strm, Z_FINISH);
+        if (ret != Z_STREAM_END || strm.total_out != in_len ||
+            memcmp(buf, in, in_len) != 0) {
+            fprintf(stderr, "# FAIL: thread %d stream output of %lu bytes does not match "
+                    "its input, ret:%d\n", test_parameters->id, strm.total_out, ret);
+            failed = TEST_FAILED;
+        }
+        inflateEnd(&strm);
+    }
+    else {
+        fprintf(stderr, "# FAIL: inflateInit2 for verify failed, ret:%d\n", ret);
+        failed = TEST_FAILED;
+    }
+
+    if (TEST_PASSED == failed)
+        test_parameters->verify_checked++;
+    tests_verify_stop(test_parameters, &span);
+    return failed;
+}
+
+/******************************************************************************
+* function:
+*     streams_set (test_parameters_t* test_parameters, int count, int verify,
+*                  int llc, streams_result_t *result)
+*
+* @param test_parameters [IN] - parameters of one worker
+* @param count           [IN] - number of live streams in the set
+* @param verify          [IN] - keep the output of some streams and check it
+* @param llc             [IN] - perf event of the cache misses or -1
+* @param result          [OUT] - totals of the set size, updated
+*
+* description:
+*   open count streams at once, each fed from its own offset of the corpus,
+*   and deflate them a chunk at a time in turn until each has taken in
+*   STREAMS_BYTES, so the state of every stream is cold again by the time
+*   its next chunk comes round
+******************************************************************************/
+static int
+streams_set(test_parameters_t* test_parameters, int count, int verify, int llc,
+            streams_result_t *result)
+{
+    z_stream *strm = NULL;
+    unsigned char *finished = NULL;
+    unsigned char *send = NULL;
+    unsigned char *keep = NULL;
+    unsigned long *keep_len = NULL;
+    unsigned long bytes = STREAMS_BYTES;
+    unsigned long chunk = test_parameters->chunksize;
+    unsigned long send_room = STREAMS_SEND_ROOM(chunk);
+    unsigned long keep_room = STREAMS_SEND_ROOM(STREAMS_BYTES) + send_room;
+    unsigned long span = 0, have = 0, len = 0, pos = 0;
+    unsigned long long t0 = 0, misses = 0, out_total = 0;
+    zalloc_count_t memory;
+    int stride = 1, active = 0, opened = 0, slot = -1;
+    int windowbits = tests_window_bits(test_parameters->streamtype,
+                                       test_parameters->window_bits);
+    int failed = TEST_PASSED;
+    int flush = Z_NO_FLUSH;
+    int j, ret = Z_OK;
+
+    if (bytes > test_parameters->input_buflen)
+        bytes = test_parameters->input_buflen;
+    span = test_parameters->input_buflen - bytes;
+    if (count > STREAMS_VERIFY_MAX)
+        stride = (count + STREAMS_VERIFY_MAX - 1) / STREAMS_VERIFY_MAX;
+
+    strm = calloc(count, sizeof(z_stream));
+    finished = calloc(count, 1);
+    send = malloc(send_room);
+    if (verify) {
+        keep = malloc(STREAMS_VERIFY_MAX * keep_room);
+        keep_len = calloc(STREAMS_VERIFY_MAX, sizeof(unsigned long));
+    }
+    if (NULL == strm || NULL == finished || NULL == send || (verify && (NULL == keep || NULL == keep_len))) {
+        fprintf(stderr, "# FAIL: Could not allocate a set of %d streams.\n", count);
+        failed = TEST_FAILED;
+        goto out;
+    }
+
+    memset(&memory, 0, sizeof(memory));
+    t0 = tests_nsec();
+    for (opened = 0; opened < count; opened++) {
+        tests_zalloc_use(&strm[opened], &memory);
+        ret = deflateInit2(&strm[opened], test_parameters->level, 8, windowbits,
+                           test_parameters->mem_level, test_parameters->strategy);
+        if (ret != Z_OK) {
+            fprintf(stderr, "# FAIL: deflateInit2 of stream %d of %d failed, ret:%d\n",
+                    opened, count, ret);
+            failed = TEST_FAILED;
+            goto out;
+        }
+        /* the streams start at offsets spread evenly over the corpus */
+        strm[opened].next_in = test_parameters->input_buf +
+                               (count > 1 ? (unsigned long)((double)span * opened / (count - 1)) : 0);
+    }
+    result->setup_ns += tests_nsec() - t0;
+
+    if (llc >= 0) {
+        ioctl(llc, PERF_EVENT_IOC_RESET, 0);
+        ioctl(llc, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    t0 = tests_nsec();
+
+    /* Round robin, one chunk of every stream that is still open at a time */
+    active = count;
+    while (active > 0 && TEST_PASSED == failed) {
+        for (j = 0; j < count && TEST_PASSED == failed; j++) {
+            if (finished[j])
+                continue;
+
+            len = bytes - strm[j].total_in;
+            flush = Z_NO_FLUSH;
+            if (len <= chunk)
+                flush = Z_FINISH;
+            else
+                len = chunk;
+            strm[j].avail_in = len;
+            slot = (verify && j % stride == 0) ? j / stride : -1;
+
+            do {
+                strm[j].next_out = send;
+                strm[j].avail_out = send_room;
+                ret = deflate(&strm[j], flush);
+                have = send_room - strm[j].avail_out;
+                if (slot >= 0 && keep_len[slot] + have <= keep_room) {
+                    memcpy(keep + slot * keep_room + keep_len[slot], send, have);
+                    keep_len[slot] += have;
+                }
+                out_total += have;
+            } while (ret == Z_OK && (strm[j].avail_out == 0 || flush == Z_FINISH));
+
+            if (ret == Z_STREAM_END) {
+                finished[j] = 1;
+                active--;
+            }
+            else if (ret != Z_OK) {
+                fprintf(stderr, "# FAIL: deflate of stream %d of %d failed, ret:%d\n",
+                        j, count, ret);
+                failed = TEST_FAILED;
+            }
+        }
+    }
+
+    result->ns += tests_nsec() - t0;
+    if (llc >= 0) {
+        ioctl(llc, PERF_EVENT_IOC_DISABLE, 0);
+        misses = streams_llc_read(llc);
+    }
+
+    if (TEST_PASSED == failed) {
+        result->bytes_in += (unsigned long long)count * bytes;
+        result->bytes_out += out_total;
+        result->llc_misses += misses;
+        result->state_bytes = memory.peak;
+        if (memory.peak / count > test_parameters->state_bytes)
+            test_parameters->state_bytes = memory.peak / count;
+        result->sets++;
+        tests_live_op(test_parameters, (unsigned long)count * bytes, out_total,
+                      tests_nsec() - t0);
+    }
+
+    /* The output of the sampled streams is checked before the corpus slices
+       they point at are lost with the streams */
+    for (j = 0; verify && TEST_PASSED == failed && j < count; j += stride) {
+        pos = count > 1 ? (unsigned long)((double)span * j / (count - 1)) : 0;
+        failed = streams_verify(test_parameters, test_parameters->input_buf + pos, bytes,
+                                keep + (j / stride) * keep_room, keep_len[j / stride]);
+    }
+
+out:
+    for (j = 0; j < opened; j++)
+        deflateEnd(&strm[j]);
+    free(strm);
+    free(finished);
+    free(send);
+    free(keep);
+    free(keep_len);
+    return failed;
+}
+
+
+
+int
+run_corpus_streams(test_parameters_t* test_parameters)
+{
+    streams_result_t *results = NULL;
+    streams_result_t *r;
+    unsigned long long run_start = 0, trace = 0;
+    unsigned long long bytes_in = 0, bytes_out = 0;
+    int sweeps = test_parameters->streams_sweeps;
+    int failed = TEST_PASSED;
+    int llc = -1;
+    int i, s;
+
+    results = calloc(sweeps, sizeof(streams_result_t));
+    if (NULL == results) {
+        fprintf(stderr, "# FAIL: Could not allocate stream set results.\n");
+        return TEST_FAILED;
+    }
+
+    /* Counted for this thread only, around the round robin of each set */
+    llc = streams_llc_open();
+
+    run_start = tests_nsec();
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        tests_pace(test_parameters, i, run_start);
+        for (s = 0; s < sweeps && TEST_PASSED == failed; s++) {
+            trace = tests_trace_start(test_parameters->trace);
+            failed = streams_set(test_parameters, test_parameters->streams_sweep[s],
+                                 tests_verify_due(test_parameters, i), llc, &results[s]);
+            tests_trace_stop(test_parameters->trace, "stream set", trace);
+            if (TEST_PASSED != failed)
+                tests_live_error(test_parameters);
+        }
+    }
+
+    if (llc >= 0)
+        close(llc);
+
+    if (TEST_PASSED == failed && results[0].sets) {
+        flockfile(stdout);
+        printf("\nThread %d concurrent streams, %d KB each in %d byte chunks:\n",
+               test_parameters->id, STREAMS_BYTES / 1024, test_parameters->chunksize);
+        printf("%8s %10s %8s %12s %12s %10s %10s %10s\n", "Streams", "Mbps", "Ratio",
+               "LLC_misses", "Misses/KB", "State_MB", "KB/stream", "Setup_us");
+        for (s = 0; s < sweeps; s++) {
+            r = &results[s];
+            printf("%8d %10.2f %8.4f ", test_parameters->streams_sweep[s],
+                   (double)r->bytes_in * 8 * 1000 / r->ns,
+                   (double)r->bytes_out / r->bytes_in);
+            if (llc >= 0)
+                printf("%12llu %12.2f ", r->llc_misses / r->sets,
+                       (double)r->llc_misses * 1024 / r->bytes_in);
+            else
+                printf("%12s %12s ", "n/a", "n/a");
+            printf("%10.1f %10.1f %10.1f\n", (double)r->state_bytes / (1024 * 1024),
+                   (double)r->state_bytes / 1024 / test_parameters->streams_sweep[s],
+                   (double)r->setup_ns / r->sets / 1000);
+            bytes_in += r->bytes_in;
+            bytes_out += r->bytes_out;
+        }
+        if (llc < 0)
+            printf("LLC misses are n/a, the perf cache miss events could not be opened\n");
+        printf("LLC_misses per set, State_MB is the zlib state of all the streams of a set\n");
+        funlockfile(stdout);
+
+        /* An operation runs a set of every size */
+        test_parameters->single_call_bytes = bytes_in / results[0].sets;
+        test_parameters->ratio = (float)bytes_out / bytes_in;
+    }
+
+    free(results);
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_streams(test_parameters_t* test_parameters)
+{
+    return tests_shutdown_corpus_compression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_streams  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a concurrent streams job
+*
+******************************************************************************/
+int
+tests_startup_corpus_streams(test_parameters_t* test_parameters)
+{
+   return startup_corpus_streams(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_streams  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	deflate sets of interleaved streams of every -streams size
+*
+******************************************************************************/
+int
+tests_run_corpus_streams(test_parameters_t* test_parameters)
+{
+    return run_corpus_streams(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_streams  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a concurrent streams job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_streams(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_streams(test_parameters);
+}
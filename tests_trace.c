@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "tests.h"
+
+/* rdtsc and the monotonic clock when the rings were mapped, against which
+   the cycle counts of the spans are turned into microseconds */
+static unsigned long long trace_base_tsc = 0;
+static unsigned long long trace_base_nsec = 0;
+
+/******************************************************************************
+* function:
+*     tests_trace_open (int workers)
+*
+* @param workers [IN] - number of worker threads or processes
+*
+* description:
+*   map a ring of TRACE_RING_EVENTS spans for every worker. The mapping is
+*   shared so worker processes can record into it, and populated so no page
+*   is faulted in while the workers record.
+******************************************************************************/
+trace_ring_t *tests_trace_open(int workers)
+{
+    size_t rings_len = workers * sizeof(trace_ring_t);
+    size_t events_len = (size_t)workers * TRACE_RING_EVENTS * sizeof(trace_event_t);
+    trace_ring_t *rings;
+    trace_event_t *events;
+    int i;
+
+    rings = mmap(NULL, rings_len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    events = mmap(NULL, events_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (MAP_FAILED == rings || MAP_FAILED == events) {
+        fprintf(stderr, "# FAIL: Could not map %d trace rings\n", workers);
+        return NULL;
+    }
+
+    for (i = 0; i < workers; i++) {
+        rings[i].events = events + (size_t)i * TRACE_RING_EVENTS;
+        rings[i].next = 0;
+    }
+
+    trace_base_tsc = rdtsc();
+    trace_base_nsec = tests_nsec();
+    return rings;
+}
+
+/******************************************************************************
+* function:
+*     tests_trace_dump (const char *path, trace_ring_t *rings,
+*                       int workers, int processes)
+*
+* @param path      [IN] - file to write
+* @param rings     [IN] - rings of the workers
+* @param workers   [IN] - number of rings
+* @param processes [IN] - the workers were processes rather than threads
+*
+* description:
+*   write the spans of every worker as complete ("X") events of the Chrome
+*   trace event format, each worker on a track of its own, so the timeline
+*   opens in Perfetto or chrome://tracing
+******************************************************************************/
+int tests_trace_dump(const char *path, trace_ring_t *rings, int workers, int processes)
+{
+    double cycles_per_usec = 0;
+    unsigned long long first = 0, n = 0, lost = 0, total = 0;
+    trace_event_t *event;
+    FILE *out;
+    int i, sep = 0;
+
+    cycles_per_usec = (double)(rdtsc() - trace_base_tsc) * 1000 /
+                      (tests_nsec() - trace_base_nsec);
+    if (cycles_per_usec <= 0)
+        cycles_per_usec = 1;
+
+    out = fopen(path, "w");
+    if (NULL == out) {
+        fprintf(stderr, "# FAIL: Could not open trace file %s\n", path);
+        return TEST_FAILED;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+                 "\"args\":{\"name\":\"mt_perf\"}}");
+    for (i = 0; i < workers; i++) {
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                     "\"args\":{\"name\":\"%s %d\"}}", i, processes ? "process" : "thread", i);
+        sep = 1;
+    }
+
+    for (i = 0; i < workers; i++) {
+        n = rings[i].next;
+        first = n > TRACE_RING_EVENTS ? n - TRACE_RING_EVENTS : 0;
+        lost += first;
+        for (; first < n; first++) {
+            event = &rings[i].events[first & (TRACE_RING_EVENTS - 1)];
+            fprintf(out, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                         "\"ts\":%.3f,\"dur\":%.3f}", sep ? "," : "", event->name, i,
+                    (double)(long long)(event->start - trace_base_tsc) / cycles_per_usec,
+                    (double)(event->end - event->start) / cycles_per_usec);
+            sep = 1;
+            total++;
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "# FAIL: Could not write trace file %s\n", path);
+        return TEST_FAILED;
+    }
+
+    printf("Trace: %llu events written to %s", total, path);
+    if (lost)
+        printf(", %llu older events overwritten", lost);
+    printf("\n");
+    return TEST_PASSED;
+}
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "tests.h"
+
+/* History a stream needs to be resumed in the middle */
+#define ZRAN_WINDOW             32768
+/* Random reads served per checkpoint spacing and iteration */
+#define ZRAN_READS              256
+/* Inflate output that is thrown away while skipping to the read offset */
+#define ZRAN_DISCARD            16384
+
+/* Checkpoint spacings measured. The full pass records access points at
+   the first spacing, the others are subsets of those points. */
+static const unsigned long zran_spacings[] =
+{
+    128 * 1024, 256 * 1024, 512 * 1024, 1024 * 1024, 2048 * 1024, 4096 * 1024
+};
+
+#define ZRAN_NUM_SPACINGS (sizeof(zran_spacings)/sizeof(zran_spacings[0]))
+
+/* Where inflate can be restarted: the uncompressed and compressed offsets
+   of a deflate block boundary, the bits of the byte before in that belong
+   to the previous block, and the 32K of output in front of it */
+typedef struct
+{
+    unsigned long out;
+    unsigned long in;
+    int bits;
+    unsigned char window[ZRAN_WINDOW];
+}
+zran_point_t;
+
+
+
+/******************************************************************************
+* function:
+*     zran_build_index (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*
+* description:
+*   inflate output_buf once from the start, stopping at every deflate block
+*   boundary, and record an access point at the first boundary after every
+*   zran_spacings[0] bytes of output. The points are left in index_buf.
+******************************************************************************/
+static int
+zran_build_index(test_parameters_t* test_parameters)
+{
+    z_stream strm;
+    zran_point_t *points = NULL;
+    zran_point_t *point = NULL;
+    unsigned char *out = NULL;
+    unsigned long max_points = 0, count = 0, last = 0, history = 0;
+    int ret = Z_OK;
+    int failed = TEST_PASSED;
+
+    max_points = test_parameters->input_buflen / zran_spacings[0] + 2;
+    points = malloc(max_points * sizeof(*points));
+    out = malloc(test_parameters->input_buflen + 100);
+    if (NULL == points || NULL == out) {
+        fprintf(stderr, "# FAIL: Could not allocate zran index.\n");
+        free(points);
+        free(out);
+        return TEST_FAILED;
+    }
+
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, tests_window_bits(test_parameters->streamtype,
+                                                test_parameters->window_bits));
+    if (ret != Z_OK) {
+        fprintf(stderr, "# FAIL: inflateInit2 failed, ret:%d\n", ret);
+        free(points);
+        free(out);
+        return TEST_FAILED;
+    }
+
+    /* Without a header to stop after, a raw stream starts on its first
+       block and that is the first point */
+    if (RAW_DEFLATE_STREAM == test_parameters->streamtype) {
+        memset(&points[0], 0, sizeof(points[0]));
+        count = 1;
+    }
+
+    strm.next_in = test_parameters->output_buf;
+    strm.avail_in = test_parameters->output_buflen;
+    strm.next_out = out;
+    strm.avail_out = test_parameters->input_buflen + 100;
+    do {
+        /* Z_BLOCK returns at the end of the header and of every block */
+        ret = inflate(&strm, Z_BLOCK);
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            fprintf(stderr, "# FAIL: inflate while indexing failed, ret:%d\n", ret);
+            failed = TEST_FAILED;
+            break;
+        }
+
+        /* At a block boundary that is not after the last block, with the
+           first point at the start of the first block */
+        if ((strm.data_type & 128) && !(strm.data_type & 64) &&
+            (0 == count || strm.total_out - last >= zran_spacings[0]) &&
+            count < max_points) {
+            point = &points[count++];
+            point->out = strm.total_out;
+            point->in = strm.total_in;
+            point->bits = strm.data_type & 7;
+            history = strm.total_out < ZRAN_WINDOW ? strm.total_out : ZRAN_WINDOW;
+            memset(point->window, 0, ZRAN_WINDOW - history);
+            memcpy(point->window + ZRAN_WINDOW - history, out + strm.total_out - history, history);
+            last = strm.total_out;
+        }
+    } while (ret != Z_STREAM_END);
+
+    inflateEnd(&strm);
+    free(out);
+
+    if (TEST_PASSED != failed || 0 == count) {
+        free(points);
+        return TEST_FAILED;
+    }
+
+    test_parameters->index_buf = (unsigned char *)points;
+    test_parameters->index_len = count * sizeof(*points);
+    return TEST_PASSED;
+}
+
+/******************************************************************************
+* function:
+*     zran_extract (test_parameters_t* test_parameters,
+*                   z_stream *strm,
+*                   const zran_point_t *point,
+*                   unsigned char *discard,
+*                   unsigned long offset,
+*                   unsigned char *buf,
+*                   unsigned long len)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+* @param strm            [IN] - raw inflate stream, reset for every read
+* @param point           [IN] - closest access point at or before offset
+* @param discard         [IN] - scratch space for the skipped output
+* @param offset          [IN] - uncompressed offset of the read
+* @param buf             [OUT] - where the read goes
+* @param len             [IN] - length of the read
+*
+* description:
+*   restart inflate at the access point, priming it with the bits of the
+*   split byte and the window, skip up to offset and inflate len bytes
+******************************************************************************/
+static int
+zran_extract(test_parameters_t* test_parameters, z_stream *strm,
+             const zran_point_t *point, unsigned char *discard,
+             unsigned long offset, unsigned char *buf, unsigned long len)
+{
+    unsigned long skip = offset - point->out;
+    int ret = Z_OK;
+
+    inflateReset(strm);
+    strm->next_in = test_parameters->output_buf + point->in;
+    strm->avail_in = test_parameters->output_buflen - point->in;
+    if (point->bits) {
+        ret = inflatePrime(strm, point->bits,
+                           test_parameters->output_buf[point->in - 1] >> (8 - point->bits));
+        if (ret != Z_OK)
+            return ret;
+    }
+    ret = inflateSetDictionary(strm, point->window, ZRAN_WINDOW);
+    if (ret != Z_OK)
+        return ret;
+
+    while (skip > 0) {
+        strm->next_out = discard;
+        strm->avail_out = skip < ZRAN_DISCARD ? skip : ZRAN_DISCARD;
+        skip -= strm->avail_out;
+        ret = inflate(strm, Z_NO_FLUSH);
+        if (ret != Z_OK || strm->avail_out != 0)
+            return ret == Z_OK ? Z_DATA_ERROR : ret;
+    }
+
+    strm->next_out = buf;
+    strm->avail_out = len;
+    ret = inflate(strm, Z_NO_FLUSH);
+    if (strm->avail_out != 0)
+        return Z_DATA_ERROR;
+
+    return (ret == Z_OK || ret == Z_STREAM_END) ? Z_OK : ret;
+}
+
+
+
+int
+startup_corpus_zran(test_parameters_t* test_parameters)
+{
+    unsigned long long start = 0;
+
+    if (TEST_PASSED != tests_startup_corpus_decompression(test_parameters))
+        return TEST_FAILED;
+
+    if (test_parameters->chunksize > test_parameters->input_buflen) {
+        fprintf(stderr, "# FAIL: read size %d is larger than the corpus\n",
+                test_parameters->chunksize);
+        return TEST_FAILED;
+    }
+
+    start = tests_nsec();
+    if (TEST_PASSED != zran_build_index(test_parameters))
+        return TEST_FAILED;
+
+    flockfile(stdout);
+    printf("Thread %d zran index: %lu access points every %lu KB, %.1f KB, built in %.3f msec\n",
+           test_parameters->id, test_parameters->index_len / sizeof(zran_point_t),
+           zran_spacings[0] / 1024, (double)test_parameters->index_len / 1024,
+           (double)(tests_nsec() - start) / 1000000);
+    funlockfile(stdout);
+
+    return TEST_PASSED;
+}
+
+
+
+int
+run_corpus_zran(test_parameters_t* test_parameters)
+{
+    z_stream strm;
+    zran_point_t *points = (zran_point_t *)test_parameters->index_buf;
+    unsigned long num_points = test_parameters->index_len / sizeof(zran_point_t);
+    unsigned long *selected = NULL;
+    unsigned long num_selected[ZRAN_NUM_SPACINGS];
+    unsigned long long read_ns[ZRAN_NUM_SPACINGS];
+    histogram_t latency[ZRAN_NUM_SPACINGS];
+    unsigned char *discard = NULL;
+    unsigned char *buf = NULL;
+    unsigned long len = test_parameters->chunksize;
+    unsigned long offset = 0, p = 0, lo = 0, hi = 0, mid = 0, last = 0;
+    unsigned long long t0 = 0, total = 0;
+    verify_span_t span;
+    unsigned int seed = 0;
+    unsigned int sp = 0;
+    int i = 0, r = 0, ret = 0;
+    int verify_now = 0;
+    int failed = TEST_PASSED;
+
+    selected = malloc(ZRAN_NUM_SPACINGS * num_points * sizeof(*selected));
+    discard = malloc(ZRAN_DISCARD);
+    buf = malloc(len);
+    memset(&strm, 0, sizeof(strm));
+    if (NULL == selected || NULL == discard || NULL == buf ||
+        inflateInit2(&strm, -15) != Z_OK) {
+        fprintf(stderr, "# FAIL: Could not set up the zran reader.\n");
+        free(selected);
+        free(discard);
+        free(buf);
+        return TEST_FAILED;
+    }
+
+    /* The points of a wider spacing are the first point and every point at
+       least that far from the previous one kept */
+    for (sp = 0; sp < ZRAN_NUM_SPACINGS; sp++) {
+        num_selected[sp] = 0;
+        for (p = 0; p < num_points; p++) {
+            if (0 == p || points[p].out - last >= zran_spacings[sp]) {
+                selected[sp * num_points + num_selected[sp]++] = p;
+                last = points[p].out;
+            }
+        }
+        read_ns[sp] = 0;
+        tests_histogram_init(&latency[sp]);
+    }
+
+    seed = (unsigned int)tests_nsec() ^ (test_parameters->id * 2654435761U);
+
+    for (i = 0; tests_running(test_parameters, i) && TEST_PASSED == failed; i++) {
+        verify_now = tests_verify_due(test_parameters, i);
+        total = 0;
+        for (sp = 0; sp < ZRAN_NUM_SPACINGS && TEST_PASSED == failed; sp++) {
+            /* A spacing that keeps the same points as the one before it is
+               the same index */
+            if (sp > 0 && num_selected[sp] == num_selected[sp - 1])
+                continue;
+
+            for (r = 0; r < ZRAN_READS; r++) {
+                offset = (unsigned long)(((unsigned long long)rand_r(&seed) << 16 ^ rand_r(&seed)) %
+                                         (test_parameters->input_buflen - len + 1));
+
+                t0 = tests_nsec();
+                /* Last access point at or before the offset */
+                lo = 0;
+                hi = num_selected[sp];
+                while (hi - lo > 1) {
+                    mid = (lo + hi) / 2;
+                    if (points[selected[sp * num_points + mid]].out <= offset)
+                        lo = mid;
+                    else
+                        hi = mid;
+                }
+                ret = zran_extract(test_parameters, &strm,
+                                   &points[selected[sp * num_points + lo]],
+                                   discard, offset, buf, len);
+                t0 = tests_nsec() - t0;
+                if (ret != Z_OK) {
+                    fprintf(stderr, "# FAIL: zran read of %lu bytes at %lu failed, ret:%d\n",
+                            len, offset, ret);
+                    failed = TEST_FAILED;
+                    break;
+                }
+                read_ns[sp] += t0;
+                tests_histogram_add(&latency[sp], t0);
+                total += len;
+
+                if (verify_now) {
+                    tests_verify_start(&span);
+                    if (memcmp(buf, test_parameters->input_buf + offset, len)) {
+                        fprintf(stderr, "# FAIL: zran read of %lu bytes at %lu does not match\n",
+                                len, offset);
+                        failed = TEST_FAILED;
+                    }
+                    tests_verify_stop(test_parameters, &span);
+                }
+            }
+        }
+        if (verify_now && TEST_PASSED == failed)
+            test_parameters->verify_checked++;
+
+        test_parameters->single_call_bytes = total;
+        test_parameters->ratio = (float)test_parameters->output_buflen /
+                                 test_parameters->input_buflen;
+    }
+
+    if (TEST_PASSED == failed) {
+        flockfile(stdout);
+        printf("\nThread %d random reads of %lu bytes:\n", test_parameters->id, len);
+        printf("%10s %7s %10s %8s %10s %10s %10s %10s %10s\n",
+               "Spacing", "Points", "Index_KB", "Reads", "Mean_us",
+               "p50_us", "p90_us", "p99_us", "Max_us");
+        for (sp = 0; sp < ZRAN_NUM_SPACINGS; sp++) {
+            if (0 == latency[sp].count)
+                continue;
+            printf("%10lu %7lu %10.1f %8llu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                   zran_spacings[sp], num_selected[sp],
+                   (double)num_selected[sp] * sizeof(zran_point_t) / 1024,
+                   latency[sp].count,
+                   (double)read_ns[sp] / latency[sp].count / 1000,
+                   (double)tests_histogram_percentile(&latency[sp], 50) / 1000,
+                   (double)tests_histogram_percentile(&latency[sp], 90) / 1000,
+                   (double)tests_histogram_percentile(&latency[sp], 99) / 1000,
+                   (double)latency[sp].max / 1000);
+        }
+        funlockfile(stdout);
+    }
+
+    inflateEnd(&strm);
+    free(selected);
+    free(discard);
+    free(buf);
+    return failed;
+}
+
+
+
+int
+shutdown_corpus_zran(test_parameters_t* test_parameters)
+{
+    if (test_parameters->index_buf) {
+        free(test_parameters->index_buf);
+        test_parameters->index_buf = NULL;
+        test_parameters->index_len = 0;
+    }
+    return tests_shutdown_corpus_decompression(test_parameters);
+}
+
+
+
+/******************************************************************************
+* function:
+*     tests_startup_corpus_zran  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get created/set within this function.
+*
+* description:
+*	setup a random access decompression job, indexing the compressed corpus
+*
+******************************************************************************/
+int
+tests_startup_corpus_zran(test_parameters_t* test_parameters)
+{
+   return startup_corpus_zran(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_run_corpus_zran  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function.
+*
+* description:
+*	run a random access decompression job
+*
+******************************************************************************/
+int
+tests_run_corpus_zran(test_parameters_t* test_parameters)
+{
+    return run_corpus_zran(test_parameters);
+}
+
+/******************************************************************************
+* function:
+*     tests_shutdown_corpus_zran  (test_parameters_t* test_parameters)
+*
+* @param test_parameters [IN] - struct containing all the parameters/buffers used.
+*                               it is passed in as a pointer as some of the values will get updated
+*                               within the function. Specifically the input/output buffers and lengths
+*                               will get freed/set to zero within this function.
+*
+* description:
+*	shutdown a random access decompression job
+*
+******************************************************************************/
+int
+tests_shutdown_corpus_zran(test_parameters_t* test_parameters)
+{
+    return shutdown_corpus_zran(test_parameters);
+}